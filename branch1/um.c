@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <except.h>
 #include <inttypes.h>
+#include <string.h>
 
 #define UM_WORD_WIDTH 32
 #define MAX_VAL 4294967296
@@ -96,48 +97,50 @@ typedef struct UM {
 
 UM um;
 
-static inline void op_conditional_move(Um_register ra, Um_register rb,
-                                                            Um_register rc)
+static inline void op_conditional_move(uint32_t *registers, Um_register ra,
+                                       Um_register rb, Um_register rc)
 {
-    if (um.registers[rc] != 0) {
-        um.registers[ra] = um.registers[rb];
+    if (registers[rc] != 0) {
+        registers[ra] = registers[rb];
     }
 }
 
-static inline void op_segmented_load(Um_register ra, Um_register rb,
-                                                            Um_register rc)
+static inline void op_segmented_load(uint32_t *registers, Um_register ra,
+                                     Um_register rb, Um_register rc)
 {
-  um.registers[ra] =
-  ((segments.seg_array[um.registers[rb]]).words)[um.registers[rc]];
+  registers[ra] =
+  ((segments.seg_array[registers[rb]]).words)[registers[rc]];
 }
 
-static inline void op_segmented_store(Um_register ra, Um_register rb,
-                                                            Um_register rc)
+static inline void op_segmented_store(uint32_t *registers, Um_register ra,
+                                      Um_register rb, Um_register rc)
 {
-    ((segments.seg_array[um.registers[ra]]).words)[um.registers[rb]] =
-    um.registers[rc];
+    ((segments.seg_array[registers[ra]]).words)[registers[rb]] =
+    registers[rc];
 }
 
-static inline void op_addition(Um_register ra, Um_register rb, Um_register rc)
+static inline void op_addition(uint32_t *registers, Um_register ra,
+                               Um_register rb, Um_register rc)
 {
-    um.registers[ra] = (um.registers[rb] + um.registers[rc]) % MAX_VAL;
+    registers[ra] = (registers[rb] + registers[rc]) % MAX_VAL;
 }
 
-static inline void op_multiplication(Um_register ra, Um_register rb,
-                                                              Um_register rc)
+static inline void op_multiplication(uint32_t *registers, Um_register ra,
+                                     Um_register rb, Um_register rc)
 {
-      um.registers[ra] = (um.registers[rb] * um.registers[rc]) % MAX_VAL;
+      registers[ra] = (registers[rb] * registers[rc]) % MAX_VAL;
 }
 
-static inline void op_division(Um_register ra, Um_register rb, Um_register rc)
+static inline void op_division(uint32_t *registers, Um_register ra,
+                               Um_register rb, Um_register rc)
 {
-      um.registers[ra] = um.registers[rb] / um.registers[rc];
+      registers[ra] = registers[rb] / registers[rc];
 }
 
-static inline void op_bitwise_NAND(Um_register ra, Um_register rb,
-                                                              Um_register rc)
+static inline void op_bitwise_NAND(uint32_t *registers, Um_register ra,
+                                   Um_register rb, Um_register rc)
 {
-      um.registers[ra] = ~(um.registers[rb] & um.registers[rc]);
+      registers[ra] = ~(registers[rb] & registers[rc]);
 }
 
 static inline void op_map_segment(Um_register rb, Um_register rc)
@@ -220,9 +223,10 @@ static inline void op_load_program(Um_register rb, Um_register rc)
     (segments.seg_array[0]).words = new_words;
 }
 
-static inline void op_load_value(Um_register ra, uint32_t value)
+static inline void op_load_value(uint32_t *registers, Um_register ra,
+                                 uint32_t value)
 {
-    um.registers[ra] = value;
+    registers[ra] = value;
 }
 
 Except_T Bitpack_Overflow = { "Overflow packing bits" };
@@ -303,8 +307,24 @@ void read_instructions (FILE *fp) {
     unmapped_Dynamic_Array_init();
 }
 
+static inline void store_frame(const uint32_t *registers, uint32_t counter)
+{
+    memcpy(um.registers, registers, sizeof(um.registers));
+    um.counter = counter;
+}
+
+static inline void load_frame(uint32_t *registers, uint32_t *counter)
+{
+    memcpy(registers, um.registers, sizeof(um.registers));
+    *counter = um.counter;
+}
+
 void execute_instructions () {
 
+    uint32_t registers[NUM_REGISTERS];
+    uint32_t counter;
+    load_frame(registers, &counter);
+
     Um_register ra = -1;
     Um_register rb = -1;
     Um_register rc = -1;
@@ -316,7 +336,7 @@ void execute_instructions () {
 
     while (doLoop) {
 
-        cur_instruction = instructions[um.counter];
+        cur_instruction = instructions[counter];
 
         opcode = Bitpack_getu(cur_instruction, 4, 28);
 
@@ -325,79 +345,90 @@ void execute_instructions () {
               ra = Bitpack_getu(cur_instruction, 3, 6);
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_conditional_move(ra, rb, rc);
+              op_conditional_move(registers, ra, rb, rc);
               break;
           case SLOAD:
               ra = Bitpack_getu(cur_instruction, 3, 6);
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_segmented_load(ra, rb, rc);
+              op_segmented_load(registers, ra, rb, rc);
               break;
           case SSTORE:
               ra = Bitpack_getu(cur_instruction, 3, 6);
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_segmented_store(ra, rb, rc);
+              op_segmented_store(registers, ra, rb, rc);
               break;
           case ADD:
               ra = Bitpack_getu(cur_instruction, 3, 6);
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_addition(ra, rb, rc);
+              op_addition(registers, ra, rb, rc);
               break;
           case MUL:
               ra = Bitpack_getu(cur_instruction, 3, 6);
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_multiplication(ra, rb, rc);
+              op_multiplication(registers, ra, rb, rc);
               break;
           case DIV:
               ra = Bitpack_getu(cur_instruction, 3, 6);
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_division(ra, rb, rc);
+              op_division(registers, ra, rb, rc);
               break;
           case NAND:
               ra = Bitpack_getu(cur_instruction, 3, 6);
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_bitwise_NAND(ra, rb, rc);
+              op_bitwise_NAND(registers, ra, rb, rc);
               break;
           case HALT:
+              store_frame(registers, counter);
               doLoop = false;
               break;
           case ACTIVATE:
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
+              store_frame(registers, counter);
               op_map_segment(rb, rc);
+              load_frame(registers, &counter);
               break;
           case INACTIVATE:
               rc = Bitpack_getu(cur_instruction, 3, 0);
+              store_frame(registers, counter);
               op_unmap_segment(rc);
+              load_frame(registers, &counter);
               break;
           case OUT:
               rc = Bitpack_getu(cur_instruction, 3, 0);
+              store_frame(registers, counter);
               op_output(rc);
+              load_frame(registers, &counter);
               break;
           case IN:
               rc = Bitpack_getu(cur_instruction, 3, 0);
+              store_frame(registers, counter);
               op_input(rc);
+              load_frame(registers, &counter);
               break;
           case LOADP:
               rb = Bitpack_getu(cur_instruction, 3, 3);
               rc = Bitpack_getu(cur_instruction, 3, 0);
+              store_frame(registers, counter);
               op_load_program(rb, rc);
               if(um.registers[rb] != 0){
                 instructions = (segments.seg_array[0]).words;
               }
+              load_frame(registers, &counter);
               continue;
           case LV:
               ra = Bitpack_getu(cur_instruction, 3, 25);
               uint32_t value = Bitpack_getu(cur_instruction, 25, 0);
-              op_load_value(ra, value);
+              op_load_value(registers, ra, value);
               break;
         }
-        um.counter++;
+        counter++;
     }
 }
 
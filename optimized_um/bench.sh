@@ -0,0 +1,117 @@
+#!/bin/sh
+#
+#   bench.sh
+#   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+#
+#   Times the interpreter, the optimizing tier (-O) and the ahead-of-time
+#   build of each fixed benchmark image, and checks all three print the same
+#   output. Build with `make um aot` first, or run `make bench`.
+#
+#   Then compares running the same image $lanes times in lockstep lanes
+#   (-l) against running it as $lanes separate processes at once, one per
+#   core as the scheduler sees fit, which is how separate threads would
+#   run them: the engine holds one machine per process.
+#
+#   Last, starts a job server (-S) on a local socket and compares $jobs
+#   short jobs submitted to it (-J) against as many fresh runs; the server
+#   prints its queueing and run latency percentiles as it shuts down. Each
+#   submission still starts a client process, so the server's own run
+#   latency is what a fresh run's time per job compares with.
+#
+#   Usage: ./bench.sh [runs]
+
+runs=${1:-3}
+lanes=16
+jobs=200
+
+# Prints the best wall-clock time of $runs runs of a command, leaving the
+# output of the last run in bench.out
+best_time() {
+    best=
+    i=0
+    while [ $i -lt $runs ]; do
+        start=$(date +%s.%N)
+        "$@" < /dev/null > bench.out
+        end=$(date +%s.%N)
+        best=$(echo "$start $end $best" |
+               awk '{ t = $2 - $1; if ($3 != "" && $3 < t) t = $3;
+                      printf "%.2f", t }')
+        i=$((i + 1))
+    done
+    echo $best
+}
+
+status=0
+printf "%-14s %8s %8s %8s %8s\n" image um "um -O" aot speedup
+for bench in sandmark:ums/sandmark.umz midmark:ums/midmark.um; do
+    name=${bench%%:*}
+    image=${bench#*:}
+
+    interpreted=$(best_time ./um $image)
+    mv bench.out bench.expected
+    optimized=$(best_time ./um -O $image)
+    cmp -s bench.out bench.expected || { echo "$name: um -O differs"; status=1; }
+    compiled=$(best_time ./${name}_aot $image)
+    cmp -s bench.out bench.expected || { echo "$name: aot differs"; status=1; }
+
+    printf "%-14s %8s %8s %8s %7sx\n" $(basename $image) $interpreted \
+           $optimized $compiled \
+           $(echo "$interpreted $compiled" | awk '{ printf "%.2f", $1 / $2 }')
+done
+
+# Runs $lanes copies of an image as separate processes at once
+separate() {
+    i=0
+    while [ $i -lt $lanes ]; do
+        ./um "$1" > bench.$i.out &
+        i=$((i + 1))
+    done
+    wait
+}
+
+printf "\n%-14s %8s %8s %8s\n" image lanes separate speedup
+for image in ums/midmark.um; do
+    i=0
+    while [ $i -lt $lanes ]; do
+        : > bench.$i
+        i=$((i + 1))
+    done
+    apart=$(best_time separate $image)
+    mv bench.0.out bench.expected
+    locked=$(best_time ./um -l bench $image)
+    i=0
+    while [ $i -lt $lanes ]; do
+        cmp -s bench.$i.out bench.expected ||
+            { echo "lane $i differs"; status=1; }
+        rm -f bench.$i bench.$i.out
+        i=$((i + 1))
+    done
+
+    printf "%-14s %8s %8s %7sx\n" $(basename $image) $locked $apart \
+           $(echo "$apart $locked" | awk '{ printf "%.2f", $1 / $2 }')
+done
+
+# Runs $jobs jobs of a command one after another
+repeat() {
+    i=0
+    while [ $i -lt $jobs ]; do
+        "$@" > bench.$i.out
+        i=$((i + 1))
+    done
+}
+
+socket=${TMPDIR:-/tmp}/um-bench.$$
+./um -S $socket ums/hello.um &
+server=$!
+sleep 1
+printf "\n%-14s %8s %8s %8s\n" "$jobs jobs" served fresh speedup
+served=$(best_time repeat ./um -J $socket hello.um)
+mv bench.0.out bench.expected
+fresh=$(best_time repeat ./um ums/hello.um)
+cmp -s bench.0.out bench.expected || { echo "served job differs"; status=1; }
+printf "%-14s %8s %8s %7sx\n" hello.um $served $fresh \
+       $(echo "$fresh $served" | awk '{ printf "%.2f", $1 / $2 }')
+kill $server
+wait $server
+rm -f bench.*.out bench.out bench.expected
+exit $status
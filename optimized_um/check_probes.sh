@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+#   check_probes.sh
+#   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+#
+#   Checks the engine's USDT probes (see um_probes.h) build both ways:
+#   lists the notes of um, which come from <sys/sdt.h> where $CC finds it
+#   and are written by um_probes.h otherwise, and checks um holds every
+#   probe the scripts in bpftrace/ attach to. Then checks the engine built
+#   with -DUM_NO_SDT_H holds the same probes as um, and the engine built
+#   with -DUM_NO_PROBES holds none. The notes need x86-64 or sdt.h. Build
+#   um, um_engine_sdtless.o and um_engine_noprobes.o first, or run
+#   `make probes`.
+#
+#   Usage: ./check_probes.sh
+
+status=0
+
+# Reports a failed check and fails the run
+fail() {
+    echo "FAILED: $*"
+    status=1
+}
+
+# Prints the names of the probes in the stapsdt notes of $1, one per line
+probes() {
+    readelf -n "$1" | sed -n 's/^ *Name: //p' | sort -u
+}
+
+if echo '#include <sys/sdt.h>' | ${CC:-gcc} -E - > /dev/null 2>&1; then
+    echo "um: probes from <sys/sdt.h>"
+else
+    echo "um: probes written by um_probes.h (no <sys/sdt.h>)"
+fi
+readelf -n um | grep -A 4 stapsdt
+
+probes um > um.probes
+[ -s um.probes ] || fail "um holds no probes"
+for probe in $(grep -oh 'usdt:[^ {,]*' bpftrace/*.bt | sed 's/.*://'); do
+    grep -qx "$probe" um.probes || fail "um lacks the probe $probe"
+done
+probes um_engine_sdtless.o | cmp -s - um.probes ||
+    fail "um_engine_sdtless.o holds other probes than um"
+readelf -n um_engine_noprobes.o | grep -q stapsdt &&
+    fail "um_engine_noprobes.o holds probes"
+rm -f um.probes
+
+if [ $status -eq 0 ]; then
+    echo "All Probe Checks Succeeded!"
+else
+    echo "Some Probe Checks Failed."
+fi
+exit $status
@@ -0,0 +1,275 @@
+#!/bin/sh
+#
+#   run_tests.sh
+#   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+#
+#   Runs the unit tests of ../um/UMTESTS, as ../um/writetests writes them,
+#   under each set of options below that changes how the engine runs a
+#   program but not what the program does, and checks each prints what its
+#   .1 file expects; -C runs twice, so the second run loads what the first
+#   cached, and -p trains the layout of a run with -O. Then checks what
+#   the options that do more than run a program leave behind, each in a
+#   section of its own below, and the fault safe mode reports for each of
+#   the fault tests. Build um, um2c, umtrace, umslice and ../um/writetests
+#   first, or run `make test`.
+#
+#   Usage: ./run_tests.sh
+
+status=0
+
+# Reports a failed test and fails the run
+fail() {
+    echo "FAILED: $*"
+    status=1
+}
+
+# Runs test $1 with options $2, with its .0 file as input if it has one
+run() {
+    input=/dev/null
+    [ -e "$1.0" ] && input="$1.0"
+    ../um $2 "$1.um" < "$input"
+}
+
+# Checks test $1 prints what its .1 file expects, with options $2
+check() {
+    expected=/dev/null
+    [ -e "$1.1" ] && expected="$1.1"
+    run "$1" "$2" > "$1.mine" 2>&1
+    cmp -s "$1.mine" "$expected" || fail "$1 with options '$2'"
+}
+
+rm -rf tests
+mkdir tests
+cd tests || exit 1
+../../um/writetests > /dev/null || exit 1
+
+for options in "" -s -O "-t 2" -a "-C cache" "-C cache" "-m 1" -c \
+               "-C profiled -p" "-C profiled -O" "-T 60000"; do
+    for test in $(sed 's/\.um$//' ../../um/UMTESTS); do
+        check "$test" "$options"
+    done
+done
+
+# Past a 1 MiB budget, large_segments must spill segments to the backing
+# file, and still read them back
+check large_segments "-m 1 -f spill"
+[ -s spill ] || fail "large_segments did not spill"
+
+# Waiting on input a second with a segment live, input_to_segment must
+# have its segments compacted, and the ratios published
+(sleep 1; cat input_to_segment.0) |
+    ../um -c -w compact.stats input_to_segment.um > input_to_segment.mine 2>&1
+cmp -s input_to_segment.mine input_to_segment.1 || fail "compacting"
+../um -W compact.stats | grep -q ", 1 compactions (fragmentation" ||
+    fail "compaction not published"
+
+# A training run must keep a block transition profile along with the
+# decoded program, which then lays out the blocks of copy_loop
+../um -C unprofiled -O copy_loop.um > /dev/null
+../um -C trained -p copy_loop.um > /dev/null
+[ "$(cat trained/*.umc | wc -c)" -gt "$(cat unprofiled/*.umc | wc -c)" ] ||
+    fail "copy_loop profile not cached"
+check copy_loop "-C trained -O"
+
+# Every test run as a job, twice, on a server of them all must print what
+# it does on its own, and the server must then report its latencies
+../um -S server.socket $(cat ../../um/UMTESTS) 2> server.err &
+server=$!
+tries=0
+while [ ! -S server.socket ] && [ $tries -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+num_jobs=0
+for test in $(sed 's/\.um$//' ../../um/UMTESTS); do
+    for job in 1 2; do
+        check "$test" "-J server.socket"
+        num_jobs=$((num_jobs + 1))
+    done
+done
+
+# Each machine of the server runs job after job, reset in between, so nine
+# jobs of a test among its four machines must each find the machine as
+# loaded, even after tests that rewrite m[0] or map many segments
+for test in self_modifying_restart edit_instruction_segment large_segments; do
+    for job in 1 2 3 4 5 6 7 8 9; do
+        check "$test" "-J server.socket"
+        num_jobs=$((num_jobs + 1))
+    done
+done
+../um -J server.socket stats < /dev/null > server.stats
+grep -q "^run .* over $num_jobs jobs" server.stats || fail "server latencies"
+kill $server
+wait $server
+
+# The server takes only options its jobs can run with
+../um -S refused.socket -s -a halt.um > /dev/null 2>&1 &&
+    fail "server with -s and -a"
+
+# A machine stopped at its time limit must keep what it printed and
+# report where it stopped
+../um -T 100 endless_loop.um > endless_loop.mine 2> endless_loop.err &&
+    fail "endless_loop was not stopped"
+cmp -s endless_loop.mine endless_loop.1 || fail "endless_loop output"
+grep -q "^Time limit of 100 ms exceeded at pc 3" endless_loop.err ||
+    fail "endless_loop report"
+
+# A machine preempted at every block entry and resumed, as run_for does
+# with a budget of one instruction, must print what it does run straight
+# through
+for test in $(sed 's/\.um$//' ../../um/UMTESTS); do
+    input=/dev/null
+    [ -e "$test.0" ] && input="$test.0"
+    expected=/dev/null
+    [ -e "$test.1" ] && expected="$test.1"
+    for options in "" -O; do
+        ../umslice $options 1 "$test.um" < "$input" > "$test.mine" \
+            2> "$test.slices" || fail "$test in slices with '$options'"
+        cmp -s "$test.mine" "$expected" ||
+            fail "$test in slices with '$options'"
+    done
+done
+[ "$(cut -d ' ' -f 1 copy_loop.slices)" -gt 1 ] ||
+    fail "copy_loop was not preempted"
+
+# A machine reset after it halts must run again as if freshly loaded,
+# whether the pool keeps its memory or releases it
+for test in $(sed 's/\.um$//' ../../um/UMTESTS); do
+    [ -e "$test.0" ] && continue
+    expected=/dev/null
+    [ -e "$test.1" ] && expected="$test.1"
+    for options in "" -O; do
+        ../umslice $options -n 3 100 "$test.um" > "$test.mine" 2> /dev/null
+        cat "$expected" "$expected" "$expected" | cmp -s - "$test.mine" ||
+            fail "$test reset with '$options'"
+    done
+done
+
+# umtrace must replay the trace of every test to the same output, one
+# listed instruction for each the summary counts
+for test in $(sed 's/\.um$//' ../../um/UMTESTS); do
+    run "$test" "-x $test.trace" > /dev/null 2>&1
+    expected=/dev/null
+    [ -e "$test.1" ] && expected="$test.1"
+    ../umtrace "$test.trace" > "$test.listing" || fail "$test trace"
+    awk '$2 == "OUT" { print $3 }' "$test.listing" | while read -r byte; do
+        printf "\\$(printf %o "$byte")"
+    done > "$test.mine"
+    cmp -s "$test.mine" "$expected" || fail "$test trace output"
+    executed=$(../umtrace -s "$test.trace" | head -n 1 | cut -d ' ' -f 1)
+    [ "$(grep -c '^ *[0-9]' "$test.listing")" = "$executed" ] ||
+        fail "$test trace summary"
+done
+[ "$(grep -c 'MAP .*(1000 words)' copy_loop.listing)" = 2 ] ||
+    fail "copy_loop trace maps"
+
+# The timeline of every test must be valid JSON, where python3 can check
+# it; large_segments must show every map, or one in four with -E 4, and
+# always the exact count of live segments
+for test in $(sed 's/\.um$//' ../../um/UMTESTS); do
+    check "$test" "-e $test.json"
+    if command -v python3 > /dev/null; then
+        python3 -m json.tool "$test.json" > /dev/null ||
+            fail "$test timeline is not JSON"
+    fi
+done
+[ "$(grep -c '"name":"map"' large_segments.json)" = 16 ] ||
+    fail "large_segments timeline maps"
+check large_segments "-e sampled.json -E 4"
+[ "$(grep -c '"name":"map"' sampled.json)" = 4 ] ||
+    fail "large_segments sampled timeline maps"
+grep '"live segments"' sampled.json | tail -n 1 | grep -q '"segments":16,' ||
+    fail "large_segments sampled live segments"
+grep -q '"name":"input wait"' input.json || fail "input timeline"
+
+# The statistics a run publishes must count what it did, and -W must
+# print them once it halts
+check input "-w input.stats"
+../um -W input.stats | grep -q \
+    ": .*, 7 instructions .*, 3 bytes in, 3 bytes out, halted$" ||
+    fail "input statistics"
+check large_segments "-w large_segments.stats"
+../um -W large_segments.stats | grep -q " 16 segments (4.0 MiB), " ||
+    fail "large_segments statistics"
+check halt_instruction_from_load_program "-w load_program.stats"
+../um -W load_program.stats | grep -q " 1 load programs, " ||
+    fail "halt_instruction_from_load_program statistics"
+check fill_loop "-O -w fill_loop.stats"
+../um -W fill_loop.stats |
+    grep -q "loop idioms removed 0 copy, [1-9][0-9]* fill and 0 compare" ||
+    fail "fill_loop statistics"
+
+# A running machine must print its statistics on SIGUSR1, and -W must see
+# it exit without halting once its time limit stops it
+../um -T 500 -w endless.stats endless_loop.um > /dev/null 2> endless.err &
+machine=$!
+tries=0
+while [ ! -s endless.stats ] && [ $tries -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+sleep 0.1
+kill -USR1 $machine
+wait $machine
+grep -q "^um $machine: .* instructions " endless.err ||
+    fail "endless_loop statistics on SIGUSR1"
+../um -W endless.stats > endless.watched &&
+    fail "endless_loop watched as halted"
+tail -n 1 endless.watched | grep -q "exited without halting" ||
+    fail "endless_loop watched"
+
+# The compiled build of a program must leave the compiled code of each
+# word the program rewrites
+aot=self_modifying_loop_aot
+(cd .. && ./um2c tests/self_modifying_loop.um > $aot.c &&
+ make $aot > /dev/null) || fail "$aot build"
+../$aot self_modifying_loop.um > $aot.mine 2>&1
+cmp -s $aot.mine self_modifying_loop.1 || fail "$aot"
+rm -f ../$aot ../$aot.c ../$aot.o
+
+# Replaying the input a run recorded must print what the run printed,
+# with nothing on stdin
+run input "-r input.record" > input.mine 2>&1
+cmp -s input.mine input.1 || fail "input recorded"
+../um -R input.record input.um < /dev/null > input.mine 2>&1
+cmp -s input.mine input.1 || fail "input replayed"
+
+# Machines run in lockstep must each print what they would alone: the
+# input test, which echoes its input, on its own input and on another
+cp input.0 lanes.0
+printf 'UMV' > lanes.1
+../um -l lanes input.um < /dev/null > lanes.mine 2>&1 || fail "lanes"
+cmp -s lanes.mine /dev/null || fail "lanes printed"
+cmp -s lanes.0.out input.1 || fail "lanes, lane 0"
+cmp -s lanes.1.out lanes.1 || fail "lanes, lane 1"
+
+# Each stage of a pipeline must read what the last printed: the input
+# test echoes stdin through two stages, then what conditional_move prints
+../um -P input.um input.um < input.0 > pipeline.mine 2>&1
+cmp -s pipeline.mine input.1 || fail "pipeline from stdin"
+../um -P conditional_move.um input.um < /dev/null > pipeline.mine 2>&1
+cmp -s pipeline.mine conditional_move.1 || fail "pipeline"
+
+# The first line safe mode prints for each fault test: the fault, and the
+# pc and opcode of the instruction that caused it
+while IFS='|' read -r test report; do
+    run "$test" -s > "$test.mine" 2>&1 && fail "$test did not fail"
+    [ "$(head -n 1 "$test.mine")" = "$report" ] || fail "$test report"
+done <<EOF
+fault_division|um: division by zero at pc 1 (opcode 5)
+fault_unmapped_load|um: access to an unmapped segment at pc 1 (opcode 1)
+fault_out_of_bounds_load|um: out-of-bounds segment access at pc 2 (opcode 1)
+fault_far_store|um: out-of-bounds segment access at pc 3 (opcode 2)
+fault_fused_store|um: access to an unmapped segment at pc 1 (opcode 2)
+fault_fused_load|um: out-of-bounds segment access at pc 3 (opcode 1)
+fault_fused_load_add_store|um: out-of-bounds segment access at pc 6 (opcode 2)
+fault_fused_load_program|um: access to an unmapped segment at pc 3 (opcode 12)
+EOF
+
+cd ..
+if [ $status -eq 0 ]; then
+    echo "All Tests Succeeded!"
+else
+    echo "Some Tests Failed."
+fi
+exit $status
@@ -7,23 +7,304 @@
 */
 
 #include "um_engine.h"
+#include "um_asm.h"
+#include "um_lanes.h"
+#include "um_pipe.h"
+#include "um_serve.h"
+#include "um_stats.h"
 #include <assert.h>
+#include <unistd.h>
+#ifdef UM_AOT
+#include "um_aot.h"
+#endif
+
+static void usage()
+{
+    fprintf(stderr, "Usage: ./um [-s] [-m MiB [-f file]] [-c] [-O] [-t N] "
+                    "[-C dir [-p]] [-d prefix] [-a] [-T ms]\n"
+                    "            [-r file | -R file] [-x trace] "
+                    "[-e timeline [-E N]] [-w file] [-l prefix]\n"
+                    "            [-P] [-S socket]\n"
+                    "            [um instruction file ...]\n"
+                    "       ./um -J socket program\n"
+                    "       ./um -W file\n"
+                    "  -s       safe mode: report out-of-bounds, unmapped and "
+                    "divide-by-zero faults\n"
+                    "  -m MiB   spill cold segments to disk past MiB of "
+                    "segment memory\n"
+                    "  -f file  backing file for spilled segments\n"
+                    "  -c       compact fragmented segment memory while "
+                    "waiting for input\n"
+                    "  -O       optimize basic blocks before running "
+                    "them\n"
+                    "  -t N     optimize basic blocks on a background thread "
+                    "once entered N times\n"
+                    "  -C dir   keep the decoded form of each program in "
+                    "dir for later runs\n"
+                    "  -p       profile block transitions into the cache, "
+                    "to lay out hot blocks\n"
+                    "           together on later runs with -O\n"
+                    "  -d prefix  write each program loaded from another "
+                    "segment to prefix.N.um\n"
+                    "  -a       run on the hand-written x86-64 interpreter "
+                    "core\n"
+                    "  -T ms    stop a program that has not halted after ms "
+                    "milliseconds\n"
+                    "  -r file  record every input the program reads to "
+                    "file\n"
+                    "  -R file  replay the input recorded in file instead "
+                    "of reading stdin\n"
+                    "  -x trace  write an execution trace, to be read with "
+                    "umtrace\n"
+                    "  -e timeline  write a timeline of segment, load program "
+                    "and I/O events,\n"
+                    "           in the Chrome trace format\n"
+                    "  -E N     record one segment map and unmap in N on the "
+                    "timeline\n"
+                    "  -w file  publish live statistics in file, and print "
+                    "them on SIGUSR1\n"
+                    "  -l prefix  run one machine per input file prefix.0, "
+                    "prefix.1, ... in\n"
+                    "           lockstep, writing prefix.N.out\n"
+                    "  -P       run each file as a stage of a pipeline, "
+                    "each stage's output\n"
+                    "           feeding the next stage's input\n"
+                    "  -S socket  serve jobs for each file on a Unix socket "
+                    "(only with -s, -c,\n"
+                    "           -O, -a or -T)\n"
+                    "  -J socket  run a job of the named program on a server, "
+                    "with stdin as\n"
+                    "           its input; the program \"stats\" reports "
+                    "job latencies\n"
+                    "  -W file  print the statistics a machine publishes in "
+                    "file every second\n"
+                    "           until it halts\n");
+    exit(EXIT_FAILURE);
+}
 
 int main(int argc, char **argv)
 {
+    // Parse the options
+    Um_options options = { .safe = false, .memory_budget = 0,
+                           .spill_path = NULL, .compact = false,
+                           .optimize = false, .tier_threshold = 0,
+                           .cache_dir = NULL, .profile = false,
+                           .dump_prefix = NULL, .asm_core = false,
+                           .input_ring = NULL, .output_ring = NULL,
+                           .time_limit_ms = 0, .pool = false,
+                           .record_path = NULL, .replay_path = NULL,
+                           .trace_path = NULL, .events_path = NULL,
+                           .event_sample = 1, .stats_path = NULL,
+                           .aot_images = NULL, .num_aot_images = 0 };
+#ifdef UM_AOT
+    // Programs compiled into this build by um2c
+    options.aot_images = um_aot_images;
+    options.num_aot_images = um_aot_num_images;
+#endif
+    const char *lanes_prefix = NULL;
+    bool pipeline = false;
+    const char *serve_socket = NULL, *job_socket = NULL;
+    const char *watch_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv,
+                         "sm:f:cOt:C:pd:aT:r:R:x:e:E:w:l:PS:J:W:")) != -1) {
+        switch (opt) {
+          case 's':
+              options.safe = true;
+              break;
+          case 'm':
+              options.memory_budget = strtoull(optarg, NULL, 10) << 20;
+              if (options.memory_budget == 0) {
+                  usage();
+              }
+              break;
+          case 'f':
+              options.spill_path = optarg;
+              break;
+          case 'c':
+              options.compact = true;
+              break;
+          case 'O':
+              options.optimize = true;
+              break;
+          case 't':
+              options.tier_threshold = strtoul(optarg, NULL, 10);
+              if (options.tier_threshold == 0) {
+                  usage();
+              }
+              options.optimize = true;
+              break;
+          case 'C':
+              options.cache_dir = optarg;
+              break;
+          case 'p':
+              options.profile = true;
+              options.optimize = true;
+              break;
+          case 'd':
+              options.dump_prefix = optarg;
+              break;
+          case 'a':
+              options.asm_core = true;
+              break;
+          case 'T':
+              options.time_limit_ms = strtoul(optarg, NULL, 10);
+              if (options.time_limit_ms == 0) {
+                  usage();
+              }
+              break;
+          case 'r':
+              options.record_path = optarg;
+              break;
+          case 'R':
+              options.replay_path = optarg;
+              break;
+          case 'x':
+              options.trace_path = optarg;
+              break;
+          case 'e':
+              options.events_path = optarg;
+              break;
+          case 'E':
+              options.event_sample = strtoul(optarg, NULL, 10);
+              if (options.event_sample == 0) {
+                  usage();
+              }
+              break;
+          case 'w':
+              options.stats_path = optarg;
+              break;
+          case 'l':
+              lanes_prefix = optarg;
+              break;
+          case 'P':
+              pipeline = true;
+              break;
+          case 'S':
+              serve_socket = optarg;
+              break;
+          case 'J':
+              job_socket = optarg;
+              break;
+          case 'W':
+              watch_path = optarg;
+              break;
+          default:
+              usage();
+        }
+    }
+
+    if (watch_path != NULL) {
+        if (argc != optind) {
+            usage();
+        }
+        exit(watch_stats(watch_path) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     // Open the file
-    if (argc != 2) {
-        fprintf(stderr, "Usage: ./um [um instruction file]\n");
+    if (argc - optind != 1 &&
+        !((pipeline || serve_socket != NULL) && argc - optind >= 1)) {
+        usage();
+    }
+    if (job_socket != NULL) {
+        exit(submit_job(job_socket, argv[optind]) ? EXIT_SUCCESS :
+                                                    EXIT_FAILURE);
+    }
+    if (options.safe + (options.memory_budget != 0) + options.compact > 1) {
+        fprintf(stderr, "Only one of -s, -m and -c can be used at a time.\n");
         exit(EXIT_FAILURE);
     }
-    FILE *fp = fopen(argv[1], "r");
+    if (options.safe && options.optimize) {
+        // Safe mode interprets every instruction, so that each access is
+        // checked and each fault reported at the instruction that caused it
+        fprintf(stderr, "-s cannot be combined with -O, -t or -p.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.profile && options.cache_dir == NULL) {
+        fprintf(stderr, "-p needs a cache directory (-C).\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.asm_core && !UM_HAVE_ASM_CORE) {
+        fprintf(stderr, "-a is only available on x86-64.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.asm_core && (options.safe || options.memory_budget != 0 ||
+                             options.optimize)) {
+        fprintf(stderr, "-a cannot be combined with -s, -m, -O, -t or "
+                        "-p.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (serve_socket != NULL) {
+        if (options.memory_budget != 0 || options.tier_threshold != 0 ||
+            options.cache_dir != NULL || options.dump_prefix != NULL ||
+            options.record_path != NULL || options.replay_path != NULL ||
+            options.trace_path != NULL || options.events_path != NULL ||
+            options.stats_path != NULL || lanes_prefix != NULL || pipeline) {
+            fprintf(stderr, "-S cannot be combined with -m, -t, -C, -p, -d, "
+                            "-r, -R, -x, -e, -w, -l or -P.\n");
+            exit(EXIT_FAILURE);
+        }
+        exit(serve(serve_socket, argv + optind, argc - optind, &options) ?
+             EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (options.record_path != NULL && options.replay_path != NULL) {
+        fprintf(stderr, "-r and -R cannot be used together.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pipeline && (options.record_path != NULL ||
+                     options.replay_path != NULL)) {
+        fprintf(stderr, "-P cannot be combined with -r or -R.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.trace_path != NULL && (options.safe || options.optimize ||
+                                       options.asm_core || pipeline)) {
+        fprintf(stderr, "-x cannot be combined with -s, -O, -t, -p, -a or "
+                        "-P.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.event_sample != 1 && options.events_path == NULL) {
+        fprintf(stderr, "-E needs a timeline (-e).\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((options.events_path != NULL || options.stats_path != NULL) &&
+        pipeline) {
+        fprintf(stderr, "-e and -w cannot be combined with -P.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (lanes_prefix != NULL && pipeline) {
+        fprintf(stderr, "-l and -P cannot be used together.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pipeline) {
+        exit(run_pipeline(argv + optind, argc - optind, &options) ?
+             EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (lanes_prefix != NULL && (options.safe || options.memory_budget != 0 ||
+                                 options.compact || options.optimize ||
+                                 options.cache_dir != NULL ||
+                                 options.dump_prefix != NULL ||
+                                 options.asm_core ||
+                                 options.time_limit_ms != 0 ||
+                                 options.record_path != NULL ||
+                                 options.replay_path != NULL ||
+                                 options.trace_path != NULL ||
+                                 options.events_path != NULL ||
+                                 options.stats_path != NULL)) {
+        fprintf(stderr, "-l cannot be combined with other options.\n");
+        exit(EXIT_FAILURE);
+    }
+    FILE *fp = fopen(argv[optind], "r");
     if (fp == NULL) {
         fprintf(stderr, "Specified um instruction file does not exist.\n");
         exit(EXIT_FAILURE);
     }
 
-    // Create and run a UM emulator
-    run_um(fp);
+    // Create and run a UM emulator, or one per lane
+    if (lanes_prefix != NULL) {
+        run_lanes(fp, lanes_prefix);
+    } else {
+        run_um(fp, &options);
+    }
 
     // Close the file
     fclose(fp);
@@ -0,0 +1,361 @@
+/*
+*   um2c.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This file holds um2c, the ahead-of-time compiler. It translates UM
+*   programs into a C file defining um_aot_images (see um_aot.h), to be
+*   linked with the engine and the AOT build of the driver:
+*
+*       ./um2c sandmark.umz sandmark.1.um > sandmark_aot.c
+*
+*   A program becomes one function holding a switch on the pc. Its entries
+*   are pc 0, every value an LV loads that is a pc, and every pc after a
+*   LOADP; the basic blocks reachable from them become straight-line C
+*   code under their case labels, with the registers as locals. A LOADP
+*   whose target was loaded by an LV earlier in the block jumps straight to
+*   it; any other jump goes back through the switch, and jumps to pcs that
+*   are not entries or are stale after a store into m[0] return to the
+*   interpreter.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "um_util.h"
+
+/*
+* read_program
+* Reads the big-endian words of a .um file
+* Arguments:
+*   - path - the file
+*   - length - where the number of words is stored
+* Return: the malloc'd words, or NULL if the file cannot be read
+*/
+static uint32_t *read_program(const char *path, uint32_t *length)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    uint32_t capacity = 1024;
+    uint32_t *words = malloc(capacity * sizeof(*words));
+    *length = 0;
+    int byte;
+    while (words != NULL && (byte = getc(fp)) != EOF) {
+        uint32_t word = byte;
+        for (int i = 0; i < 3 && byte != EOF; i++) {
+            byte = getc(fp);
+            word = (word << 8) | (byte & 0xff);
+        }
+        if (byte == EOF) {
+            fprintf(stderr, "um2c: %s ends in a partial word\n", path);
+            exit(EXIT_FAILURE);
+        }
+        if (*length == capacity) {
+            capacity *= 2;
+            words = realloc(words, capacity * sizeof(*words));
+        }
+        if (words != NULL) {
+            words[(*length)++] = word;
+        }
+    }
+    fclose(fp);
+    return words;
+}
+
+/*
+* find_entries
+* Marks the pcs a jump may enter the program at, and the pcs reachable
+* from them without a jump
+* Arguments:
+*   - words, length - the program
+*   - entry, reachable - arrays of length flags to fill in
+* Return: void
+*/
+static void find_entries(const uint32_t *words, uint32_t length,
+                         bool *entry, bool *reachable)
+{
+    entry[0] = length > 0;
+    for (uint32_t pc = 0; pc < length; pc++) {
+        Um_opcode opcode = words[pc] >> 28;
+        uint32_t value = words[pc] & 0x1ffffff;
+        if (opcode == LV && value < length) {
+            entry[value] = true;
+        }
+        if (opcode == LOADP && pc + 1 < length) {
+            entry[pc + 1] = true;
+        }
+    }
+
+    bool falls_in = false;
+    for (uint32_t pc = 0; pc < length; pc++) {
+        Um_opcode opcode = words[pc] >> 28;
+        reachable[pc] = entry[pc] || falls_in;
+        falls_in = reachable[pc] && opcode != LOADP && opcode != HALT;
+    }
+}
+
+/*
+* find_jumps
+* Finds, for each reachable LOADP, the pc its target register was last set
+* to by an LV in the same block, and marks those pcs as jumped to
+* Arguments:
+*   - words, length - the program
+*   - entry, reachable - the entries and reachable pcs
+*   - hint - array of length targets to fill in, UINT32_MAX where unknown
+*   - jumped_to - array of length flags to fill in
+* Return: void
+*/
+static void find_jumps(const uint32_t *words, uint32_t length,
+                       const bool *entry, const bool *reachable,
+                       uint32_t *hint, bool *jumped_to)
+{
+    uint32_t value[NUM_REGISTERS];
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        value[r] = UINT32_MAX;
+    }
+
+    for (uint32_t pc = 0; pc < length; pc++) {
+        uint32_t word = words[pc];
+        Um_opcode opcode = word >> 28;
+        int a = opcode == LV ? (word >> 25) & 0x7 : (word >> 6) & 0x7;
+        int b = (word >> 3) & 0x7;
+        int c = word & 0x7;
+        hint[pc] = UINT32_MAX;
+        if (!reachable[pc]) {
+            continue;
+        }
+
+        switch (opcode) {
+          case LV:
+              value[a] = word & 0x1ffffff;
+              break;
+          case CMOV:
+          case SLOAD:
+          case ADD:
+          case MUL:
+          case DIV:
+          case NAND:
+              value[a] = UINT32_MAX;
+              break;
+          case ACTIVATE:
+              value[b] = UINT32_MAX;
+              break;
+          case IN:
+              value[c] = UINT32_MAX;
+              break;
+          case LOADP:
+              if (value[c] < length && entry[value[c]]) {
+                  hint[pc] = value[c];
+                  jumped_to[value[c]] = true;
+              }
+              for (int r = 0; r < NUM_REGISTERS; r++) {
+                  value[r] = UINT32_MAX;
+              }
+              break;
+          default:
+              break;
+        }
+    }
+}
+
+/*
+* emit_instruction
+* Writes the C code for the instruction at pc
+*/
+static void emit_instruction(FILE *out, uint32_t pc, uint32_t word,
+                             uint32_t hint)
+{
+    Um_opcode opcode = word >> 28;
+    int a = (word >> 6) & 0x7;
+    int b = (word >> 3) & 0x7;
+    int c = word & 0x7;
+
+    switch (opcode) {
+      case CMOV:
+          fprintf(out, "        if (r%d) r%d = r%d;\n", c, a, b);
+          break;
+      case SLOAD:
+          fprintf(out, "        r%d = um->words[r%d][r%d];\n", a, b, c);
+          break;
+      case SSTORE:
+          fprintf(out, "        if (r%d != 0) um->words[r%d][r%d] = r%d;\n",
+                  a, a, b, c);
+          fprintf(out, "        else if (aot_store_code(%" PRIu32 "u, r%d, "
+                       "r%d)) { pc = %" PRIu32 "u; goto interpret; }\n",
+                  pc, b, c, pc + 1);
+          break;
+      case ADD:
+          fprintf(out, "        r%d = r%d + r%d;\n", a, b, c);
+          break;
+      case MUL:
+          fprintf(out, "        r%d = r%d * r%d;\n", a, b, c);
+          break;
+      case DIV:
+          fprintf(out, "        r%d = r%d / r%d;\n", a, b, c);
+          break;
+      case NAND:
+          fprintf(out, "        r%d = ~(r%d & r%d);\n", a, b, c);
+          break;
+      case HALT:
+          fprintf(out, "        pc = %" PRIu32 "u;\n", pc);
+          fprintf(out, "        goto halt;\n");
+          break;
+      case ACTIVATE:
+          fprintf(out, "        registers[%d] = r%d;\n", c, c);
+          fprintf(out, "        aot_step(0x%08" PRIx32 "u);\n", word);
+          fprintf(out, "        r%d = registers[%d];\n", b, b);
+          break;
+      case INACTIVATE:
+      case OUT:
+          fprintf(out, "        registers[%d] = r%d;\n", c, c);
+          fprintf(out, "        aot_step(0x%08" PRIx32 "u);\n", word);
+          break;
+      case IN:
+          fprintf(out, "        um->counter = %" PRIu32 "u;\n", pc);
+          fprintf(out, "        aot_step(0x%08" PRIx32 "u);\n", word);
+          fprintf(out, "        r%d = registers[%d];\n", c, c);
+          break;
+      case LOADP:
+          fprintf(out, "        if (r%d != 0) { pc = %" PRIu32 "u; "
+                       "goto interpret; }\n", b, pc);
+          fprintf(out, "        pc = r%d;\n", c);
+          if (hint != UINT32_MAX) {
+              fprintf(out, "        if (pc == %" PRIu32 "u && !aot_stale[pc]) "
+                           "goto L%" PRIu32 ";\n", hint, hint);
+          }
+          fprintf(out, "        goto dispatch;\n");
+          break;
+      case LV:
+          fprintf(out, "        r%d = %" PRIu32 "u;\n", (int)(word >> 25) & 0x7,
+                  word & 0x1ffffff);
+          break;
+      default:
+          // Invalid instructions do nothing, as in the interpreter
+          break;
+    }
+}
+
+/*
+* emit_image
+* Writes the words of a program and the function that runs it
+*/
+static void emit_image(FILE *out, int index, const uint32_t *words,
+                       uint32_t length)
+{
+    bool *entry = calloc(length + 1, sizeof(bool));
+    bool *reachable = calloc(length + 1, sizeof(bool));
+    bool *jumped_to = calloc(length + 1, sizeof(bool));
+    uint32_t *hint = calloc(length + 1, sizeof(uint32_t));
+    if (entry == NULL || reachable == NULL || jumped_to == NULL ||
+        hint == NULL) {
+        fprintf(stderr, "um2c: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    find_entries(words, length, entry, reachable);
+    find_jumps(words, length, entry, reachable, hint, jumped_to);
+
+    fprintf(out, "static const uint32_t words_%d[] = {", index);
+    for (uint32_t pc = 0; pc < length; pc++) {
+        fprintf(out, "%s0x%08" PRIx32 "u,", pc % 6 == 0 ? "\n    " : " ",
+                words[pc]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static Um_aot_exit run_%d(UM *um)\n{\n", index);
+    fprintf(out, "    uint32_t *registers = um->registers;\n");
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        fprintf(out, "    uint32_t r%d = registers[%d];\n", r, r);
+    }
+    fprintf(out, "    uint32_t pc = um->counter;\n\n");
+
+    bool jumps = false;
+    for (uint32_t pc = 0; pc < length; pc++) {
+        jumps |= reachable[pc] && words[pc] >> 28 == LOADP;
+    }
+    fprintf(out, "%s    if (pc < %" PRIu32 "u && aot_stale[pc]) "
+                 "goto interpret;\n", jumps ? "dispatch:\n" : "", length);
+    fprintf(out, "    switch (pc) {\n");
+    fprintf(out, "      default:\n        goto interpret;\n");
+
+    bool halts = false;
+    for (uint32_t pc = 0; pc < length; pc++) {
+        if (!reachable[pc]) {
+            continue;
+        }
+        if (entry[pc]) {
+            if (pc > 0 && reachable[pc - 1] &&
+                words[pc - 1] >> 28 != LOADP && words[pc - 1] >> 28 != HALT) {
+                fprintf(out, "        /* fall through */\n");
+            }
+            fprintf(out, "      case %" PRIu32 "u:\n", pc);
+            if (jumped_to[pc]) {
+                fprintf(out, "      L%" PRIu32 ":\n", pc);
+            }
+        }
+        emit_instruction(out, pc, words[pc], hint[pc]);
+        halts |= words[pc] >> 28 == HALT;
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "    pc = %" PRIu32 "u;\n\n", length);
+
+    // Hand the machine back with the registers written out
+    fprintf(out, "interpret:\n");
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        fprintf(out, "    registers[%d] = r%d;\n", r, r);
+    }
+    fprintf(out, "    um->counter = pc;\n");
+    fprintf(out, "    return AOT_INTERPRET;\n");
+    if (halts) {
+        fprintf(out, "\nhalt:\n");
+        for (int r = 0; r < NUM_REGISTERS; r++) {
+            fprintf(out, "    registers[%d] = r%d;\n", r, r);
+        }
+        fprintf(out, "    um->counter = pc;\n");
+        fprintf(out, "    return AOT_HALT;\n");
+    }
+    fprintf(out, "}\n\n");
+
+    free(entry);
+    free(reachable);
+    free(jumped_to);
+    free(hint);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: ./um2c program.um [program.um ...] > "
+                        "program_aot.c\n");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *out = stdout;
+    fprintf(out, "/*\n*   Generated by um2c from");
+    for (int i = 1; i < argc; i++) {
+        fprintf(out, " %s", argv[i]);
+    }
+    fprintf(out, "; do not edit\n*/\n\n#include \"um_aot.h\"\n\n");
+
+    uint32_t *lengths = malloc(argc * sizeof(*lengths));
+    for (int i = 1; i < argc; i++) {
+        uint32_t *words = read_program(argv[i], &lengths[i]);
+        if (words == NULL) {
+            fprintf(stderr, "um2c: could not read %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        emit_image(out, i - 1, words, lengths[i]);
+        free(words);
+    }
+
+    fprintf(out, "const Um_aot_image um_aot_images[] = {\n");
+    for (int i = 1; i < argc; i++) {
+        fprintf(out, "    { words_%d, %" PRIu32 "u, run_%d },\n", i - 1,
+                lengths[i], i - 1);
+    }
+    fprintf(out, "};\n\nconst uint32_t um_aot_num_images = %d;\n", argc - 1);
+    free(lengths);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/*
+*   um_aot.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the interface between the engine and programs
+*   compiled ahead of time by um2c. A compiled program runs m[0] natively
+*   from the instructions of the image it was compiled from that m[0] still
+*   holds, and hands the machine back to the interpreter for anything else.
+*/
+
+#ifndef UM_AOT_INCLUDED
+#define UM_AOT_INCLUDED
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "um_util.h"
+
+/*
+* How compiled code gave the machine back
+*/
+typedef enum Um_aot_exit {
+    AOT_HALT,       // the machine halted
+    AOT_INTERPRET   // the interpreter continues at um->counter
+} Um_aot_exit;
+
+/*
+* Um_aot_image struct that represents a compiled program: the words it was
+* compiled from, and the function that runs it from um->counter. The code
+* returns AOT_INTERPRET with the instruction it stopped at unexecuted when
+* it reaches a pc it has no entry for or that is stale, or a LOADP of
+* another segment.
+*/
+typedef struct Um_aot_image {
+    const uint32_t *words;
+    uint32_t length;
+    Um_aot_exit (*run)(UM *um);
+} Um_aot_image;
+
+/*
+* The images linked into an ahead-of-time build, defined by um2c output
+*/
+extern const Um_aot_image um_aot_images[];
+extern const uint32_t um_aot_num_images;
+
+/*
+* Flags, one per word of m[0], set once the word or a word it falls through
+* into no longer holds the instruction compiled for it. Compiled code only
+* enters the image at pcs that are not stale.
+*/
+extern uint8_t *aot_stale;
+
+/*
+* aot_store_code
+* Stores into m[0] for compiled code, marking the words it makes stale
+* Arguments:
+*   - pc - the pc of the store instruction
+*   - index, value - the word stored
+* Return: true if the store made the code after pc stale, so that compiled
+* code must hand over to the interpreter at the next instruction
+*/
+bool aot_store_code(uint32_t pc, uint32_t index, uint32_t value);
+
+/*
+* aot_step
+* Executes a map, unmap, output or input instruction on um->registers for
+* compiled code, which writes back the registers it names first, and the
+* pc of an input instruction to um->counter
+* Arguments:
+*   - word - the instruction
+* Return: void
+*/
+void aot_step(uint32_t word);
+
+#endif
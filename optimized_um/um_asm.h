@@ -0,0 +1,40 @@
+/*
+*   um_asm.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the hand-written x86-64 interpreter core in
+*   um_asm.S. The core keeps the eight UM registers in host registers and
+*   decodes each word of m[0] as it runs it, dispatching through a jump
+*   table indexed by the opcode and the three register fields. It runs
+*   everything but segment mapping, I/O and loading a program from another
+*   segment, which it hands back to the engine one instruction at a time.
+*/
+
+#ifndef UM_ASM_INCLUDED
+#define UM_ASM_INCLUDED
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+* Whether this build has the assembly core
+*/
+#if defined(__x86_64__)
+#define UM_HAVE_ASM_CORE 1
+#else
+#define UM_HAVE_ASM_CORE 0
+#endif
+
+/*
+* um_asm_run
+* Runs m[0] from *counter until the machine halts or reaches an instruction
+* the core leaves to the engine, which is left unexecuted
+* Arguments:
+*   - registers - the eight UM registers, written back on return
+*   - counter - the pc to start at, set to the pc stopped at on return
+*   - segments - the segment table; segments[0] is m[0]
+* Return: true if the machine halted
+*/
+bool um_asm_run(uint32_t *registers, uint32_t *counter, uint32_t **segments);
+
+#endif
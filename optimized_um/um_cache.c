@@ -0,0 +1,394 @@
+/*
+*   um_cache.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_cache. Each entry is a file
+*   named after the hex SHA-256 hash of the engine version, program length
+*   and program words, holding a header, the program words, the decoded
+*   entries and the profile edges. A file is mapped read-only and only used
+*   if its header, hash and words match the program and every decoded entry
+*   is well formed, so a stale or corrupt file is ignored and then replaced.
+*   Files are written to a temporary name and renamed into place, so a
+*   reader never sees a partial entry.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "um_cache.h"
+
+#define HASH_BYTES 32
+
+typedef struct Cache_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t num_ops;
+    uint32_t length;
+    uint32_t num_edges;
+    uint8_t hash[HASH_BYTES];
+} Cache_header;
+
+static const char MAGIC[4] = { 'U', 'M', 'C', '2' };
+
+static const char *cache_dir = NULL;
+static uint32_t engine_version = 0;
+
+// The m[0] being run: its words when loaded, its hash, and the entry it
+// was loaded from, still mapped, or NULL
+static uint32_t *original = NULL;
+static uint32_t original_length = 0;
+static uint8_t original_hash[HASH_BYTES];
+static void *mapped = NULL;
+static size_t mapped_size = 0;
+
+/*
+* SHA-256 (FIPS 180-4)
+*/
+typedef struct Sha256 {
+    uint32_t state[8];
+    uint8_t block[64];
+    uint32_t filled;
+    uint64_t total;
+} Sha256;
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_init(Sha256 *s)
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(s->state, initial, sizeof(initial));
+    s->filled = 0;
+    s->total = 0;
+}
+
+static void sha256_block(Sha256 *s)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t) s->block[4 * i] << 24 |
+               (uint32_t) s->block[4 * i + 1] << 16 |
+               (uint32_t) s->block[4 * i + 2] << 8 | s->block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^
+                      (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^
+                      (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t v[8];
+    memcpy(v, s->state, sizeof(v));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = v[7] + (rotr(v[4], 6) ^ rotr(v[4], 11) ^
+                              rotr(v[4], 25)) +
+                      ((v[4] & v[5]) ^ (~v[4] & v[6])) + K[i] + w[i];
+        uint32_t t2 = (rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22)) +
+                      ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        s->state[i] += v[i];
+    }
+}
+
+static void sha256_update(Sha256 *s, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    s->total += size;
+    while (size > 0) {
+        size_t n = 64 - s->filled < size ? 64 - s->filled : size;
+        memcpy(s->block + s->filled, bytes, n);
+        s->filled += n;
+        bytes += n;
+        size -= n;
+        if (s->filled == 64) {
+            sha256_block(s);
+            s->filled = 0;
+        }
+    }
+}
+
+static void sha256_final(Sha256 *s, uint8_t hash[HASH_BYTES])
+{
+    uint64_t bits = s->total * 8;
+    uint8_t pad = 0x80;
+    sha256_update(s, &pad, 1);
+    pad = 0;
+    while (s->filled != 56) {
+        sha256_update(s, &pad, 1);
+    }
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        uint8_t byte = bits >> shift;
+        sha256_update(s, &byte, 1);
+    }
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) {
+            hash[4 * i + j] = s->state[i] >> (24 - 8 * j);
+        }
+    }
+}
+
+/*
+* entry_path
+* Writes the path of the entry for a hash, with suffix appended
+*/
+static void entry_path(char *path, size_t size, const uint8_t *hash,
+                       const char *suffix)
+{
+    int n = snprintf(path, size, "%s/", cache_dir);
+    for (int i = 0; i < HASH_BYTES && n > 0 && (size_t) n < size; i++) {
+        n += snprintf(path + n, size - n, "%02x", hash[i]);
+    }
+    if (n > 0 && (size_t) n < size) {
+        snprintf(path + n, size - n, "%s", suffix);
+    }
+}
+
+static inline size_t entry_size(uint32_t length, uint32_t num_edges)
+{
+    return sizeof(Cache_header) +
+           (size_t) length * (sizeof(uint32_t) + sizeof(Um_decoded)) +
+           (size_t) num_edges * sizeof(Um_edge);
+}
+
+/*
+* entry_code, entry_edges
+* Return: where the decoded entries and the profile of a mapped entry start
+*/
+static inline const Um_decoded *entry_code(const Cache_header *header)
+{
+    return (const Um_decoded *)
+        ((const uint32_t *) (header + 1) + header->length);
+}
+
+static inline const Um_edge *entry_edges(const Cache_header *header)
+{
+    return (const Um_edge *) (entry_code(header) + header->length);
+}
+
+/*
+* valid_code
+* Checks that decoded entries are ones the engine could have made: ops it
+* dispatches on outside blocks, registers in range, and superinstructions
+* whose following entries are decoded and inside m[0]
+*/
+static bool valid_code(const Um_decoded *code, uint32_t length)
+{
+    for (uint32_t pc = 0; pc < length; pc++) {
+        const Um_decoded *d = &code[pc];
+        if (d->op >= DOP_COUNT || (d->op >= DOP_CONST && d->op <= DOP_JUMP) ||
+            d->a > 7 || d->b > 7 || d->c > 7) {
+            return false;
+        }
+        uint32_t fused = FUSED_LENGTH(d->op);
+        if (fused > length - pc) {
+            return false;
+        }
+        for (uint32_t i = 1; i < fused; i++) {
+            if (code[pc + i].op == DOP_DECODE) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void cache_init(const char *dir, uint32_t version)
+{
+    cache_dir = dir;
+    engine_version = version;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "um: could not create cache directory %s: %s\n",
+                dir, strerror(errno));
+    }
+}
+
+/*
+* release_program
+* Forgets the m[0] last passed to cache_load
+*/
+static void release_program()
+{
+    if (mapped != NULL) {
+        munmap(mapped, mapped_size);
+        mapped = NULL;
+    }
+    free(original);
+    original = NULL;
+    original_length = 0;
+}
+
+bool cache_load(const uint32_t *words, uint32_t length, Um_decoded *code)
+{
+    release_program();
+    original = malloc((size_t) length * sizeof(uint32_t));
+    assert(original != NULL || length == 0);
+    memcpy(original, words, (size_t) length * sizeof(uint32_t));
+    original_length = length;
+
+    Sha256 sha;
+    sha256_init(&sha);
+    sha256_update(&sha, &engine_version, sizeof(engine_version));
+    sha256_update(&sha, &length, sizeof(length));
+    sha256_update(&sha, words, (size_t) length * sizeof(uint32_t));
+    sha256_final(&sha, original_hash);
+
+    char path[4096];
+    entry_path(path, sizeof(path), original_hash, ".umc");
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Cache_header)) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void *entry = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (entry == MAP_FAILED) {
+        return false;
+    }
+
+    const Cache_header *header = entry;
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header->version != engine_version ||
+        header->entry_size != sizeof(Um_decoded) ||
+        header->num_ops != DOP_COUNT || header->length != length ||
+        size != entry_size(length, header->num_edges) ||
+        memcmp(header->hash, original_hash, HASH_BYTES) != 0 ||
+        memcmp(header + 1, words, (size_t) length * sizeof(uint32_t)) != 0 ||
+        !valid_code(entry_code(header), length)) {
+        munmap(entry, size);
+        return false;
+    }
+
+    memcpy(code, entry_code(header), (size_t) length * sizeof(Um_decoded));
+    mapped = entry;
+    mapped_size = size;
+    return true;
+}
+
+const Um_edge *cache_profile(uint32_t *num_edges)
+{
+    if (mapped == NULL || ((const Cache_header *) mapped)->num_edges == 0) {
+        return NULL;
+    }
+    *num_edges = ((const Cache_header *) mapped)->num_edges;
+    return entry_edges(mapped);
+}
+
+/*
+* write_entry
+* Writes an entry for the remembered program with the given decoded form
+* and profile
+*/
+static void write_entry(const Um_decoded *code, const Um_edge *edges,
+                        uint32_t num_edges)
+{
+    char path[4096], temp[4096], suffix[32];
+    snprintf(suffix, sizeof(suffix), ".umc.%d", (int) getpid());
+    entry_path(path, sizeof(path), original_hash, ".umc");
+    entry_path(temp, sizeof(temp), original_hash, suffix);
+
+    Cache_header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = engine_version;
+    header.entry_size = sizeof(Um_decoded);
+    header.num_ops = DOP_COUNT;
+    header.length = original_length;
+    header.num_edges = num_edges;
+    memcpy(header.hash, original_hash, HASH_BYTES);
+
+    FILE *fp = fopen(temp, "w");
+    if (fp == NULL) {
+        return;
+    }
+    bool written =
+        fwrite(&header, sizeof(header), 1, fp) == 1 &&
+        fwrite(original, sizeof(uint32_t), original_length, fp) ==
+            original_length &&
+        fwrite(code, sizeof(Um_decoded), original_length, fp) ==
+            original_length &&
+        fwrite(edges, sizeof(Um_edge), num_edges, fp) == num_edges;
+    if (fclose(fp) != 0 || !written || rename(temp, path) != 0) {
+        unlink(temp);
+    }
+}
+
+void cache_save(const uint32_t *words, const Um_decoded *code,
+                const Um_edge *edges, uint32_t num_edges)
+{
+    uint32_t length = original_length;
+    Um_decoded *saved = malloc((size_t) length * sizeof(Um_decoded));
+    assert(saved != NULL || length == 0);
+    memcpy(saved, code, (size_t) length * sizeof(Um_decoded));
+
+    // Undo whatever was decoded from words stored since the load
+    for (uint32_t pc = 0; pc < length; pc++) {
+        if (words[pc] == original[pc]) {
+            continue;
+        }
+        saved[pc].op = DOP_DECODE;
+        for (uint32_t back = 1; back < MAX_FUSED_LENGTH && back <= pc;
+             back++) {
+            if (FUSED_LENGTH(saved[pc - back].op) > back) {
+                saved[pc - back].op = DOP_DECODE;
+            }
+        }
+    }
+
+    // Without a new profile, keep the entry's, and the entry itself if the
+    // decoded form has not changed either
+    bool unchanged = false;
+    if (edges == NULL) {
+        unchanged = mapped != NULL &&
+                    memcmp(saved, entry_code(mapped),
+                           (size_t) length * sizeof(Um_decoded)) == 0;
+        edges = cache_profile(&num_edges);
+        if (edges == NULL) {
+            num_edges = 0;
+        }
+    }
+    if (!unchanged) {
+        write_entry(saved, edges, num_edges);
+    }
+    free(saved);
+    release_program();
+}
+
+void cache_finish()
+{
+    release_program();
+}
@@ -0,0 +1,78 @@
+/*
+*   um_cache.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_cache, a persistent cache of
+*   the decoded form of m[0] (see um_decode.h) kept in a directory across
+*   runs. Entries are keyed by a SHA-256 hash of the engine version and the
+*   program words, so a program starts out already decoded and fused the
+*   next time the same image is run by the same engine. An entry can also
+*   hold a block transition profile of the program (see um_layout.h).
+*/
+
+#ifndef UM_CACHE_INCLUDED
+#define UM_CACHE_INCLUDED
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "um_decode.h"
+#include "um_layout.h"
+
+/*
+* cache_init
+* Opens the cache directory, creating it if needed
+* Arguments:
+*   - dir - the cache directory
+*   - version - the engine version; entries from other versions are never
+*               used, since their decoded ops may mean something else
+* Return: void
+*/
+void cache_init(const char *dir, uint32_t version);
+
+/*
+* cache_load
+* Starts running a new m[0]: remembers its words, and fills in its decoded
+* form from the cache if there is a valid entry for them
+* Arguments:
+*   - words - the words of m[0]
+*   - length - the number of words in m[0]
+*   - code - the decoded form of m[0], all DOP_DECODE, length entries
+* Return: true if the entry was found and copied into code
+*/
+bool cache_load(const uint32_t *words, uint32_t length, Um_decoded *code);
+
+/*
+* cache_profile
+* Returns the block transition profile in the entry cache_load found
+* Arguments:
+*   - num_edges - set to the number of edges
+* Return: the edges, valid until the next cache_save, or NULL if there was
+* no entry or it holds no profile
+*/
+const Um_edge *cache_profile(uint32_t *num_edges);
+
+/*
+* cache_save
+* Writes the decoded form of the m[0] last passed to cache_load back to the
+* cache, unless the entry on disk already holds it. Entries for words that
+* were overwritten since the load, and superinstructions that cover them,
+* are saved undecoded, so the entry only describes the original words.
+* Arguments:
+*   - words - the words of m[0] now
+*   - code - the decoded form of m[0] now
+*   - edges, num_edges - a new block transition profile to store, or NULL
+*                        to keep the one already in the entry
+* Return: void
+*/
+void cache_save(const uint32_t *words, const Um_decoded *code,
+                const Um_edge *edges, uint32_t num_edges);
+
+/*
+* cache_finish
+* Releases the cache, forgetting the m[0] last passed to cache_load
+* Arguments: None
+* Return: void
+*/
+void cache_finish();
+
+#endif
@@ -0,0 +1,305 @@
+/*
+*   um_compact.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_compact. Segments are first
+*   allocated with calloc. When the machine is about to block on input and
+*   resident memory is well above the bytes of live segments, a compaction
+*   pass walks the segment table and copies each live segment into the bump
+*   pointer of a dense mmap'd arena, frees its heap block and updates the table
+*   entry in place, so segment ids never change. Segments left in arenas that
+*   have become mostly dead are moved again. At the end of a pass malloc_trim
+*   hands the freed heap pages back to the OS, and fully dead arenas are
+*   unmapped.
+*
+*   Passes are incremental: each slice moves a bounded number of bytes and
+*   then checks whether input has arrived, so an interactive program resumes
+*   as soon as the user types.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <malloc.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "um_compact.h"
+
+/*
+* Tuning constants
+*/
+#define ARENA_BYTES (1 << 20)
+#define SLICE_BYTES (256 << 10)
+#define MIN_WASTE_BYTES (1 << 20)
+#define START_RATIO 1.5
+#define NO_ARENA -1
+
+typedef struct Arena {
+    char *base;
+    size_t size;
+    size_t used;
+    size_t live;
+} Arena;
+
+static UM *compact_um = NULL;
+static size_t page_size = 0;
+static size_t live_bytes = 0;
+
+// Arena each id's words live in, or NO_ARENA for the heap
+static int32_t *homes = NULL;
+static uint32_t homes_capacity = 0;
+
+static Arena *arenas = NULL;
+static int32_t num_arenas = 0;
+static int32_t arenas_capacity = 0;
+static int32_t current_arena = NO_ARENA;
+
+// State of the pass in progress
+static bool pass_active = false;
+static uint32_t cursor = 1;
+static double ratio_before = 0;
+
+static inline size_t segment_bytes(uint32_t length)
+{
+    return (size_t) length * sizeof(uint32_t);
+}
+
+/*
+* home
+* Returns where id's words live, growing the bookkeeping to cover it
+*/
+static int32_t *home(uint32_t id)
+{
+    if (id >= homes_capacity) {
+        uint32_t old_capacity = homes_capacity;
+        homes_capacity = homes_capacity == 0 ? 1024 : homes_capacity;
+        while (homes_capacity <= id) {
+            homes_capacity *= 2;
+        }
+        homes = realloc(homes, homes_capacity * sizeof(*homes));
+        assert(homes != NULL);
+        for (uint32_t i = old_capacity; i < homes_capacity; i++) {
+            homes[i] = NO_ARENA;
+        }
+    }
+    return &homes[id];
+}
+
+/*
+* resident_bytes
+* Returns the resident set size of the process
+*/
+static size_t resident_bytes()
+{
+    unsigned long size = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) {
+        return 0;
+    }
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(statm);
+    return resident * page_size;
+}
+
+static double fragmentation_ratio(size_t resident)
+{
+    return live_bytes == 0 ? 0 : (double) resident / live_bytes;
+}
+
+/*
+* arena_release
+* Drops bytes from arena index; unmaps it once nothing in it is live
+*/
+static void arena_release(int32_t index, size_t bytes)
+{
+    Arena *arena = &arenas[index];
+    arena->live -= bytes;
+    if (arena->live == 0 && index != current_arena) {
+        munmap(arena->base, arena->size);
+        arena->base = NULL;
+    }
+}
+
+/*
+* arena_alloc
+* Bump-allocates bytes from the current arena, starting a new one if needed;
+* returns NULL if no memory could be mapped
+*/
+static char *arena_alloc(size_t bytes, int32_t *index)
+{
+    Arena *arena = current_arena == NO_ARENA ? NULL : &arenas[current_arena];
+    if (arena == NULL || arena->size - arena->used < bytes) {
+        // Retire the old arena, freeing it if it is already dead
+        int32_t retired = current_arena;
+        current_arena = NO_ARENA;
+        if (retired != NO_ARENA && arenas[retired].live == 0) {
+            arena_release(retired, 0);
+        }
+
+        if (num_arenas == arenas_capacity) {
+            arenas_capacity = arenas_capacity == 0 ? 16 : arenas_capacity * 2;
+            arenas = realloc(arenas, arenas_capacity * sizeof(*arenas));
+            assert(arenas != NULL);
+        }
+        size_t size = bytes > ARENA_BYTES ?
+                      (bytes + page_size - 1) & ~(page_size - 1) :
+                      ARENA_BYTES;
+        char *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            return NULL;
+        }
+        arenas[num_arenas] = (Arena) { base, size, 0, 0 };
+        current_arena = num_arenas++;
+        arena = &arenas[current_arena];
+    }
+
+    char *result = arena->base + arena->used;
+    arena->used += (bytes + 7) & ~(size_t) 7;
+    arena->live += bytes;
+    *index = current_arena;
+    return result;
+}
+
+/*
+* worth_moving
+* A segment is moved if it is still on the heap, or sits in a retired arena
+* that is now less than half live
+*/
+static bool worth_moving(int32_t index)
+{
+    if (index == NO_ARENA) {
+        return true;
+    }
+    return index != current_arena &&
+           arenas[index].live * 2 < arenas[index].used;
+}
+
+/*
+* relocate
+* Copies segment id into the current arena and repoints its table entry;
+* returns the number of bytes moved
+*/
+static size_t relocate(uint32_t id)
+{
+    int32_t *where = home(id);
+    size_t bytes = segment_bytes(compact_um->lengths[id]);
+    if (bytes == 0 || !worth_moving(*where)) {
+        return 0;
+    }
+
+    int32_t index;
+    uint32_t *moved = (uint32_t *) arena_alloc(bytes, &index);
+    if (moved == NULL) {
+        return 0;
+    }
+    memcpy(moved, compact_um->words[id], bytes);
+
+    if (*where == NO_ARENA) {
+        free(compact_um->words[id]);
+    } else {
+        arena_release(*where, bytes);
+    }
+    *where = index;
+
+    compact_um->words[id] = moved;
+    if (compact_um->cached_id == id) {
+        compact_um->cached_words = moved;
+    }
+    return bytes;
+}
+
+static bool input_ready(int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+    return poll(&pfd, 1, 0) != 0;
+}
+
+void compact_init(UM *um)
+{
+    compact_um = um;
+    page_size = sysconf(_SC_PAGESIZE);
+}
+
+uint32_t *compact_words_new(uint32_t id, uint32_t length)
+{
+    uint32_t *words = calloc(length, sizeof(uint32_t));
+    assert(words != NULL || length == 0);
+    *home(id) = NO_ARENA;
+    live_bytes += segment_bytes(length);
+    return words;
+}
+
+void compact_words_free(uint32_t id)
+{
+    int32_t *where = home(id);
+    size_t bytes = segment_bytes(compact_um->lengths[id]);
+    if (*where == NO_ARENA) {
+        free(compact_um->words[id]);
+    } else {
+        arena_release(*where, bytes);
+        *where = NO_ARENA;
+    }
+    live_bytes -= bytes;
+}
+
+void compact_while_idle(int fd, Um_stats *stats)
+{
+    // Decide whether fragmentation is bad enough to start a pass
+    if (!pass_active) {
+        size_t resident = resident_bytes();
+        if (resident < live_bytes + MIN_WASTE_BYTES ||
+            fragmentation_ratio(resident) < START_RATIO) {
+            return;
+        }
+        pass_active = true;
+        cursor = 1;
+        ratio_before = fragmentation_ratio(resident);
+    }
+
+    // Move segments a slice at a time until input shows up. Segment 0 is
+    // left alone since the engine holds on to its instruction pointer.
+    while (!input_ready(fd)) {
+        size_t moved = 0;
+        while (moved < SLICE_BYTES && cursor < compact_um->num_segments) {
+            if (compact_um->words[cursor] != NULL) {
+                moved += relocate(cursor);
+            }
+            cursor++;
+        }
+
+        if (cursor >= compact_um->num_segments) {
+            malloc_trim(0);
+            pass_active = false;
+            if (stats != NULL) {
+                stats->fragmentation_before = ratio_before;
+                stats->fragmentation_after =
+                    fragmentation_ratio(resident_bytes());
+                stats->compactions++;
+            }
+            return;
+        }
+    }
+}
+
+void compact_finish()
+{
+    for (int32_t i = 0; i < num_arenas; i++) {
+        if (arenas[i].base != NULL) {
+            munmap(arenas[i].base, arenas[i].size);
+        }
+    }
+    free(arenas);
+    free(homes);
+    arenas = NULL;
+    homes = NULL;
+    num_arenas = arenas_capacity = 0;
+    homes_capacity = 0;
+    current_arena = NO_ARENA;
+    live_bytes = 0;
+}
@@ -0,0 +1,68 @@
+/*
+*   um_compact.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_compact, a segment memory backend
+*   that relocates live segments into dense arenas while the machine is idle
+*   waiting for input, so that memory fragmented by malloc can be returned to
+*   the operating system
+*/
+
+#ifndef UM_COMPACT_INCLUDED
+#define UM_COMPACT_INCLUDED
+
+#include <inttypes.h>
+#include "um_util.h"
+#include "um_stats.h"
+
+/*
+* compact_init
+* Starts tracking live segment memory for the given machine
+* Arguments:
+*   - um - the machine whose segments are managed
+* Return: void
+*/
+void compact_init(UM *um);
+
+/*
+* compact_words_new
+* Allocates zeroed words for segment id from the heap
+* Arguments:
+*   - id - the id the words will be stored under
+*   - length - the number of words in the segment
+* Return: the first word of the segment
+*/
+uint32_t *compact_words_new(uint32_t id, uint32_t length);
+
+/*
+* compact_words_free
+* Releases the words of segment id, wherever they have been relocated to
+* Arguments:
+*   - id - the segment to release; um->words[id] and um->lengths[id] must
+*          still describe it
+* Return: void
+*/
+void compact_words_free(uint32_t id);
+
+/*
+* compact_while_idle
+* Runs compaction in small slices for as long as fd has no input ready.
+* A pass starts when resident memory exceeds live segment bytes by enough
+* to be worth it, and publishes the fragmentation ratio before and after
+* once it finishes.
+* Arguments:
+*   - fd - the file descriptor the machine is about to block on
+*   - stats - the statistics page to publish the ratios in, or NULL
+* Return: void
+*/
+void compact_while_idle(int fd, Um_stats *stats);
+
+/*
+* compact_finish
+* Releases every arena
+* Arguments: None
+* Return: void
+*/
+void compact_finish();
+
+#endif
@@ -0,0 +1,109 @@
+/*
+*   um_decode.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class standardizes the pre-decoded form of m[0] that the engine
+*   dispatches on: one Um_decoded entry per instruction word, holding the
+*   unpacked operands and a dispatch op. The three-register arithmetic and
+*   move instructions are decoded straight to a handler specialized for their
+*   exact (opcode, ra, rb, rc), so the handler indexes the register file with
+*   constants instead of run-time register numbers.
+*
+*   Common instruction sequences are fused into superinstructions: the first
+*   entry of the sequence gets the fused op and runs the whole sequence, using
+*   the operands of the following entries, which keep their own ops so that
+*   jumps into the middle of a sequence still work.
+*/
+
+#ifndef UM_DECODE_INCLUDED
+#define UM_DECODE_INCLUDED
+
+#include <inttypes.h>
+#include "um_util.h"
+
+/*
+* Um_dop enum that standardizes the dispatch ops of decoded entries. Entries
+* start out (and are reset to) DOP_DECODE, which decodes the word on first
+* execution, so the code array can be created with calloc.
+*/
+typedef enum Um_dop {
+    DOP_DECODE = 0,
+    DOP_CMOV, DOP_SLOAD, DOP_SSTORE, DOP_ADD, DOP_MUL, DOP_DIV,
+    DOP_NAND, DOP_HALT, DOP_ACTIVATE, DOP_INACTIVATE, DOP_OUT, DOP_IN,
+    DOP_LOADP, DOP_LV, DOP_INVALID,
+
+    // Produced only by the block optimizer (um_optimize.h)
+    DOP_CONST,              // ra = value, any 32-bit constant
+    DOP_MOV,                // ra = rb
+    DOP_JUMP,               // LOADP of m[0] to the constant pc in value
+
+    // Superinstructions
+    DOP_LV_LV,              // two loads of constants
+    DOP_LV_SLOAD,           // load from a constant segment or offset
+    DOP_LV_SSTORE,          // store to a constant segment or offset
+    DOP_NAND_NAND,          // AND/OR/NOT synthesized from NANDs
+    DOP_LV_LOADP,           // direct jump through a loaded target
+    DOP_SLOAD_ADD_SSTORE,   // read-modify-write of a segment word
+
+    DOP_SPECIALIZED
+} Um_dop;
+
+/*
+* Generic dispatch op for a UM opcode
+*/
+#define DOP_OF(opcode) ((opcode) > LV ? DOP_INVALID : (opcode) + 1)
+
+/*
+* Number of instruction words a superinstruction covers
+*/
+#define FUSED_LENGTH(op) \
+    ((op) == DOP_SLOAD_ADD_SSTORE ? 3 : \
+     (op) >= DOP_LV_LV && (op) < DOP_SPECIALIZED ? 2 : 1)
+
+/*
+* Longest superinstruction, in words
+*/
+#define MAX_FUSED_LENGTH 3
+
+/*
+* Register-specialized ops: 512 consecutive ops per specialized opcode, one
+* for each (ra, rb, rc), starting at DOP_SPECIALIZED
+*/
+typedef enum Um_specialized {
+    SPEC_CMOV = 0, SPEC_ADD, SPEC_MUL, SPEC_DIV, SPEC_NAND, NUM_SPECIALIZED
+} Um_specialized;
+
+#define SPEC_OP(kind, a, b, c) \
+    (DOP_SPECIALIZED + (kind) * 512 + ((a) << 6) + ((b) << 3) + (c))
+
+#define DOP_COUNT SPEC_OP(NUM_SPECIALIZED, 0, 0, 0)
+
+/*
+* Expand M(kind, a, b, c) for all 512 register combinations
+*/
+#define FOR_REGS_C(M, kind, a, b) \
+    M(kind, a, b, 0) M(kind, a, b, 1) M(kind, a, b, 2) M(kind, a, b, 3) \
+    M(kind, a, b, 4) M(kind, a, b, 5) M(kind, a, b, 6) M(kind, a, b, 7)
+#define FOR_REGS_BC(M, kind, a) \
+    FOR_REGS_C(M, kind, a, 0) FOR_REGS_C(M, kind, a, 1) \
+    FOR_REGS_C(M, kind, a, 2) FOR_REGS_C(M, kind, a, 3) \
+    FOR_REGS_C(M, kind, a, 4) FOR_REGS_C(M, kind, a, 5) \
+    FOR_REGS_C(M, kind, a, 6) FOR_REGS_C(M, kind, a, 7)
+#define FOR_REGS(M, kind) \
+    FOR_REGS_BC(M, kind, 0) FOR_REGS_BC(M, kind, 1) \
+    FOR_REGS_BC(M, kind, 2) FOR_REGS_BC(M, kind, 3) \
+    FOR_REGS_BC(M, kind, 4) FOR_REGS_BC(M, kind, 5) \
+    FOR_REGS_BC(M, kind, 6) FOR_REGS_BC(M, kind, 7)
+
+/*
+* Um_decoded struct that represents one decoded instruction of m[0]
+*/
+typedef struct Um_decoded {
+    uint16_t op;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint32_t value;
+} Um_decoded;
+
+#endif
@@ -1,108 +1,632 @@
 #include "um_engine.h"
 #include "um_util.h"
+#include "um_decode.h"
+#include "um_optimize.h"
+#include "um_loop.h"
+#include "um_tier.h"
+#include "um_layout.h"
+#include "um_aot.h"
+#include "um_cache.h"
+#include "um_safe.h"
+#include "um_spill.h"
+#include "um_compact.h"
+#include "um_asm.h"
+#include "um_watch.h"
+#include "um_pipe.h"
+#include "um_pool.h"
+#include "um_replay.h"
+#include "um_trace.h"
+#include "um_events.h"
+#include "um_probes.h"
+#include "um_stats.h"
+#include <time.h>
 
 UM um;
+static Um_options options;
+
+// Version of the decoded form of m[0], which cached programs must match;
+// bump it whenever the meaning of the decoded ops changes
+#ifdef UM_GENERIC_HANDLERS
+#define ENGINE_VERSION 0x80000001
+#else
+#define ENGINE_VERSION 1
+#endif
+
+// Safe mode decodes without superinstructions, so it keeps programs of its
+// own in the cache
+#define SAFE_VERSION_BIT 0x40000000
+
+// The compiled image m[0] currently holds, or NULL, and which of its words
+// no longer hold the instruction compiled for them (see um_aot.h)
+static const Um_aot_image *aot_image;
+uint8_t *aot_stale;
+
+// The last block entered, for counting transitions in a profiling run
+static uint32_t last_block = UINT32_MAX;
+
+// Programs written out so far for the dump option
+static uint32_t num_dumps;
+
+// A copy of the program as loaded, which reset_um puts back in m[0]
+static uint32_t *program;
+static uint32_t program_length;
+
+// Whether input comes from a terminal, so that the machine may wait on the
+// user at every input instruction
+static bool interactive;
+
+// The budget of the running run_for call, if any: the instructions left and
+// the monotonic time in nanoseconds to stop at (0: none). The clock is read
+// only at every BUDGET_CLOCK_CHECKS-th check, since reading it takes a call.
+#define BUDGET_CLOCK_CHECKS 64
+static bool budgeted;
+static uint64_t budget_left;
+static uint64_t deadline;
+static uint32_t clock_checks;
+
+// The live statistics published for other processes, or NULL, and whether
+// block entries count the instructions run since the last, for them or
+// for run_for's budget
+static Um_stats *stats;
+static bool counting;
 
-static inline void op_conditional_move(Um_register ra, Um_register rb,
-                                                            Um_register rc)
+/*
+* new_words
+* Allocates a zeroed segment of length words to be stored under id, from
+* um_watch for m[0] outside safe mode, the spilling backend when a memory
+* budget is set, the compacting backend when compaction is on, the pool when
+* the machine is pooled, and from malloc otherwise
+*/
+static inline uint32_t *new_words(uint32_t id, uint32_t length)
+{
+    if (id == 0 && !options.safe) {
+        return watch_words_new(length);
+    }
+    if (options.memory_budget != 0) {
+        return spill_words_new(id, length);
+    }
+    if (options.compact) {
+        return compact_words_new(id, length);
+    }
+    if (options.pool) {
+        return pool_words_new(length);
+    }
+    uint32_t *words = calloc(length, sizeof(uint32_t));
+    assert(words != NULL || length == 0);
+    return words;
+}
+
+/*
+* free_words
+* Releases the words of segment id, which must still be in the table
+*/
+static inline void free_words(uint32_t id)
+{
+    if (id == 0 && !options.safe) {
+        watch_words_free(um.words[0], um.lengths[0]);
+    } else if (options.memory_budget != 0) {
+        spill_words_free(id);
+    } else if (options.compact) {
+        compact_words_free(id);
+    } else if (options.pool) {
+        pool_words_free(um.words[id], um.lengths[id]);
+    } else {
+        free(um.words[id]);
+    }
+}
+
+/*
+* watch_code
+* Has um_watch report the next store into the pages holding count words of
+* m[0] from first, since code is being cached from them. Safe mode checks
+* each store instead.
+*/
+static inline void watch_code(uint32_t first, uint32_t count)
 {
-    if (um.registers[rc] != 0) {
-        um.registers[ra] = um.registers[rb];
+    if (!options.safe) {
+        watch_range(first, count);
     }
 }
 
-static inline void op_segmented_load(Um_register ra, Um_register rb, Um_register rc)
+/*
+* new_code
+* Allocates the decoded form of a length-word m[0], with every entry still
+* to be decoded. In safe mode it ends at a guard page like m[0] itself, so
+* running off the end of the program still faults.
+*/
+static inline Um_decoded *new_code(uint32_t length)
+{
+    if (options.safe) {
+        Um_decoded *code = (Um_decoded *)
+            safe_words_new(length * sizeof(Um_decoded) / sizeof(uint32_t));
+        if (code == NULL) {
+            fprintf(stderr, "um: could not map the guarded decode cache\n");
+            exit(EXIT_FAILURE);
+        }
+        return code;
+    }
+    Um_decoded *code = calloc(length, sizeof(Um_decoded));
+    assert(code != NULL || length == 0);
+    return code;
+}
+
+/*
+* free_code
+* Releases the decoded form of a length-word m[0]
+*/
+static inline void free_code(Um_decoded *code, uint32_t length)
+{
+    if (options.safe) {
+        safe_words_free((uint32_t *) code, length * sizeof(Um_decoded) /
+                                           sizeof(uint32_t));
+    } else {
+        free(code);
+    }
+}
+
+/*
+* new_blocks
+* Allocates an empty optimized block table for a length-word m[0]
+*/
+static inline void new_blocks(uint32_t length)
+{
+    um.blocks = calloc(length, sizeof(*um.blocks));
+    um.block_cover = calloc(length, sizeof(*um.block_cover));
+    assert((um.blocks != NULL && um.block_cover != NULL) || length == 0);
+    if (options.tier_threshold != 0) {
+        um.block_entries = calloc(length, sizeof(*um.block_entries));
+        assert(um.block_entries != NULL || length == 0);
+        tier_reset(length);
+    }
+}
+
+/*
+* remove_block
+* Frees the optimized block entered at start and uncovers its words
+*/
+static void remove_block(uint32_t start)
+{
+    Um_block *block = um.blocks[start];
+    for (uint32_t pc = start; pc < start + block->length; pc++) {
+        um.block_cover[pc]--;
+    }
+    um.blocks[start] = NULL;
+    free_block(block);
+    if (um.block_entries != NULL) {
+        um.block_entries[start] = 0;
+    }
+}
+
+/*
+* free_blocks
+* Frees every optimized block of a length-word m[0], and the table
+*/
+static void free_blocks(uint32_t length)
+{
+    for (uint32_t pc = 0; pc < length; pc++) {
+        free_block(um.blocks[pc]);
+    }
+    free(um.blocks);
+    free(um.block_cover);
+    free(um.block_entries);
+    free(um.block_arena);
+    um.blocks = NULL;
+    um.block_cover = NULL;
+    um.block_entries = NULL;
+    um.block_arena = NULL;
+}
+
+/*
+* install_block
+* Enters an optimized block into the table and covers its words
+*/
+static void install_block(Um_block *block)
+{
+    watch_code(block->start, block->length);
+    um.blocks[block->start] = block;
+    for (uint32_t pc = block->start; pc < block->start + block->length;
+         pc++) {
+        um.block_cover[pc]++;
+    }
+}
+
+/*
+* lay_out_blocks
+* Builds every block the cached profile of m[0] saw entered, and places them
+* back to back in the profile's layout order, so that the ops of a hot path
+* sit in consecutive memory
+*/
+static void lay_out_blocks()
+{
+    uint32_t num_edges, num_blocks;
+    const Um_edge *edges = cache_profile(&num_edges);
+    if (edges == NULL) {
+        return;
+    }
+    uint32_t *order = layout_order(edges, num_edges, um.lengths[0],
+                                   &num_blocks);
+    Um_block **built = malloc((num_blocks + 1) * sizeof(*built));
+    assert(built != NULL);
+    size_t size = 0;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        built[i] = optimize_block(um.words[0] + order[i],
+                                  um.lengths[0] - order[i], order[i]);
+        size += BLOCK_SIZE(built[i]);
+    }
+
+    um.block_arena = malloc(size);
+    assert(um.block_arena != NULL || size == 0);
+    char *next = um.block_arena;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        Um_block *block = (Um_block *) next;
+        memcpy(block, built[i], BLOCK_SIZE(built[i]));
+        next += BLOCK_SIZE(built[i]);
+        block->placed = true;
+        install_block(block);
+        free(built[i]);
+    }
+    free(built);
+    free(order);
+}
+
+/*
+* mark_stale_words
+* Marks count words of m[0] from first stale against its compiled image,
+* along with every word before them that falls through into them
+*/
+static void mark_stale_words(uint32_t first, uint32_t count)
+{
+    const uint32_t *words = aot_image->words;
+    if (first >= aot_image->length) {
+        return;
+    }
+    if (count > aot_image->length - first) {
+        count = aot_image->length - first;
+    }
+
+    memset(aot_stale + first, 1, count);
+    for (uint32_t pc = first; pc-- > 0 && !aot_stale[pc]; ) {
+        Um_opcode opcode = words[pc] >> 28;
+        if (opcode == LOADP || opcode == HALT) {
+            break;
+        }
+        aot_stale[pc] = 1;
+    }
+}
+
+/*
+* mark_stale
+* Records a store into m[0] against its compiled image. If the word changed,
+* the word and every word before it that falls through into it is stale, so
+* compiled code is no longer entered anywhere that would run it.
+*/
+static void mark_stale(uint32_t index)
+{
+    if (index >= aot_image->length ||
+        um.words[0][index] == aot_image->words[index]) {
+        return;
+    }
+    mark_stale_words(index, 1);
+}
+
+/*
+* forget_decoding
+* Forgets the decoding of m[0][index], along with any superinstruction
+* whose words cover it. It takes plain stores alone, so it may be done from
+* a signal handler.
+*/
+static inline void forget_decoding(uint32_t index)
+{
+    um.code[index].op = DOP_DECODE;
+    for (uint32_t back = 1; back < MAX_FUSED_LENGTH && back <= index;
+         back++) {
+        if (FUSED_LENGTH(um.code[index - back].op) > back) {
+            um.code[index - back].op = DOP_DECODE;
+        }
+    }
+}
+
+/*
+* invalidate_code
+* Forgets the decoding of m[0][index] after a store to it, along with any
+* superinstruction or optimized block whose words cover it
+*/
+static inline void invalidate_code(uint32_t index)
+{
+    forget_decoding(index);
+    if (um.block_cover != NULL && um.block_cover[index] != 0) {
+        for (uint32_t back = 0; back < MAX_BLOCK_LENGTH && back <= index;
+             back++) {
+            Um_block *block = um.blocks[index - back];
+            if (block != NULL && block->length > back) {
+                remove_block(index - back);
+            }
+        }
+    }
+}
+
+/*
+* forget_page
+* Called by um_watch from its fault handler, just before a store into a
+* page of m[0] that code was cached from: forgets the decodings of the
+* page, so that none of its words runs before invalidate_page has dropped
+* the rest of what was cached from it
+*/
+static void forget_page(uint32_t first, uint32_t count)
+{
+    for (uint32_t index = first; index < first + count; index++) {
+        forget_decoding(index);
+    }
+}
+
+/*
+* invalidate_page
+* Called by watch_flush for a page of m[0] stored into since code was
+* cached from it: forgets all of it, since later stores into the page are
+* not seen. The stored values are not looked at, so every word of the page
+* is taken as changed against a compiled image.
+*/
+static void invalidate_page(uint32_t first, uint32_t count)
+{
+    for (uint32_t index = first; index < first + count; index++) {
+        invalidate_code(index);
+    }
+    if (aot_image != NULL) {
+        mark_stale_words(first, count);
+    }
+}
+
+/*
+* forget_code
+* Called by um_watch when it stops: forgets every decoding of m[0], so that
+* an interpreter that relied on the watch reaches DOP_DECODE and hands over
+* to one that checks each store. Optimized blocks check their own stores.
+* It takes plain stores alone, since the fault handler may call it.
+*/
+static void forget_code()
+{
+    for (uint32_t index = 0; index < um.lengths[0]; index++) {
+        um.code[index].op = DOP_DECODE;
+    }
+}
+
+/*
+* segment_words
+* Returns the words of segment id, going through the one-entry lookup cache
+* so that runs of SLOAD/SSTORE on the same segment skip the table load
+*/
+static inline uint32_t *segment_words(uint32_t id)
+{
+    if (id != um.cached_id) {
+        um.cached_id = id;
+        um.cached_words = um.words[id];
+        if (options.memory_budget != 0) {
+            um.referenced[id] = 1;
+        }
+    }
+    return um.cached_words;
+}
+
+/*
+* check_access
+* Reports an access to word index of segment id that falls outside it, or
+* to a segment not mapped, for safe mode
+*/
+static inline void check_access(uint32_t id, uint32_t index)
+{
+    if (id >= um.num_segments || index >= um.lengths[id]) {
+        safe_fault(id >= um.num_segments || um.words[id] == safe_trap_words ?
+                   "access to an unmapped segment" :
+                   "out-of-bounds segment access");
+    }
+}
+
+/*
+* check_program
+* Reports a load program from a segment not mapped, for safe mode
+*/
+static inline void check_program(uint32_t id)
+{
+    if (id >= um.num_segments || um.words[id] == safe_trap_words) {
+        safe_fault("access to an unmapped segment");
+    }
+}
+
+static inline void op_conditional_move(uint32_t *registers, Um_register ra,
+                                       Um_register rb, Um_register rc)
+{
+    if (registers[rc] != 0) {
+        registers[ra] = registers[rb];
+    }
+}
+
+static inline void op_segmented_load(uint32_t *registers, Um_register ra,
+                                     Um_register rb, Um_register rc)
 {
     // Retrieve the segment
-    Segment segment = (Segment) Seq_get(um.mapped, um.registers[rb]);
-    uint32_t *words = segment->words;
+    uint32_t *words = segment_words(registers[rb]);
+#ifdef UM_CHECKED
+    assert(registers[rb] < um.num_segments);
+    assert(registers[rc] < um.lengths[registers[rb]]);
+#endif
 
     // Load the specified value into ra
-    um.registers[ra] = words[um.registers[rc]];
+    registers[ra] = words[registers[rc]];
 }
 
-static inline void op_segmented_store(Um_register ra, Um_register rb, Um_register rc)
+static inline __attribute__((always_inline))
+void op_segmented_store(uint32_t *registers, Um_register ra, Um_register rb,
+                        Um_register rc, bool watched)
 {
     // Retrieve the segment
-    Segment segment = (Segment) Seq_get(um.mapped, um.registers[ra]);
-    uint32_t *words = segment->words;
+    uint32_t *words = segment_words(registers[ra]);
+#ifdef UM_CHECKED
+    assert(registers[ra] < um.num_segments);
+    assert(registers[rb] < um.lengths[registers[ra]]);
+#endif
 
     // Store the specific value
-    words[um.registers[rb]] = um.registers[rc];
+    words[registers[rb]] = registers[rc];
+
+    // Self-modification: the word is decoded again when next executed. When
+    // m[0] is watched, the store itself has already forgotten the
+    // decodings of its page, and watch_flush drops the rest.
+    if (!watched && registers[ra] == 0) {
+        invalidate_code(registers[rb]);
+        if (aot_image != NULL) {
+            mark_stale(registers[rb]);
+        }
+    }
 }
 
-static inline void op_addition(Um_register ra, Um_register rb, Um_register rc)
+static inline void op_addition(uint32_t *registers, Um_register ra,
+                               Um_register rb, Um_register rc)
 {
-    um.registers[ra] = (um.registers[rb] + um.registers[rc]) % MAX_VAL;
+    registers[ra] = (registers[rb] + registers[rc]) % MAX_VAL;
 }
 
-static inline void op_multiplication(Um_register ra, Um_register rb, Um_register rc)
+static inline void op_multiplication(uint32_t *registers, Um_register ra,
+                                     Um_register rb, Um_register rc)
 {
-      um.registers[ra] = (um.registers[rb] * um.registers[rc]) % MAX_VAL;
+      registers[ra] = (registers[rb] * registers[rc]) % MAX_VAL;
 }
 
-static inline void op_division(Um_register ra, Um_register rb, Um_register rc)
+static inline void op_division(uint32_t *registers, Um_register ra,
+                               Um_register rb, Um_register rc)
 {
-      um.registers[ra] = um.registers[rb] / um.registers[rc];
+      registers[ra] = registers[rb] / registers[rc];
 }
 
-static inline void op_bitwise_NAND(Um_register ra, Um_register rb, Um_register rc)
+static inline void op_bitwise_NAND(uint32_t *registers, Um_register ra,
+                                   Um_register rb, Um_register rc)
 {
-      um.registers[ra] = ~(um.registers[rb] & um.registers[rc]);
+      registers[ra] = ~(registers[rb] & registers[rc]);
 }
 
 static inline void op_map_segment(Um_register rb, Um_register rc)
 {
-    // Allocate the memory for the segment
-    uint32_t *real_memory = malloc(sizeof(uint32_t) * um.registers[rc]);
-    assert(real_memory != NULL);
-
-    // Initialize each word to 0
-    for (uint32_t i = 0; i < um.registers[rc]; i++) {
-        real_memory[i] = 0;
-    }
+    UM_PROBE1(map_begin, um.registers[rc]);
 
-    Segment updated_segment;
-
-    // Assign to the lowest free index in mapped
+    // Reuse the most recently unmapped id, or grow the table by one
     uint32_t id;
-    if (Seq_length(um.unmapped) > 0){
-        id = (uint32_t)(uintptr_t)Seq_remlo(um.unmapped);
-        updated_segment = (Segment) Seq_get(um.mapped, id);
+    if (um.num_unmapped > 0) {
+        id = um.unmapped[--um.num_unmapped];
     } else {
-        updated_segment = malloc(sizeof(*updated_segment));
-        assert(updated_segment != NULL);
-        id = Seq_length(um.mapped);
-        Seq_addhi(um.mapped, (void *) updated_segment);
+        if (um.num_segments == um.segment_capacity) {
+            uint32_t old_capacity = um.segment_capacity;
+            um.segment_capacity *= 2;
+            if (options.safe) {
+                safe_table_grow(um.words, old_capacity, um.segment_capacity);
+            } else {
+                um.words = realloc(um.words,
+                                   um.segment_capacity * sizeof(*um.words));
+                assert(um.words != NULL);
+            }
+            um.lengths = realloc(um.lengths,
+                                 um.segment_capacity * sizeof(*um.lengths));
+            um.referenced = realloc(um.referenced, um.segment_capacity);
+            assert(um.lengths != NULL && um.referenced != NULL);
+        }
+        id = um.num_segments++;
+    }
+
+    // Allocate the memory for the segment, with each word initialized to 0
+    um.words[id] = new_words(id, um.registers[rc]);
+    um.lengths[id] = um.registers[rc];
+    if (options.memory_budget != 0) {
+        um.referenced[id] = 1;
+    }
+    if (options.events_path != NULL) {
+        events_map(id, um.lengths[id]);
+    }
+    UM_PROBE2(map_end, id, um.lengths[id]);
+    if (stats != NULL) {
+        stats->segments++;
+        stats->mapped_bytes += (uint64_t) um.lengths[id] * sizeof(uint32_t);
+        stats->unmapped_ids = um.num_unmapped;
     }
-    updated_segment->length = um.registers[rc];
-    updated_segment->words = real_memory;
 
     um.registers[rb] = id;
 }
 
 static inline void op_unmap_segment(Um_register rc)
 {
-    // Free the segment memory
-    Segment segment = (Segment) Seq_get(um.mapped, um.registers[rc]);
-    free(segment->words);
-    segment->length = 0;
-    segment->words = NULL;
+    uint32_t id = um.registers[rc];
+
+    UM_PROBE2(unmap, id, um.lengths[id]);
+    if (options.events_path != NULL) {
+        events_unmap(id, um.lengths[id]);
+    }
+    if (stats != NULL) {
+        stats->segments--;
+        stats->mapped_bytes -= (uint64_t) um.lengths[id] * sizeof(uint32_t);
+    }
+
+    // Free the segment memory; in safe mode the id now points at the trap
+    free_words(id);
+    um.words[id] = options.safe ? safe_trap_words : NULL;
+    um.lengths[id] = 0;
+
+    // The cached pair may name the segment we just freed
+    if (um.cached_id == id) {
+        um.cached_id = NO_SEGMENT;
+    }
 
     // Add the id to unmapped
-    Seq_addhi(um.unmapped, (void *)(uintptr_t)um.registers[rc]);
+    if (um.num_unmapped == um.unmapped_capacity) {
+        um.unmapped_capacity *= 2;
+        um.unmapped = realloc(um.unmapped,
+                              um.unmapped_capacity * sizeof(*um.unmapped));
+        assert(um.unmapped != NULL);
+    }
+    um.unmapped[um.num_unmapped++] = id;
+    if (stats != NULL) {
+        stats->unmapped_ids = um.num_unmapped;
+    }
 }
 
 static inline void op_output(Um_register rc)
 {
     // Print as unsigned char
-    printf("%c", um.registers[rc]);
+    UM_PROBE1(output, um.registers[rc] & 0xff);
+    if (stats != NULL) {
+        stats->output_bytes++;
+    }
+    if (options.output_ring != NULL) {
+        ring_put(options.output_ring, um.registers[rc]);
+    } else {
+        printf("%c", um.registers[rc]);
+    }
 }
 
 static inline void op_input(Um_register rc)
 {
-    // Take input from stdin
-    int input = getc(stdin);
+    // A replayed input is read from memory, without waiting
+    int input;
+    if (options.replay_path != NULL) {
+        input = replay_input(um.counter);
+    } else {
+        // Let the next machine of a pipeline see the output so far if this
+        // one may wait on the user
+        if (options.output_ring != NULL && options.input_ring == NULL &&
+            interactive) {
+            ring_flush(options.output_ring);
+        }
+
+        // Waiting on the user is a good time to tidy up the heap
+        if (options.compact && options.input_ring == NULL) {
+            fflush(stdout);
+            compact_while_idle(STDIN_FILENO, stats);
+        }
+
+        // Take input from stdin or the previous machine of a pipeline
+        input = options.input_ring != NULL ?
+                ring_get(options.input_ring, options.output_ring) :
+                getc(stdin);
+        if (options.record_path != NULL) {
+            record_input(um.counter, input);
+        }
+    }
     if (input == -1) {
         uint32_t value = 0;
         value = ~value;
@@ -110,6 +634,124 @@ static inline void op_input(Um_register rc)
     } else {
         um.registers[rc] = input;
     }
+    UM_PROBE2(input, um.counter, um.registers[rc]);
+    if (stats != NULL && input != -1) {
+        stats->input_bytes++;
+    }
+}
+
+/*
+* load_program
+* Fills in the decoded form of a new m[0] from the cache, and lays out its
+* blocks if the cache holds a profile of it
+*/
+static void load_program()
+{
+    if (options.cache_dir == NULL) {
+        return;
+    }
+    cache_load(um.words[0], um.lengths[0], um.code);
+    watch_code(0, um.lengths[0]);
+    if (options.optimize) {
+        lay_out_blocks();
+    }
+}
+
+/*
+* save_program
+* Writes the decoded form of m[0] back to the cache before it is replaced,
+* with the transitions counted while it ran in a profiling run
+*/
+static void save_program()
+{
+    if (options.cache_dir == NULL) {
+        return;
+    }
+    uint32_t num_edges = 0;
+    const Um_edge *edges = NULL;
+    if (options.profile) {
+        edges = layout_edges(&num_edges);
+    }
+    cache_save(um.words[0], um.code, edges, num_edges);
+    if (options.profile) {
+        layout_reset();
+        last_block = UINT32_MAX;
+    }
+}
+
+static void match_aot_image();
+
+/*
+* replace_program
+* Replaces m[0] and everything derived from it with a copy of a program
+* Arguments:
+*   - words, length - the program, which must not be m[0] itself
+*/
+static void replace_program(const uint32_t *words, uint32_t length)
+{
+    save_program();
+    free_code(um.code, um.lengths[0]);
+    um.code = new_code(length);
+    if (options.optimize) {
+        free_blocks(um.lengths[0]);
+        new_blocks(length);
+    }
+    free_words(0);
+    um.words[0] = new_words(0, length);
+    memcpy(um.words[0], words, length * sizeof(uint32_t));
+    um.lengths[0] = length;
+    load_program();
+    if (um.cached_id == 0) {
+        um.cached_id = NO_SEGMENT;
+    }
+    match_aot_image();
+}
+
+/*
+* match_aot_image
+* Finds the compiled image m[0] holds, if any. Safe mode always interprets,
+* so faults are reported at the instruction that caused them.
+*/
+static void match_aot_image()
+{
+    aot_image = NULL;
+    free(aot_stale);
+    aot_stale = NULL;
+    for (uint32_t i = 0; i < options.num_aot_images && !options.safe; i++) {
+        const Um_aot_image *image = &options.aot_images[i];
+        if (image->length == um.lengths[0] &&
+            memcmp(image->words, um.words[0],
+                   image->length * sizeof(uint32_t)) == 0) {
+            aot_image = image;
+            aot_stale = calloc(image->length + 1, 1);
+            assert(aot_stale != NULL);
+            watch_code(0, image->length);
+            return;
+        }
+    }
+}
+
+/*
+* dump_program
+* Writes m[0] to the next numbered dump file, in the .um file format
+*/
+static void dump_program()
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%" PRIu32 ".um", options.dump_prefix,
+             ++num_dumps);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "um: could not write %s\n", path);
+        return;
+    }
+    for (uint32_t i = 0; i < um.lengths[0]; i++) {
+        uint32_t word = um.words[0][i];
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            putc((word >> shift) & 0xff, fp);
+        }
+    }
+    fclose(fp);
 }
 
 static inline void op_load_program(Um_register rb, Um_register rc)
@@ -122,31 +764,58 @@ static inline void op_load_program(Um_register rb, Um_register rc)
         return;
     }
 
-    // Retrieve the instructions segment
-    Segment instructions_segment = (Segment) Seq_get(um.mapped, 0);
-    free(instructions_segment->words);
-
-    // Retrieve the segment to duplicate
-    Segment load_from = (Segment) Seq_get(um.mapped, um.registers[rb]);
+    // Replace the old instructions with a duplicate of m[rb]
+    uint32_t from = um.registers[rb];
+    UM_PROBE3(load_program, from, um.lengths[from], um.counter);
+    if (stats != NULL) {
+        stats->load_programs++;
+    }
+    uint64_t start = options.events_path != NULL ? events_now() : 0;
+    replace_program(um.words[from], um.lengths[from]);
+    if (options.events_path != NULL) {
+        events_load_program(start, from, um.lengths[0]);
+    }
 
-    // Create new words segment
-    uint32_t *new_words = malloc(load_from->length * sizeof(uint32_t));
-    assert(new_words != NULL);
+    if (options.dump_prefix != NULL) {
+        dump_program();
+    }
+}
 
+bool aot_store_code(uint32_t pc, uint32_t index, uint32_t value)
+{
+    um.words[0][index] = value;
+    invalidate_code(index);
+    mark_stale(index);
+    return aot_stale[pc];
+}
 
-    // Copy words in the segment
-    for (uint32_t i = 0; i < load_from->length; i++)  {
-        new_words[i] = (load_from->words)[i];
+void aot_step(uint32_t word)
+{
+    Um_register rb = (word >> 3) & 0x7;
+    Um_register rc = word & 0x7;
+
+    switch (word >> 28) {
+      case ACTIVATE:
+          op_map_segment(rb, rc);
+          break;
+      case INACTIVATE:
+          op_unmap_segment(rc);
+          break;
+      case OUT:
+          op_output(rc);
+          break;
+      case IN:
+          op_input(rc);
+          break;
+      default:
+          assert(false);
     }
-
-    // Update instructions segments fields
-    instructions_segment->length = load_from->length;
-    instructions_segment->words = new_words;
 }
 
-static inline void op_load_value(Um_register ra, uint32_t value)
+static inline void op_load_value(uint32_t *registers, Um_register ra,
+                                 uint32_t value)
 {
-    um.registers[ra] = value;
+    registers[ra] = value;
 }
 
 Except_T Bitpack_Overflow = { "Overflow packing bits" };
@@ -206,40 +875,120 @@ static inline uint64_t Bitpack_newu(uint64_t word, unsigned width, unsigned lsb,
 
 #define SEGMENT_HINT 65536
 
+/*
+* How a run of m[0] handed control back
+*/
+typedef enum Run_exit {
+    RUN_HALT,       // the machine halted
+    RUN_PREEMPT,    // the run_for budget ran out at a block entry
+    RUN_RESUME      // the next way of running it takes over at um.counter
+} Run_exit;
+
 void initialize_um ();
 void read_instructions (FILE *fp);
-void execute_instructions ();
-void free_um ();
+Run_exit execute_instructions ();
+
+void run_um (FILE *file, const Um_options *run_options) {
+
+    load_um(file, run_options);
+    finish_um();
+}
 
-void run_um (FILE *file) {
+void load_um (FILE *file, const Um_options *run_options) {
+
+    options = *run_options;
+
+    // The pool only backs segments no other backend takes
+    options.pool = options.pool && !options.safe &&
+                   options.memory_budget == 0 && !options.compact;
 
     initialize_um();
     // Read in the initial instructions
     read_instructions(file);
+}
+
+void finish_um () {
 
     // Loop through execution
-    execute_instructions();
+    bool halted = run_loaded();
 
     // Free the UM emulator
     free_um();
+    if (!halted) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool run_loaded () {
+
+    if (options.time_limit_ms == 0) {
+        execute_instructions();
+        UM_PROBE1(halt, um.num_segments - 1 - um.num_unmapped);
+        if (stats != NULL) {
+            stats->halted = true;
+        }
+        return true;
+    }
+    Um_budget budget = { 0, (uint64_t) options.time_limit_ms * 1000 };
+    if (run_for(budget) == UM_HALTED) {
+        return true;
+    }
+    fprintf(stderr, "Time limit of %" PRIu32 " ms exceeded at pc %" PRIu32
+                    ".\n", options.time_limit_ms, um.counter);
+    return false;
 }
 
 void initialize_um () {
 
     // Instruction counter
     um.counter = 0;
+    interactive = isatty(STDIN_FILENO);
 
     // Array for registers
     for(int i = 0; i < NUM_REGISTERS; i++){
         um.registers[i] = 0;
     }
 
-    // Sequences for segments
-    um.mapped = Seq_new(SEGMENT_HINT);
-    assert(um.mapped != NULL);
-    um.unmapped = Seq_new(SEGMENT_HINT);
+    // Segment table and unmapped id stack
+    um.segment_capacity = SEGMENT_HINT;
+    um.num_segments = 0;
+    if (options.safe) {
+        safe_init(&um);
+        um.words = safe_table_new(SEGMENT_HINT);
+    } else {
+        um.words = malloc(SEGMENT_HINT * sizeof(*um.words));
+    }
+    um.lengths = malloc(SEGMENT_HINT * sizeof(*um.lengths));
+    um.referenced = calloc(SEGMENT_HINT, 1);
+    assert(um.words != NULL && um.lengths != NULL && um.referenced != NULL);
+    if (options.memory_budget != 0) {
+        spill_init(&um, options.memory_budget, options.spill_path);
+    }
+    if (options.compact) {
+        compact_init(&um);
+    }
+    if (options.pool) {
+        pool_init();
+    }
+    if (options.tier_threshold != 0) {
+        tier_start();
+    }
+    if (options.cache_dir != NULL) {
+        cache_init(options.cache_dir, options.safe ?
+                   ENGINE_VERSION | SAFE_VERSION_BIT : ENGINE_VERSION);
+    }
+    if (!options.safe) {
+        watch_init(forget_page, invalidate_page, forget_code);
+    }
+
+    um.unmapped_capacity = SEGMENT_HINT;
+    um.num_unmapped = 0;
+    um.unmapped = malloc(SEGMENT_HINT * sizeof(*um.unmapped));
     assert(um.unmapped != NULL);
 
+    um.cached_id = NO_SEGMENT;
+    um.cached_words = NULL;
+
 }
 
 void read_instructions (FILE *fp) {
@@ -265,146 +1014,856 @@ void read_instructions (FILE *fp) {
         Seq_addhi(instructions, (void *)(uintptr_t)word);
     }
 
-    // Create segment representing the program
-    Segment segment0 = malloc(sizeof(*segment0));
-    assert(segment0 != NULL);
-    segment0->length = Seq_length(instructions);
-
     // Create words array with length of sequence
-    uint32_t *words = malloc(sizeof(uint32_t) * segment0->length);
-    assert(words != NULL);
-    segment0->words = words;
+    uint32_t length = Seq_length(instructions);
+    uint32_t *words = new_words(0, length);
 
     // Copy the values in the sequence to the words array
-    for (uint32_t i = 0; i < segment0->length; i++) {
+    for (uint32_t i = 0; i < length; i++) {
         words[i] = (uint32_t)(uintptr_t)Seq_get(instructions, i);
     }
 
-    // Store segment as m[0]
-    Seq_addhi(um.mapped, (void *) segment0);
+    // Store segment as m[0], keeping a copy for reset_um
+    um.words[0] = words;
+    um.lengths[0] = length;
+    program = malloc(length * sizeof(uint32_t));
+    assert(program != NULL || length == 0);
+    memcpy(program, words, length * sizeof(uint32_t));
+    program_length = length;
+    UM_PROBE1(program_load, length);
+    if (options.record_path != NULL) {
+        record_start(options.record_path, program, program_length);
+    }
+    if (options.replay_path != NULL) {
+        replay_start(options.replay_path, program, program_length);
+    }
+    if (options.trace_path != NULL) {
+        trace_start(options.trace_path, program, program_length);
+    }
+    if (options.events_path != NULL) {
+        events_start(options.events_path, options.event_sample);
+    }
+    if (options.stats_path != NULL) {
+        stats = stats_start(options.stats_path);
+        counting = true;
+    }
+    um.num_segments = 1;
+    um.code = new_code(length);
+    if (options.optimize) {
+        new_blocks(length);
+    }
+    load_program();
+    match_aot_image();
 
     Seq_free(&instructions);
 }
 
-void execute_instructions () {
+/*
+* decode_instruction
+* Unpacks an instruction word into its decoded entry. Unless the engine is
+* built with UM_GENERIC_HANDLERS, three-register arithmetic and move
+* instructions get the op of the handler specialized for their registers.
+*/
+static Um_decoded decode_instruction(Um_instruction word)
+{
+    Um_decoded decoded = { 0, 0, 0, 0, 0 };
+    Um_opcode opcode = Bitpack_getu(word, 4, 28);
+
+    decoded.op = DOP_OF(opcode);
+    if (opcode == LV) {
+        decoded.a = Bitpack_getu(word, 3, 25);
+        decoded.value = Bitpack_getu(word, 25, 0);
+        return decoded;
+    }
+    decoded.a = Bitpack_getu(word, 3, 6);
+    decoded.b = Bitpack_getu(word, 3, 3);
+    decoded.c = Bitpack_getu(word, 3, 0);
+
+#ifndef UM_GENERIC_HANDLERS
+    int kind = -1;
+    switch (opcode) {
+      case CMOV: kind = SPEC_CMOV; break;
+      case ADD:  kind = SPEC_ADD;  break;
+      case MUL:  kind = SPEC_MUL;  break;
+      case DIV:  kind = SPEC_DIV;  break;
+      case NAND: kind = SPEC_NAND; break;
+      default:   break;
+    }
+    if (kind >= 0) {
+        decoded.op = SPEC_OP(kind, decoded.a, decoded.b, decoded.c);
+    }
+#endif
+    return decoded;
+}
 
-    Um_register ra = -1;
-    Um_register rb = -1;
-    Um_register rc = -1;
+/*
+* Specialized handlers: the generic operation inlined with constant registers
+*/
+#define HANDLER_SPEC_CMOV op_conditional_move
+#define HANDLER_SPEC_ADD  op_addition
+#define HANDLER_SPEC_MUL  op_multiplication
+#define HANDLER_SPEC_DIV  op_division
+#define HANDLER_SPEC_NAND op_bitwise_NAND
 
-    Segment instruction_segment = (Segment) Seq_get(um.mapped, 0);
-    uint32_t *instructions = instruction_segment->words;
-    Um_instruction cur_instruction = 0;
-    int opcode = -1;
-    bool doLoop = true;
-    // Loop through each instruction
-    while (doLoop) {
+#define SPECIALIZED_CASE(kind, a, b, c) \
+    case SPEC_OP(kind, a, b, c): HANDLER_##kind(registers, a, b, c); break;
 
-        // Retrieve the current instruction
-        cur_instruction = instructions[um.counter];
+/*
+* decode_entry
+* Decodes m[0][pc] into the code array, fusing it with the instructions
+* that follow when they form one of the superinstruction idioms. The fused
+* entries are decoded too (without fusion of their own) so the
+* superinstruction can read their operands. Safe mode fuses nothing, since
+* a superinstruction only moves the pc past its words once all of them have
+* run, and a fault in any but the first would be reported at the first.
+*/
+static void decode_entry(uint32_t pc)
+{
+    watch_code(pc, MAX_FUSED_LENGTH);
+    uint32_t *words = um.words[0];
+    uint32_t length = um.lengths[0];
+    Um_decoded *code = um.code;
 
-        // Retrieve the opcode
-        opcode = Bitpack_getu(cur_instruction, 4, 28);
+    code[pc] = decode_instruction(words[pc]);
+    if (options.safe || pc + 1 >= length) {
+        return;
+    }
+
+    Um_opcode first = words[pc] >> 28;
+    Um_opcode second = words[pc + 1] >> 28;
+    uint16_t fused = DOP_DECODE;
+    if (first == LV && second == LV) {
+        fused = DOP_LV_LV;
+    } else if (first == LV && second == SLOAD) {
+        fused = DOP_LV_SLOAD;
+    } else if (first == LV && second == SSTORE) {
+        fused = DOP_LV_SSTORE;
+    } else if (first == NAND && second == NAND) {
+        fused = DOP_NAND_NAND;
+    } else if (first == LV && second == LOADP) {
+        fused = DOP_LV_LOADP;
+    } else if (first == SLOAD && second == ADD && pc + 2 < length &&
+               (Um_opcode) (words[pc + 2] >> 28) == SSTORE) {
+        fused = DOP_SLOAD_ADD_SSTORE;
+    }
+    if (fused == DOP_DECODE) {
+        return;
+    }
+
+    for (uint32_t i = 1; i < FUSED_LENGTH(fused); i++) {
+        if (code[pc + i].op == DOP_DECODE) {
+            code[pc + i] = decode_instruction(words[pc + i]);
+        }
+    }
+    code[pc].op = fused;
+}
+
+/*
+* How execution left an optimized block
+*/
+typedef enum Block_exit {
+    BLOCK_HALT,     // the machine halted
+    BLOCK_ENTRY,    // control moved to the start of another block
+    BLOCK_RESUME    // the interpreter takes over at um.counter
+} Block_exit;
+
+static uint64_t now_ns()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/*
+* budget_spent
+* Charges instructions run since the last block entry to the live
+* statistics and to the budget of run_for, at a block entry
+* Arguments:
+*   - executed - the instructions run
+* Return: whether the budget has run out
+*/
+static bool budget_spent(uint64_t executed)
+{
+    if (stats != NULL) {
+        stats->instructions += executed;
+        if (!budgeted) {
+            return false;
+        }
+    }
+    if (executed >= budget_left) {
+        budget_left = 0;
+        return true;
+    }
+    budget_left -= executed;
+    if (deadline != 0 && --clock_checks == 0) {
+        clock_checks = BUDGET_CLOCK_CHECKS;
+        return now_ns() >= deadline;
+    }
+    return false;
+}
+
+/*
+* run_block
+* Executes an optimized block. The counter is kept on the instruction being
+* run so faults report the right pc, and a store into m[0] leaves the block
+* straight away since it may have rewritten (and freed) the block.
+*/
+static Block_exit run_block(Um_block *block)
+{
+    Um_block_op *op = block->ops;
+    Um_block_op *end = op + block->num_ops;
+
+    for (; op < end; op++) {
+        Um_decoded *d = &op->d;
+        um.counter = op->pc;
+
+        switch (d->op) {
+          case DOP_CMOV:
+              op_conditional_move(um.registers, d->a, d->b, d->c);
+              break;
+          case DOP_SLOAD:
+              op_segmented_load(um.registers, d->a, d->b, d->c);
+              break;
+          case DOP_SSTORE:
+              if (um.registers[d->a] == 0) {
+                  um.counter = op->pc + 1;
+                  op_segmented_store(um.registers, d->a, d->b, d->c, false);
+                  return BLOCK_RESUME;
+              }
+              op_segmented_store(um.registers, d->a, d->b, d->c, true);
+              break;
+          case DOP_ADD:
+              op_addition(um.registers, d->a, d->b, d->c);
+              break;
+          case DOP_MUL:
+              op_multiplication(um.registers, d->a, d->b, d->c);
+              break;
+          case DOP_DIV:
+              op_division(um.registers, d->a, d->b, d->c);
+              break;
+          case DOP_NAND:
+              op_bitwise_NAND(um.registers, d->a, d->b, d->c);
+              break;
+          case DOP_HALT:
+              return BLOCK_HALT;
+          case DOP_ACTIVATE:
+              op_map_segment(d->b, d->c);
+              break;
+          case DOP_INACTIVATE:
+              op_unmap_segment(d->c);
+              break;
+          case DOP_OUT:
+              op_output(d->c);
+              break;
+          case DOP_IN:
+              op_input(d->c);
+              break;
+          case DOP_LOADP:
+              op_load_program(d->b, d->c);
+              return BLOCK_ENTRY;
+          case DOP_LV:
+          case DOP_CONST:
+              op_load_value(um.registers, d->a, d->value);
+              break;
+          case DOP_MOV:
+              um.registers[d->a] = um.registers[d->b];
+              break;
+          case DOP_JUMP:
+              um.counter = d->value;
+              return BLOCK_ENTRY;
+          default:
+              break;
+        }
+    }
+
+    um.counter = block->exit_pc;
+    return BLOCK_RESUME;
+}
+
+/*
+* tiered_block
+* Counts an entry to the block at um.counter, queueing it to be built in the
+* background once it is hot, and takes it once it has been built
+* Return: the block, or NULL if the interpreter must run it for now
+*/
+static Um_block *tiered_block()
+{
+    uint32_t pc = um.counter;
+    uint32_t *entries = &um.block_entries[pc];
+    if (*entries < options.tier_threshold) {
+        if (++*entries == options.tier_threshold &&
+            !tier_request(um.words[0] + pc, um.lengths[0] - pc, pc)) {
+            *entries = 0;
+        }
+        return NULL;
+    }
+
+    Um_block *block;
+    if (!tier_take(pc, um.words[0] + pc, &block)) {
+        return NULL;
+    }
+    if (block == NULL) {
+        // Built from words since overwritten, so count it again
+        *entries = 0;
+    }
+    return block;
+}
+
+/*
+* run_blocks
+* Runs optimized blocks from um.counter, building each on first entry or
+* taking it from the background compiler, for as long as control keeps
+* arriving at block entries
+* Return: true if the machine halted
+*/
+static Run_exit run_blocks()
+{
+    // A pc past the end of m[0] is left for the interpreter to report
+    while (um.counter < um.lengths[0]) {
+        if (options.profile) {
+            if (last_block != UINT32_MAX) {
+                layout_count(last_block, um.counter);
+            }
+            last_block = um.counter;
+        }
+
+        Um_block *block = um.blocks[um.counter];
+        if (block == NULL) {
+            if (options.tier_threshold == 0) {
+                block = optimize_block(um.words[0] + um.counter,
+                                       um.lengths[0] - um.counter,
+                                       um.counter);
+            } else if ((block = tiered_block()) == NULL) {
+                return RUN_RESUME;
+            }
+            install_block(block);
+        }
+
+        // Loop idioms run all but their last iterations in bulk
+        uint32_t start = um.counter;
+        uint64_t executed = block->length;
+        if (block->loop != NULL) {
+            uint32_t iterations = loop_run(&um, block->loop);
+            executed += (uint64_t)iterations * block->length;
+            if (stats != NULL) {
+                stats->loop_instructions[loop_kind(block->loop)] +=
+                    (uint64_t)iterations * block->length;
+            }
+        }
+
+        uint64_t looped = executed - block->length;
+
+        Block_exit exit = run_block(block);
+        if (exit != BLOCK_ENTRY) {
+            // Whatever runs on counts from where the block left off, which
+            // a store into m[0] may have freed
+            if (counting) {
+                budget_spent(looped + (um.counter - start) +
+                             (exit == BLOCK_HALT));
+            }
+            return exit == BLOCK_HALT ? RUN_HALT : RUN_RESUME;
+        }
+        if (counting && budget_spent(executed)) {
+            return RUN_PREEMPT;
+        }
+    }
+    return RUN_RESUME;
+}
+
+/*
+* run_compiled
+* Runs m[0] from a block entry as compiled code when it matches a compiled
+* image and no block entry is counted, or as optimized blocks when the
+* optimizing tier is on, once what was cached from pages stored into is
+* dropped
+* Return: RUN_RESUME if the interpreter is to carry on
+*/
+static Run_exit run_compiled()
+{
+    watch_flush();
+    if (aot_image != NULL && !counting) {
+        return aot_image->run(&um) == AOT_HALT ? RUN_HALT : RUN_RESUME;
+    }
+    return options.optimize ? run_blocks() : RUN_RESUME;
+}
+
+/*
+* run_asm_core
+* Runs m[0] on the assembly core, carrying out the instructions it hands
+* back one at a time and resuming it after each
+* Arguments: None
+* Return: void
+*/
+static void run_asm_core()
+{
+#if UM_HAVE_ASM_CORE
+    while (!um_asm_run(um.registers, &um.counter, um.words)) {
+        uint32_t word = um.words[0][um.counter];
+        if ((Um_opcode) (word >> 28) == LOADP) {
+            op_load_program((word >> 3) & 0x7, word & 0x7);
+            if (run_compiled() == RUN_HALT) {
+                return;
+            }
+        } else {
+            aot_step(word);
+            um.counter++;
+        }
+    }
+#else
+    assert(false);
+#endif
+}
+
+/*
+* store_frame
+* Writes the register file and pc the interpreter runs on back to um, for
+* the operations that read or change them there
+*/
+static inline void store_frame(const uint32_t *registers,
+                               const uint32_t *counter)
+{
+    if (registers != um.registers) {
+        memcpy(um.registers, registers, sizeof(um.registers));
+    }
+    um.counter = *counter;
+}
+
+/*
+* load_frame
+* Reads the register file and pc back from um after such an operation
+*/
+static inline void load_frame(uint32_t *registers, uint32_t *counter)
+{
+    if (registers != um.registers) {
+        memcpy(registers, um.registers, sizeof(um.registers));
+    }
+    *counter = um.counter;
+}
+
+/*
+* trace_loaded_program
+* Writes the program a load program is about to copy into m[0] to the
+* trace, unless it is m[0] itself
+*/
+static void trace_loaded_program(Um_register rb)
+{
+    uint32_t from = um.registers[rb];
+    if (from != 0) {
+        trace_program(um.words[from], um.lengths[from]);
+    }
+}
+
+/*
+* interpret
+* Runs the decoded form of m[0] from *counter on the given register file.
+* Inlined into each caller, so that when both are locals of the caller the
+* compiler keeps the pc in a host register and knows no store into a
+* segment can change the registers; they are written back to um only
+* around the operations that need them there.
+* Arguments:
+*   - registers - the register file to run on: um.registers or a copy
+*   - counter - the pc to run on: &um.counter or a copy
+*   - watched - whether um_watch catches stores into m[0], so that
+*               segmented stores need no check for them
+*   - traced - whether to write what the instructions read from outside
+*              the register file to the trace (see um_trace.h), in which
+*              case nothing runs compiled
+*   - bounded - whether to check each segment access and load program, as
+*               safe mode does
+* Return: RUN_HALT once the machine halts, RUN_PREEMPT once the budget of
+*         run_for runs out, or RUN_RESUME if it is left in um because the
+*         watch stopped
+*/
+static inline __attribute__((always_inline))
+Run_exit interpret(uint32_t *registers, uint32_t *counter, bool watched,
+                   bool traced, bool bounded)
+{
+    Um_decoded *code = um.code;
+    Run_exit exit;
+
+    // The block entry the pc last passed, and the instructions run since,
+    // for charging run_for's budget
+    uint32_t entry = *counter, executed;
+
+    // Loop through each instruction
+    while (true) {
+
+        // Retrieve the current decoded instruction
+        Um_decoded *d = &code[*counter];
 
         // Execute the corresponding instruction
-        switch(opcode){
-          case CMOV:
-              ra = Bitpack_getu(cur_instruction, 3, 6);
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_conditional_move(ra, rb, rc);
+        switch (d->op) {
+          case DOP_DECODE:
+              if (watched && !watch_active()) {
+                  if (counting) {
+                      budget_spent(*counter - entry);
+                  }
+                  store_frame(registers, counter);
+                  return RUN_RESUME;
+              }
+              watch_flush();
+              decode_entry(*counter);
+              continue;
+          case DOP_CMOV:
+              op_conditional_move(registers, d->a, d->b, d->c);
               break;
-          case SLOAD:
-              ra = Bitpack_getu(cur_instruction, 3, 6);
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_segmented_load(ra, rb, rc);
+          case DOP_SLOAD:
+              if (bounded) {
+                  check_access(registers[d->b], registers[d->c]);
+              }
+              op_segmented_load(registers, d->a, d->b, d->c);
+              if (traced) {
+                  trace_load(*counter, registers[d->a]);
+              }
               break;
-          case SSTORE:
-              ra = Bitpack_getu(cur_instruction, 3, 6);
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_segmented_store(ra, rb, rc);
+          case DOP_SSTORE:
+              if (bounded) {
+                  check_access(registers[d->a], registers[d->b]);
+              }
+              op_segmented_store(registers, d->a, d->b, d->c, watched);
               break;
-          case ADD:
-              ra = Bitpack_getu(cur_instruction, 3, 6);
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_addition(ra, rb, rc);
+          case DOP_ADD:
+              op_addition(registers, d->a, d->b, d->c);
               break;
-          case MUL:
-              ra = Bitpack_getu(cur_instruction, 3, 6);
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_multiplication(ra, rb, rc);
+          case DOP_MUL:
+              op_multiplication(registers, d->a, d->b, d->c);
               break;
-          case DIV:
-              ra = Bitpack_getu(cur_instruction, 3, 6);
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_division(ra, rb, rc);
+          case DOP_DIV:
+              op_division(registers, d->a, d->b, d->c);
               break;
-          case NAND:
-              ra = Bitpack_getu(cur_instruction, 3, 6);
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_bitwise_NAND(ra, rb, rc);
+          case DOP_NAND:
+              op_bitwise_NAND(registers, d->a, d->b, d->c);
               break;
-          case HALT:
-              doLoop = false;
+          case DOP_HALT:
+              if (counting) {
+                  budget_spent(*counter + 1 - entry);
+              }
+              store_frame(registers, counter);
+              return RUN_HALT;
+          case DOP_ACTIVATE:
+              store_frame(registers, counter);
+              op_map_segment(d->b, d->c);
+              load_frame(registers, counter);
+              if (traced) {
+                  trace_value(registers[d->b]);
+              }
               break;
-          case ACTIVATE:
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_map_segment(rb, rc);
+          case DOP_INACTIVATE:
+              store_frame(registers, counter);
+              op_unmap_segment(d->c);
+              load_frame(registers, counter);
               break;
-          case INACTIVATE:
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_unmap_segment(rc);
+          case DOP_OUT:
+              store_frame(registers, counter);
+              op_output(d->c);
+              load_frame(registers, counter);
               break;
-          case OUT:
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_output(rc);
+          case DOP_IN:
+              store_frame(registers, counter);
+              op_input(d->c);
+              load_frame(registers, counter);
+              if (traced) {
+                  trace_value(registers[d->c] + 1);
+              }
               break;
-          case IN:
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_input(rc);
+          case DOP_LOADP:
+              store_frame(registers, counter);
+              executed = *counter + 1 - entry;
+              if (traced) {
+                  trace_loaded_program(d->b);
+              }
+              if (bounded) {
+                  check_program(registers[d->b]);
+              }
+              op_load_program(d->b, d->c);
+              if (bounded && um.counter >= um.lengths[0]) {
+                  safe_fault("program counter past the end of m[0]");
+              }
+              if (counting && budget_spent(executed)) {
+                  return RUN_PREEMPT;
+              }
+              if (!traced && (exit = run_compiled()) != RUN_RESUME) {
+                  return exit;
+              }
+              if (watched && !watch_active()) {
+                  return RUN_RESUME;
+              }
+              load_frame(registers, counter);
+              entry = *counter;
+              code = um.code;
+              continue;
+          case DOP_LV:
+              op_load_value(registers, d->a, d->value);
               break;
-          case LOADP:
-              rb = Bitpack_getu(cur_instruction, 3, 3);
-              rc = Bitpack_getu(cur_instruction, 3, 0);
-              op_load_program(rb, rc);
-              instruction_segment = (Segment) Seq_get(um.mapped, 0);
-              instructions = instruction_segment->words;
+          case DOP_LV_LV:
+              op_load_value(registers, d[0].a, d[0].value);
+              op_load_value(registers, d[1].a, d[1].value);
+              *counter += 2;
+              continue;
+          case DOP_LV_SLOAD:
+              op_load_value(registers, d[0].a, d[0].value);
+              op_segmented_load(registers, d[1].a, d[1].b, d[1].c);
+              if (traced) {
+                  trace_load(*counter + 1, registers[d[1].a]);
+              }
+              *counter += 2;
+              continue;
+          case DOP_LV_SSTORE:
+              op_load_value(registers, d[0].a, d[0].value);
+              op_segmented_store(registers, d[1].a, d[1].b, d[1].c, watched);
+              *counter += 2;
+              continue;
+          case DOP_NAND_NAND:
+              op_bitwise_NAND(registers, d[0].a, d[0].b, d[0].c);
+              op_bitwise_NAND(registers, d[1].a, d[1].b, d[1].c);
+              *counter += 2;
               continue;
-          case LV:
-              ra = Bitpack_getu(cur_instruction, 3, 25);
-              uint32_t value = Bitpack_getu(cur_instruction, 25, 0);
-              op_load_value(ra, value);
+          case DOP_LV_LOADP:
+              op_load_value(registers, d[0].a, d[0].value);
+              store_frame(registers, counter);
+              executed = *counter + 2 - entry;
+              if (traced) {
+                  trace_loaded_program(d[1].b);
+              }
+              op_load_program(d[1].b, d[1].c);
+              if (counting && budget_spent(executed)) {
+                  return RUN_PREEMPT;
+              }
+              if (!traced && (exit = run_compiled()) != RUN_RESUME) {
+                  return exit;
+              }
+              if (watched && !watch_active()) {
+                  return RUN_RESUME;
+              }
+              load_frame(registers, counter);
+              entry = *counter;
+              code = um.code;
+              continue;
+          case DOP_SLOAD_ADD_SSTORE:
+              op_segmented_load(registers, d[0].a, d[0].b, d[0].c);
+              if (traced) {
+                  trace_load(*counter, registers[d[0].a]);
+              }
+              op_addition(registers, d[1].a, d[1].b, d[1].c);
+              op_segmented_store(registers, d[2].a, d[2].b, d[2].c, watched);
+              *counter += 3;
+              continue;
+#ifndef UM_GENERIC_HANDLERS
+          FOR_REGS(SPECIALIZED_CASE, SPEC_CMOV)
+          FOR_REGS(SPECIALIZED_CASE, SPEC_ADD)
+          FOR_REGS(SPECIALIZED_CASE, SPEC_MUL)
+          FOR_REGS(SPECIALIZED_CASE, SPEC_DIV)
+          FOR_REGS(SPECIALIZED_CASE, SPEC_NAND)
+#endif
+          default:
               break;
         }
-        um.counter++;
+        (*counter)++;
     }
 }
 
-void free_um () {
+/*
+* interpret_pinned
+* Runs the interpreter on copies of the registers and pc held in locals.
+* Each instance of interpret is kept out of line in a function of its own,
+* so that none crowds another out of the compiler's inlining and tail
+* duplication budget. Stores into m[0] are left to um_watch.
+* Return: as for interpret
+*/
+static __attribute__((noinline)) Run_exit interpret_pinned()
+{
+    uint32_t registers[NUM_REGISTERS];
+    uint32_t counter;
+    load_frame(registers, &counter);
+    return interpret(registers, &counter, true, false, false);
+}
 
-    // Delete segments
-    size_t num_segments = Seq_length(um.mapped);
-    for (size_t i = 0; i < num_segments; i++) {
+/*
+* interpret_checked
+* Runs the interpreter on locals like interpret_pinned, checking each store
+* for m[0] itself, once um_watch has stopped
+*/
+static __attribute__((noinline)) Run_exit interpret_checked()
+{
+    uint32_t registers[NUM_REGISTERS];
+    uint32_t counter;
+    load_frame(registers, &counter);
+    return interpret(registers, &counter, false, false, false);
+}
+
+/*
+* interpret_traced
+* Runs the interpreter on locals like interpret_checked, writing the trace
+*/
+static __attribute__((noinline)) Run_exit interpret_traced()
+{
+    uint32_t registers[NUM_REGISTERS];
+    uint32_t counter;
+    load_frame(registers, &counter);
+    return interpret(registers, &counter, false, true, false);
+}
+
+/*
+* interpret_in_place
+* Runs the interpreter on um itself, checking each access, for safe mode,
+* which reports the registers and pc from um when the program faults
+*/
+static __attribute__((noinline)) Run_exit interpret_in_place()
+{
+    return interpret(um.registers, &um.counter, false, false, true);
+}
+
+Run_exit execute_instructions () {
+
+    if (options.trace_path != NULL) {
+        return interpret_traced();
+    }
+
+    // Program start and every load program target are block entries
+    Run_exit exit = run_compiled();
+    if (exit != RUN_RESUME) {
+        return exit;
+    }
+    if (options.asm_core && !counting) {
+        run_asm_core();
+        return RUN_HALT;
+    } else if (options.safe) {
+        return interpret_in_place();
+    } else if ((exit = interpret_pinned()) == RUN_RESUME) {
+        return interpret_checked();
+    }
+    return exit;
+}
+
+Um_status run_for (Um_budget budget) {
+
+    budgeted = true;
+    counting = true;
+    budget_left = budget.instructions != 0 ? budget.instructions :
+                                             UINT64_MAX;
+    deadline = budget.microseconds != 0 ?
+               now_ns() + budget.microseconds * 1000 : 0;
+    clock_checks = BUDGET_CLOCK_CHECKS;
+
+    Run_exit exit = execute_instructions();
+    budgeted = false;
+    counting = stats != NULL;
+    if (exit == RUN_HALT) {
+        UM_PROBE1(halt, um.num_segments - 1 - um.num_unmapped);
+        if (stats != NULL) {
+            stats->halted = true;
+        }
+    }
+    return exit == RUN_HALT ? UM_HALTED : UM_PREEMPTED;
+}
+
+void reset_um (bool release) {
+
+    // Unmap every segment but m[0], all at once when they come from the
+    // pool; the segment table and unmapped stack keep their capacity
+    if (options.pool) {
+        pool_reset(release);
+    } else {
+        for (uint32_t i = 1; i < um.num_segments; i++) {
+            if (um.words[i] != NULL && um.words[i] != safe_trap_words) {
+                free_words(i);
+            }
+            um.words[i] = options.safe ? safe_trap_words : NULL;
+        }
+    }
+    um.num_segments = 1;
+    um.num_unmapped = 0;
+    um.cached_id = NO_SEGMENT;
+    if (stats != NULL) {
+        stats->segments = stats->mapped_bytes = stats->unmapped_ids = 0;
+    }
+    if (options.memory_budget != 0) {
+        memset(um.referenced, 0, um.segment_capacity);
+    }
 
-        // Free the all of the words in each segment
-        Segment segment = Seq_get(um.mapped, i);
-        int num_words = segment->length;
-        if (num_words >= 1) {
-            free(segment->words);
+    // Put the program back in m[0]: in place, as stores into it would, when
+    // it still has the program's length, so the decoded form and blocks of
+    // every word left alone are kept
+    if (um.lengths[0] == program_length) {
+        for (uint32_t i = 0; i < program_length; i++) {
+            if (um.words[0][i] != program[i]) {
+                um.words[0][i] = program[i];
+                invalidate_code(i);
+                if (aot_image != NULL) {
+                    mark_stale(i);
+                }
+            }
         }
+    } else {
+        replace_program(program, program_length);
+    }
 
-        // Free the segment struct itself
-        free(segment);
+    um.counter = 0;
+    memset(um.registers, 0, sizeof(um.registers));
+    interactive = isatty(STDIN_FILENO);
+}
+
+void free_um () {
+
+    // Let the neighbours of this machine in a pipeline finish
+    if (options.output_ring != NULL) {
+        ring_close_writer(options.output_ring);
+    }
+    if (options.input_ring != NULL) {
+        ring_close_reader(options.input_ring);
     }
 
-    // Free struct fields
-    Seq_free(&(um.mapped));
-    Seq_free(&(um.unmapped));
+    // Keep the decoded program for the next run
+    save_program();
+    if (options.cache_dir != NULL) {
+        cache_finish();
+    }
+
+    // Free the words of every segment still mapped, or of m[0] and then
+    // the whole pool
+    for (uint32_t i = 0; i < (options.pool ? 1 : um.num_segments); i++) {
+        if (um.words[i] != NULL && um.words[i] != safe_trap_words) {
+            free_words(i);
+        }
+    }
+    if (options.pool) {
+        pool_finish();
+    }
+    free(program);
+    record_finish();
+    replay_finish();
+    trace_finish();
+    events_finish();
+    stats_finish();
+    stats = NULL;
+    counting = false;
+
+    // Free the decoded program
+    free_code(um.code, um.lengths[0]);
+    if (options.tier_threshold != 0) {
+        tier_finish();
+    }
+    if (options.optimize) {
+        free_blocks(um.lengths[0]);
+    }
+
+    // Free the segment table and unmapped stack
+    if (options.safe) {
+        safe_table_free(um.words);
+    } else {
+        free(um.words);
+    }
+    free(um.lengths);
+    free(um.referenced);
+    free(um.unmapped);
+    if (options.memory_budget != 0) {
+        spill_finish();
+    }
+    if (options.compact) {
+        compact_finish();
+    }
+    if (!options.safe) {
+        watch_finish();
+    }
+    free(aot_stale);
 }
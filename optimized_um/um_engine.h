@@ -17,8 +17,157 @@
 #include <except.h>
 #include <seq.h>
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
 #include "um_util.h"
 
-void run_um (FILE *file);
+/*
+* Um_options struct that selects optional engine behaviour from the driver
+*/
+typedef struct Um_options {
+    // Trap out-of-bounds, unmapped and divide-by-zero faults (see um_safe.h)
+    bool safe;
+
+    // Spill cold segments to disk past this many resident bytes (0: never)
+    size_t memory_budget;
+
+    // Backing file for spilled segments, or NULL for an unlinked temp file
+    const char *spill_path;
+
+    // Compact fragmented segment memory while waiting for input
+    bool compact;
+
+    // Run basic blocks through the optimizing tier (see um_optimize.h)
+    bool optimize;
+
+    // Build a block on a background thread once entered this many times,
+    // interpreting it until then, rather than on first entry (0: first entry)
+    uint32_t tier_threshold;
+
+    // Directory of decoded programs kept across runs (see um_cache.h), or
+    // NULL
+    const char *cache_dir;
+
+    // Count transitions between blocks and store them in the cache, for
+    // laying blocks out in hot path order on later runs (see um_layout.h)
+    bool profile;
+
+    // Run m[0] on the hand-written x86-64 interpreter core (see um_asm.h)
+    bool asm_core;
+
+    // Write each program loaded from another segment to PREFIX.N.um, or NULL
+    const char *dump_prefix;
+
+    // Rings to take input from and send output to in place of stdin and
+    // stdout, or NULL (see um_pipe.h)
+    struct Um_ring *input_ring;
+    struct Um_ring *output_ring;
+
+    // Stop a machine that has not halted after this many milliseconds, as
+    // checked by run_for (0: never)
+    uint32_t time_limit_ms;
+
+    // Allocate segments from one region that reset_um releases at once
+    // (see um_pool.h); ignored in safe mode and with -m or -c
+    bool pool;
+
+    // Record every input to this file, or take every input from such a
+    // recording instead of stdin (see um_replay.h), or NULL
+    const char *record_path;
+    const char *replay_path;
+
+    // Write an execution trace of the run to this file (see um_trace.h),
+    // or NULL
+    const char *trace_path;
+
+    // Write a timeline of segment, load program and I/O events to this
+    // file (see um_events.h), or NULL, recording one map or unmap in
+    // event_sample
+    const char *events_path;
+    uint32_t event_sample;
+
+    // Publish live statistics in this file (see um_stats.h), or NULL.
+    // Programs compiled ahead of time and the assembly core are not used
+    // then, since they do not stop at block entries to count instructions.
+    const char *stats_path;
+
+    // Ahead-of-time compiled programs to run m[0] with when it matches one
+    // (see um_aot.h)
+    const struct Um_aot_image *aot_images;
+    uint32_t num_aot_images;
+} Um_options;
+
+/*
+* run_um
+* Loads the um instruction file and runs it until it halts
+*/
+void run_um (FILE *file, const Um_options *options);
+
+/*
+* load_um, finish_um
+* The two halves of run_um: loading a machine ready to run, and running it
+* to the end. A process can load a machine once and fork a copy of it for
+* every run.
+*/
+void load_um (FILE *file, const Um_options *options);
+void finish_um ();
+
+/*
+* run_loaded
+* Runs a loaded machine until it halts, or until the time limit of its
+* options, reporting where it was stopped
+* Return: whether it halted
+*/
+bool run_loaded ();
+
+/*
+* Um_budget struct, how long run_for may run a machine before it hands
+* control back. Either limit may be 0 for none.
+*/
+typedef struct Um_budget {
+    uint64_t instructions;
+    uint64_t microseconds;
+} Um_budget;
+
+/*
+* What run_for leaves the machine in
+*/
+typedef enum Um_status {
+    UM_HALTED,      // the machine halted
+    UM_PREEMPTED    // the budget ran out; run_for again to resume
+} Um_status;
+
+/*
+* run_for
+* Runs a loaded machine until it halts or its budget runs out. The budget is
+* only checked when control reaches a block entry, at a load program or
+* between optimized blocks, so straight-line code runs unchecked and the
+* machine may overrun it by a block. Programs compiled ahead of time and
+* the assembly core are not used while a budget is set.
+* Arguments:
+*   - budget - the instructions and time the machine may take
+* Return: UM_HALTED, after which free_um frees the machine, or UM_PREEMPTED
+*         with the machine left ready to resume at a block entry
+*/
+Um_status run_for (Um_budget budget);
+
+/*
+* reset_um
+* Returns a loaded machine, halted or not, to the state load_um left it
+* in, so it can run again without being freed and loaded. Its segment table
+* and unmapped stack are kept, and so is its decoded program unless m[0]
+* was changed. Segments are released in one step when they come from the
+* pool, and one at a time otherwise.
+* Arguments:
+*   - release - whether the pool hands its memory back to the operating
+*               system, rather than keeping it for the next run
+*/
+void reset_um (bool release);
+
+/*
+* free_um
+* Frees a machine once it has halted
+*/
+void free_um ();
 
 #endif
@@ -0,0 +1,335 @@
+/*
+*   um_events.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_events. Events go into a ring
+*   that only the machine writes and only the writing thread reads, so each
+*   side moves its own counter with an atomic store and neither ever waits
+*   on the other: the thread wakes every few milliseconds to turn what it
+*   finds into JSON, and an event that finds the ring full is dropped and
+*   counted rather than held up. The number dropped is written in a last
+*   event.
+*
+*   The file is a JSON array of events, the form of the format that viewers
+*   still open when it is cut off before the closing bracket, and the
+*   thread flushes it after each pass; so a run that ends in a fault, which
+*   leaves from a signal handler without finishing the timeline, still
+*   leaves a timeline up to a few milliseconds before the fault.
+*
+*   stdin and stdout are swapped for streams from fopencookie, which glibc
+*   lets a program assign to them, so every refill of the input buffer and
+*   every write of the output buffer passes through here, whichever engine
+*   operation caused it.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "um_events.h"
+
+/*
+* Tuning constants
+*/
+#define RING_EVENTS (1 << 16)
+#define FILE_BUFFER_BYTES (1 << 20)
+
+// Events a map or unmap leaves free in the ring, for the rarer events that
+// mark the phases of a run
+#define RING_RESERVE (RING_EVENTS / 4)
+#define WRITE_INTERVAL_NS 5000000
+
+/*
+* What an event records
+*/
+typedef enum Event_kind {
+    EVENT_MAP,
+    EVENT_UNMAP,
+    EVENT_LOAD_PROGRAM,
+    EVENT_INPUT,
+    EVENT_OUTPUT
+} Event_kind;
+
+/*
+* Event struct, one entry of the ring. Maps and unmaps carry the segments
+* and words live after them; events that last carry their duration.
+*/
+typedef struct Event {
+    uint64_t time;
+    uint64_t duration;
+    uint64_t live_words;
+    uint32_t kind;
+    uint32_t id;
+    uint32_t size;
+    uint32_t live;
+} Event;
+
+static Event ring[RING_EVENTS];
+
+// Events put in by the machine and taken out by the thread, counted from
+// the start; event n of either lives at ring[n % RING_EVENTS]
+static uint64_t ring_head = 0;
+static uint64_t ring_tail = 0;
+static uint64_t dropped = 0;
+static bool stopping = false;
+
+static FILE *file = NULL;
+static pthread_t writer;
+static uint64_t origin;
+static int pid;
+
+// Maps and unmaps until the next one recorded, and the live counts kept
+// over all of them
+static uint32_t sample_every;
+static uint32_t until_sample;
+static uint32_t live_segments;
+static uint64_t live_words;
+
+static FILE *real_stdin;
+static FILE *real_stdout;
+static bool input_is_terminal;
+
+uint64_t events_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec - origin;
+}
+
+/*
+* put_event
+* Adds an event to the ring, or counts it as dropped if the ring has no
+* more than reserve free
+*/
+static void put_event(const Event *event, uint32_t reserve)
+{
+    uint64_t head = ring_head;
+    if (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) >=
+        RING_EVENTS - reserve) {
+        dropped++;
+        return;
+    }
+    ring[head % RING_EVENTS] = *event;
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+* put_span
+* Adds an event that lasted from start until now
+*/
+static void put_span(Event_kind kind, uint64_t start, uint32_t id,
+                     uint32_t size)
+{
+    Event event = { start, events_now() - start, 0, kind, id, size, 0 };
+    put_event(&event, 0);
+}
+
+/*
+* put_segment
+* Counts a segment mapped or unmapped, and adds it to the ring if it is
+* the one in sample_every due
+*/
+static void put_segment(Event_kind kind, uint32_t id, uint32_t words)
+{
+    if (--until_sample != 0) {
+        return;
+    }
+    until_sample = sample_every;
+    Event event = { events_now(), 0, live_words, kind, id, words,
+                    live_segments };
+    put_event(&event, RING_RESERVE);
+}
+
+void events_map(uint32_t id, uint32_t words)
+{
+    live_segments++;
+    live_words += words;
+    put_segment(EVENT_MAP, id, words);
+}
+
+void events_unmap(uint32_t id, uint32_t words)
+{
+    live_segments--;
+    live_words -= words;
+    put_segment(EVENT_UNMAP, id, words);
+}
+
+void events_load_program(uint64_t start, uint32_t id, uint32_t words)
+{
+    put_span(EVENT_LOAD_PROGRAM, start, id, words);
+}
+
+/*
+* write_time
+* Writes a time of the timeline in microseconds, the unit of the format
+*/
+static void write_time(const char *name, uint64_t ns)
+{
+    fprintf(file, ",\"%s\":%" PRIu64 ".%03" PRIu64, name, ns / 1000,
+            ns % 1000);
+}
+
+/*
+* write_event
+* Writes an event as one or two trace events
+*/
+static void write_event(const Event *event)
+{
+    static const char *const names[] = {
+        "map", "unmap", "load program", "input wait", "output flush"
+    };
+    static const char *const categories[] = {
+        "segment", "segment", "program", "io", "io"
+    };
+    bool span = event->kind >= EVENT_LOAD_PROGRAM;
+    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\"",
+            names[event->kind], categories[event->kind],
+            span ? "X" : "i\",\"s\":\"t");
+    write_time("ts", event->time);
+    if (span) {
+        write_time("dur", event->duration);
+    }
+    fprintf(file, ",\"pid\":%d,\"tid\":%d,\"args\":{", pid, pid);
+    if (event->kind == EVENT_INPUT || event->kind == EVENT_OUTPUT) {
+        fprintf(file, "\"bytes\":%" PRIu32 "}}", event->size);
+        return;
+    }
+    fprintf(file, "\"segment\":%" PRIu32 ",\"words\":%" PRIu32 "}}",
+            event->id, event->size);
+    if (!span) {
+        fprintf(file, ",\n{\"name\":\"live segments\",\"ph\":\"C\"");
+        write_time("ts", event->time);
+        fprintf(file, ",\"pid\":%d,\"args\":{\"segments\":%" PRIu32
+                      ",\"words\":%" PRIu64 "}}", pid, event->live,
+                event->live_words);
+    }
+}
+
+/*
+* write_events
+* Body of the writing thread: writes out the events in the ring every few
+* milliseconds until the timeline is finished
+*/
+static void *write_events(void *unused)
+{
+    (void) unused;
+    struct timespec interval = { 0, WRITE_INTERVAL_NS };
+    while (true) {
+        // Every event put in before stopping was set is in the ring by now
+        bool stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+        for (uint64_t tail = ring_tail; tail != head; tail++) {
+            write_event(&ring[tail % RING_EVENTS]);
+        }
+        __atomic_store_n(&ring_tail, head, __ATOMIC_RELEASE);
+        fflush(file);
+        if (stop) {
+            return NULL;
+        }
+        nanosleep(&interval, NULL);
+    }
+}
+
+/*
+* read_input
+* Refills the buffer of stdin from its descriptor, recording how long the
+* machine waited. As glibc does for a terminal, output is flushed first,
+* so a prompt shows before the wait.
+*/
+static ssize_t read_input(void *cookie, char *buffer, size_t size)
+{
+    (void) cookie;
+    if (input_is_terminal) {
+        fflush(stdout);
+    }
+    uint64_t start = events_now();
+    ssize_t got;
+    do {
+        got = read(STDIN_FILENO, buffer, size);
+    } while (got < 0 && errno == EINTR);
+    put_span(EVENT_INPUT, start, 0, got > 0 ? got : 0);
+    return got;
+}
+
+/*
+* write_output
+* Writes out the buffer of stdout to its descriptor, recording how long
+* it took
+*/
+static ssize_t write_output(void *cookie, const char *buffer, size_t size)
+{
+    (void) cookie;
+    uint64_t start = events_now();
+    size_t done = 0;
+    while (done < size) {
+        ssize_t wrote = write(STDOUT_FILENO, buffer + done, size - done);
+        if (wrote < 0 && errno != EINTR) {
+            break;
+        }
+        done += wrote > 0 ? wrote : 0;
+    }
+    put_span(EVENT_OUTPUT, start, 0, done);
+    return done == size ? (ssize_t) size : -1;
+}
+
+void events_start(const char *path, uint32_t sample)
+{
+    file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "um: could not create the timeline %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(file, NULL, _IOFBF, FILE_BUFFER_BYTES);
+    origin = 0;
+    origin = events_now();
+    pid = getpid();
+    sample_every = until_sample = sample;
+    fprintf(file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                  "\"args\":{\"name\":\"um\"}}", pid);
+
+    // Time the streams' reads and writes, buffered as the real ones are
+    fflush(stdout);
+    real_stdin = stdin;
+    real_stdout = stdout;
+    input_is_terminal = isatty(STDIN_FILENO);
+    cookie_io_functions_t input = { .read = read_input };
+    cookie_io_functions_t output = { .write = write_output };
+    stdin = fopencookie(NULL, "r", input);
+    stdout = fopencookie(NULL, "w", output);
+    assert(stdin != NULL && stdout != NULL);
+    setvbuf(stdout, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, BUFSIZ);
+
+    int status = pthread_create(&writer, NULL, write_events, NULL);
+    assert(status == 0);
+    (void) status;
+    atexit(events_finish);
+}
+
+void events_finish()
+{
+    if (file == NULL) {
+        return;
+    }
+
+    // The last flush is part of the timeline
+    fflush(stdout);
+    fclose(stdout);
+    fclose(stdin);
+    stdout = real_stdout;
+    stdin = real_stdin;
+
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+    fprintf(file, ",\n{\"name\":\"timeline end\",\"ph\":\"i\",\"s\":\"g\"");
+    write_time("ts", events_now());
+    fprintf(file, ",\"pid\":%d,\"tid\":%d,\"args\":{\"maps and unmaps "
+                  "recorded\":\"1 in %" PRIu32 "\",\"events dropped\":%"
+                  PRIu64 "}}\n]\n", pid, pid, sample_every, dropped);
+    fclose(file);
+    file = NULL;
+}
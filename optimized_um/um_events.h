@@ -0,0 +1,73 @@
+/*
+*   um_events.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_events, which records a
+*   timeline of what a run does besides compute: segments mapped and
+*   unmapped, with their sizes and the segments and words left live after
+*   each; programs loaded from other segments; time spent waiting on input;
+*   and output written out. The timeline is written in the Chrome trace
+*   event format, which chrome://tracing and the Perfetto UI both open, so
+*   the phases of a run show up as changes in the rate and kind of events.
+*
+*   Maps and unmaps can come millions of times a second, so only one in
+*   every so many is recorded; the counts of live segments and words stay
+*   exact. Input waits and output flushes are recorded from the streams
+*   themselves: with a timeline on, stdin and stdout are replaced by
+*   streams over the same descriptors whose reads and writes are timed.
+*/
+
+#ifndef UM_EVENTS_INCLUDED
+#define UM_EVENTS_INCLUDED
+
+#include <inttypes.h>
+
+/*
+* events_start
+* Starts a timeline of a run, and the thread that writes it out
+* Arguments:
+*   - path - the file to write; any file there is replaced
+*   - sample - record one map or unmap in sample
+* Return: void
+*/
+void events_start(const char *path, uint32_t sample);
+
+/*
+* events_now
+* Return: the time in nanoseconds on the clock of the timeline, for
+*         starting an event that lasts
+*/
+uint64_t events_now();
+
+/*
+* events_map, events_unmap
+* Count a segment mapped or unmapped
+* Arguments:
+*   - id - the segment
+*   - words - its length
+* Return: void
+*/
+void events_map(uint32_t id, uint32_t words);
+void events_unmap(uint32_t id, uint32_t words);
+
+/*
+* events_load_program
+* Records a program loaded from another segment
+* Arguments:
+*   - start - the time it started, from events_now
+*   - id - the segment loaded
+*   - words - its length
+* Return: void
+*/
+void events_load_program(uint64_t start, uint32_t id, uint32_t words);
+
+/*
+* events_finish
+* Writes out the rest of the timeline and puts stdin and stdout back. It
+* runs at exit as well, for runs that exit before freeing the machine.
+* Arguments: None
+* Return: void
+*/
+void events_finish();
+
+#endif
@@ -0,0 +1,603 @@
+/*
+*   um_lanes.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_lanes. The lanes sharing m[0]
+*   run as a group: the lanes at the lowest pc among them step together,
+*   one instruction for the whole group, until a load program sends them
+*   to their own pcs or the group reaches the pc of the next lane waiting,
+*   when the group is formed again. Vector operations cover every lane and
+*   keep the result only in the lanes of the group; segment access, map,
+*   unmap and I/O go lane by lane, each on the lane's own segments.
+*
+*   A lane leaves for good when it stores a new value into m[0] or loads a
+*   program the others do not, taking a copy of its m[0], and runs alone
+*   to the end. When every lane still sharing m[0] loads identical programs
+*   at once, as an unpacking image does, the new program is shared instead.
+*
+*   The vectors are GCC vector extensions, so they become AVX2 or AVX-512
+*   instructions when the build enables them (-march=native) and SSE2 pairs
+*   otherwise.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <assert.h>
+#include "um_util.h"
+#include "um_lanes.h"
+
+#define LANE_SEGMENT_HINT 64
+
+/*
+* One uint32_t per lane
+*/
+typedef uint32_t Lane_vec
+        __attribute__((vector_size(MAX_LANES * sizeof(uint32_t))));
+
+/*
+* Lane struct that holds everything of one machine but its registers
+*/
+typedef struct Lane {
+    uint32_t counter;
+    bool halted;
+
+    // m[0] is the lane's own, and the lane runs alone
+    bool alone;
+
+    // Segment table; words[0] is the shared m[0] unless alone
+    uint32_t **words;
+    uint32_t *lengths;
+    uint32_t num_segments;
+    uint32_t segment_capacity;
+
+    // Stack of unmapped ids available for reuse
+    uint32_t *unmapped;
+    uint32_t num_unmapped;
+    uint32_t unmapped_capacity;
+
+    FILE *input;
+    FILE *output;
+} Lane;
+
+// The registers of every lane, one vector per UM register
+static Lane_vec registers[NUM_REGISTERS];
+
+static Lane lanes[MAX_LANES];
+static unsigned num_lanes = 0;
+
+// The m[0] the lanes that are not alone share
+static uint32_t *code = NULL;
+static uint32_t code_length = 0;
+
+/*
+* Instruction fields
+*/
+#define OPCODE(word) ((word) >> 28)
+#define RA(word) (((word) >> 6) & 0x7)
+#define RB(word) (((word) >> 3) & 0x7)
+#define RC(word) ((word) & 0x7)
+#define LV_RA(word) (((word) >> 25) & 0x7)
+#define LV_VALUE(word) ((word) & 0x1ffffff)
+
+/*
+* Loop over the lanes of the group in
+*/
+#define FOR_GROUP(in, i) \
+    for (unsigned i = 0; i < num_lanes; i++) if (in[i] != 0)
+
+/*
+* The vector new in the lanes of the group in, and old in the others
+*/
+#define BLEND(in, new, old) (((new) & (in)) | ((old) & ~(in)))
+
+static uint32_t *copy_words(const uint32_t *words, uint32_t length)
+{
+    uint32_t *copy = malloc((length == 0 ? 1 : length) * sizeof(*copy));
+    assert(copy != NULL);
+    memcpy(copy, words, length * sizeof(*copy));
+    return copy;
+}
+
+/*
+* lane_map
+* Maps a new zeroed segment of length words for a lane
+* Return: its id
+*/
+static uint32_t lane_map(Lane *lane, uint32_t length)
+{
+    uint32_t id;
+    if (lane->num_unmapped > 0) {
+        id = lane->unmapped[--lane->num_unmapped];
+    } else {
+        if (lane->num_segments == lane->segment_capacity) {
+            lane->segment_capacity *= 2;
+            lane->words = realloc(lane->words, lane->segment_capacity *
+                                               sizeof(*lane->words));
+            lane->lengths = realloc(lane->lengths, lane->segment_capacity *
+                                                   sizeof(*lane->lengths));
+            assert(lane->words != NULL && lane->lengths != NULL);
+        }
+        id = lane->num_segments++;
+    }
+    lane->words[id] = calloc(length == 0 ? 1 : length, sizeof(uint32_t));
+    assert(lane->words[id] != NULL);
+    lane->lengths[id] = length;
+    return id;
+}
+
+static void lane_unmap(Lane *lane, uint32_t id)
+{
+    free(lane->words[id]);
+    lane->words[id] = NULL;
+    if (lane->num_unmapped == lane->unmapped_capacity) {
+        lane->unmapped_capacity *= 2;
+        lane->unmapped = realloc(lane->unmapped, lane->unmapped_capacity *
+                                                 sizeof(*lane->unmapped));
+        assert(lane->unmapped != NULL);
+    }
+    lane->unmapped[lane->num_unmapped++] = id;
+}
+
+static inline uint32_t lane_input(Lane *lane)
+{
+    int input = getc(lane->input);
+    return input == EOF ? UINT32_MAX : (uint32_t) input;
+}
+
+/*
+* lane_load
+* Replaces the m[0] of a lane with a copy of segment id, leaving the group
+* for good
+*/
+static void lane_load(Lane *lane, uint32_t id)
+{
+    if (lane->alone) {
+        free(lane->words[0]);
+    }
+    lane->words[0] = copy_words(lane->words[id], lane->lengths[id]);
+    lane->lengths[0] = lane->lengths[id];
+    lane->alone = true;
+}
+
+/*
+* run_alone
+* Runs a lane with an m[0] of its own until it halts
+*/
+static void run_alone(unsigned i)
+{
+    Lane *lane = &lanes[i];
+    uint32_t r[NUM_REGISTERS];
+    for (unsigned k = 0; k < NUM_REGISTERS; k++) {
+        r[k] = registers[k][i];
+    }
+    uint32_t pc = lane->counter;
+
+    while (true) {
+        uint32_t word = lane->words[0][pc++];
+        switch (OPCODE(word)) {
+          case CMOV:
+              if (r[RC(word)] != 0) {
+                  r[RA(word)] = r[RB(word)];
+              }
+              break;
+          case SLOAD:
+              r[RA(word)] = lane->words[r[RB(word)]][r[RC(word)]];
+              break;
+          case SSTORE:
+              lane->words[r[RA(word)]][r[RB(word)]] = r[RC(word)];
+              break;
+          case ADD:
+              r[RA(word)] = r[RB(word)] + r[RC(word)];
+              break;
+          case MUL:
+              r[RA(word)] = r[RB(word)] * r[RC(word)];
+              break;
+          case DIV:
+              r[RA(word)] = r[RB(word)] / r[RC(word)];
+              break;
+          case NAND:
+              r[RA(word)] = ~(r[RB(word)] & r[RC(word)]);
+              break;
+          case HALT:
+              lane->halted = true;
+              return;
+          case ACTIVATE:
+              r[RB(word)] = lane_map(lane, r[RC(word)]);
+              break;
+          case INACTIVATE:
+              lane_unmap(lane, r[RC(word)]);
+              break;
+          case OUT:
+              putc(r[RC(word)], lane->output);
+              break;
+          case IN:
+              r[RC(word)] = lane_input(lane);
+              break;
+          case LOADP:
+              if (r[RB(word)] != 0) {
+                  lane_load(lane, r[RB(word)]);
+              }
+              pc = r[RC(word)];
+              break;
+          case LV:
+              r[LV_RA(word)] = LV_VALUE(word);
+              break;
+          default:
+              break;
+        }
+    }
+}
+
+/*
+* load_programs
+* Carries out a load program of segment rb by the lanes of a group, which
+* share the new m[0] if all of them load the same program and no other lane
+* still shares the old one
+*/
+static void load_programs(const Lane_vec *group, Um_register rb)
+{
+    Lane_vec in = *group;
+    bool shared = true;
+    int first = -1;
+    for (unsigned i = 0; i < num_lanes && shared; i++) {
+        Lane *lane = &lanes[i];
+        if (in[i] == 0) {
+            shared = lane->halted || lane->alone;
+            continue;
+        }
+        uint32_t id = registers[rb][i];
+        if (id == 0) {
+            shared = false;
+        } else if (first < 0) {
+            first = i;
+        } else {
+            Lane *other = &lanes[first];
+            uint32_t other_id = registers[rb][first];
+            shared = lane->lengths[id] == other->lengths[other_id] &&
+                     memcmp(lane->words[id], other->words[other_id],
+                            lane->lengths[id] * sizeof(uint32_t)) == 0;
+        }
+    }
+
+    if (shared) {
+        Lane *lane = &lanes[first];
+        uint32_t id = registers[rb][first];
+        free(code);
+        code = copy_words(lane->words[id], lane->lengths[id]);
+        code_length = lane->lengths[id];
+        FOR_GROUP(in, i) {
+            lanes[i].words[0] = code;
+            lanes[i].lengths[0] = code_length;
+        }
+        return;
+    }
+    FOR_GROUP(in, i) {
+        if (registers[rb][i] != 0) {
+            lane_load(&lanes[i], registers[rb][i]);
+        }
+    }
+}
+
+/*
+* store_shared
+* Carries out a store by the lanes of a group into the m[0] they share, if
+* every one of them stores the same word at the same index of it
+* Return: whether it did
+*/
+static bool store_shared(const Lane_vec *group, Um_register ra,
+                         Um_register rb, Um_register rc)
+{
+    Lane_vec in = *group;
+    int first = -1;
+    FOR_GROUP(in, i) {
+        if (registers[ra][i] != 0) {
+            return false;
+        }
+        if (first < 0) {
+            first = i;
+        } else if (registers[rb][i] != registers[rb][first] ||
+                   registers[rc][i] != registers[rc][first]) {
+            return false;
+        }
+    }
+    code[registers[rb][first]] = registers[rc][first];
+    return true;
+}
+
+/*
+* jump_together
+* Returns whether every lane of a group loads the same pc of m[0], and
+* which
+*/
+static bool jump_together(const Lane_vec *group, Um_register rb,
+                          Um_register rc, uint32_t *target)
+{
+    Lane_vec in = *group;
+    int first = -1;
+    FOR_GROUP(in, i) {
+        if (registers[rb][i] != 0) {
+            return false;
+        }
+        if (first < 0) {
+            first = i;
+        } else if (registers[rc][i] != registers[rc][first]) {
+            return false;
+        }
+    }
+    *target = registers[rc][first];
+    return true;
+}
+
+/*
+* run_group
+* Runs the group of lanes in, all at pc, until they load a program, halt
+* or reach next, the lowest pc of the other lanes sharing m[0]
+*/
+static void run_group(const Lane_vec *group, uint32_t pc, uint32_t next)
+{
+    Lane_vec in = *group;
+    unsigned size = 0;
+    FOR_GROUP(in, i) {
+        size++;
+    }
+
+    // No lane outside the group shares m[0], so the group may change it
+    bool whole = next == UINT32_MAX;
+
+    while (true) {
+        uint32_t word = code[pc];
+        Um_register a = RA(word), b = RB(word), c = RC(word);
+
+        switch (OPCODE(word)) {
+          case CMOV:
+              registers[a] = BLEND(in & (Lane_vec) (registers[c] != 0),
+                                   registers[b], registers[a]);
+              break;
+          case SLOAD:
+              FOR_GROUP(in, i) {
+                  registers[a][i] =
+                      lanes[i].words[registers[b][i]][registers[c][i]];
+              }
+              break;
+          case SSTORE:
+              if (whole && store_shared(&in, a, b, c)) {
+                  break;
+              }
+              FOR_GROUP(in, i) {
+                  uint32_t id = registers[a][i];
+                  uint32_t index = registers[b][i];
+                  uint32_t value = registers[c][i];
+
+                  // A new value in m[0] takes the lane out of the group
+                  if (id == 0 && code[index] != value) {
+                      Lane *lane = &lanes[i];
+                      lane->words[0] = copy_words(code, code_length);
+                      lane->alone = true;
+                      lane->counter = pc + 1;
+                      in[i] = 0;
+                      size--;
+                  }
+                  lanes[i].words[id][index] = value;
+              }
+              if (size == 0) {
+                  return;
+              }
+              break;
+          case ADD:
+              registers[a] = BLEND(in, registers[b] + registers[c],
+                                   registers[a]);
+              break;
+          case MUL:
+              registers[a] = BLEND(in, registers[b] * registers[c],
+                                   registers[a]);
+              break;
+          case DIV:
+              FOR_GROUP(in, i) {
+                  registers[a][i] = registers[b][i] / registers[c][i];
+              }
+              break;
+          case NAND:
+              registers[a] = BLEND(in, ~(registers[b] & registers[c]),
+                                   registers[a]);
+              break;
+          case HALT:
+              FOR_GROUP(in, i) {
+                  lanes[i].halted = true;
+              }
+              return;
+          case ACTIVATE:
+              FOR_GROUP(in, i) {
+                  registers[b][i] = lane_map(&lanes[i], registers[c][i]);
+              }
+              break;
+          case INACTIVATE:
+              FOR_GROUP(in, i) {
+                  lane_unmap(&lanes[i], registers[c][i]);
+              }
+              break;
+          case OUT:
+              FOR_GROUP(in, i) {
+                  putc(registers[c][i], lanes[i].output);
+              }
+              break;
+          case IN:
+              FOR_GROUP(in, i) {
+                  registers[c][i] = lane_input(&lanes[i]);
+              }
+              break;
+          case LOADP:
+              // The group stays together while it is still the lowest
+              if (jump_together(&in, b, c, &pc) && pc < next) {
+                  continue;
+              }
+              FOR_GROUP(in, i) {
+                  lanes[i].counter = registers[c][i];
+              }
+              FOR_GROUP(in, i) {
+                  if (registers[b][i] != 0) {
+                      load_programs(&in, b);
+                      break;
+                  }
+              }
+              return;
+          case LV:
+              registers[LV_RA(word)] = BLEND(in, (Lane_vec) {0} +
+                                                 LV_VALUE(word),
+                                             registers[LV_RA(word)]);
+              break;
+          default:
+              break;
+        }
+
+        // The lanes waiting at the next pc join the group
+        if (++pc == next) {
+            FOR_GROUP(in, i) {
+                lanes[i].counter = pc;
+            }
+            return;
+        }
+    }
+}
+
+/*
+* run_lockstep
+* Runs every lane until all have halted
+*/
+static void run_lockstep()
+{
+    while (true) {
+        // Lanes with an m[0] of their own run by themselves
+        for (unsigned i = 0; i < num_lanes; i++) {
+            if (!lanes[i].halted && lanes[i].alone) {
+                run_alone(i);
+            }
+        }
+
+        // The group is the lanes sharing m[0] at the lowest pc
+        uint32_t pc = UINT32_MAX;
+        for (unsigned i = 0; i < num_lanes; i++) {
+            if (!lanes[i].halted && lanes[i].counter < pc) {
+                pc = lanes[i].counter;
+            }
+        }
+        uint32_t next = UINT32_MAX;
+        Lane_vec in = { 0 };
+        bool running = false;
+        for (unsigned i = 0; i < num_lanes; i++) {
+            if (lanes[i].halted) {
+                continue;
+            }
+            running = true;
+            if (lanes[i].counter == pc) {
+                in[i] = UINT32_MAX;
+            } else if (lanes[i].counter < next) {
+                next = lanes[i].counter;
+            }
+        }
+        if (!running) {
+            return;
+        }
+        run_group(&in, pc, next);
+    }
+}
+
+/*
+* read_code
+* Reads the big-endian words of a um instruction file into the shared m[0]
+*/
+static void read_code(FILE *fp)
+{
+    uint32_t capacity = 1024;
+    code = malloc(capacity * sizeof(*code));
+    assert(code != NULL);
+    code_length = 0;
+
+    unsigned char bytes[4];
+    while (fread(bytes, 1, sizeof(bytes), fp) == sizeof(bytes)) {
+        if (code_length == capacity) {
+            capacity *= 2;
+            code = realloc(code, capacity * sizeof(*code));
+            assert(code != NULL);
+        }
+        code[code_length++] = (uint32_t) bytes[0] << 24 |
+                              (uint32_t) bytes[1] << 16 |
+                              (uint32_t) bytes[2] << 8 | bytes[3];
+    }
+}
+
+/*
+* open_lanes
+* Starts a lane for each input file PREFIX.N there is, from N = 0
+*/
+static void open_lanes(const char *prefix)
+{
+    size_t size = strlen(prefix) + 16;
+    char *path = malloc(size);
+    assert(path != NULL);
+
+    for (num_lanes = 0; num_lanes < MAX_LANES; num_lanes++) {
+        snprintf(path, size, "%s.%u", prefix, num_lanes);
+        FILE *input = fopen(path, "r");
+        if (input == NULL) {
+            break;
+        }
+        snprintf(path, size, "%s.%u.out", prefix, num_lanes);
+        FILE *output = fopen(path, "w");
+        if (output == NULL) {
+            fprintf(stderr, "Cannot write %s.\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        Lane *lane = &lanes[num_lanes];
+        memset(lane, 0, sizeof(*lane));
+        lane->input = input;
+        lane->output = output;
+        lane->segment_capacity = LANE_SEGMENT_HINT;
+        lane->words = malloc(LANE_SEGMENT_HINT * sizeof(*lane->words));
+        lane->lengths = malloc(LANE_SEGMENT_HINT * sizeof(*lane->lengths));
+        lane->unmapped_capacity = LANE_SEGMENT_HINT;
+        lane->unmapped = malloc(LANE_SEGMENT_HINT *
+                                sizeof(*lane->unmapped));
+        assert(lane->words != NULL && lane->lengths != NULL &&
+               lane->unmapped != NULL);
+        lane->words[0] = code;
+        lane->lengths[0] = code_length;
+        lane->num_segments = 1;
+    }
+    free(path);
+
+    if (num_lanes == 0) {
+        fprintf(stderr, "No input file %s.0 to run a lane on.\n", prefix);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void close_lanes()
+{
+    for (unsigned i = 0; i < num_lanes; i++) {
+        Lane *lane = &lanes[i];
+        fclose(lane->input);
+        fclose(lane->output);
+        for (uint32_t id = lane->alone ? 0 : 1; id < lane->num_segments;
+             id++) {
+            free(lane->words[id]);
+        }
+        free(lane->words);
+        free(lane->lengths);
+        free(lane->unmapped);
+    }
+    free(code);
+    code = NULL;
+}
+
+void run_lanes(FILE *fp, const char *prefix)
+{
+    read_code(fp);
+    open_lanes(prefix);
+    memset(registers, 0, sizeof(registers));
+
+    run_lockstep();
+    close_lanes();
+}
@@ -0,0 +1,37 @@
+/*
+*   um_lanes.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_lanes, which runs up to
+*   MAX_LANES machines of the same program in lockstep, each with its own
+*   input, output, registers and segments. The register files are kept one
+*   vector per UM register, one lane per machine, so that while the lanes
+*   share a pc the arithmetic, NAND, load value and conditional move
+*   instructions run once for all of them. Lanes that load different pcs
+*   wait for the others to reach theirs, always running the lowest pc first
+*   so that lanes join up again, and a lane whose m[0] stops matching the
+*   others' runs on its own to the end.
+*/
+
+#ifndef UM_LANES_INCLUDED
+#define UM_LANES_INCLUDED
+
+#include <stdio.h>
+
+/*
+* The most machines run in lockstep
+*/
+#define MAX_LANES 16
+
+/*
+* run_lanes
+* Runs one machine of a program per input file PREFIX.0, PREFIX.1, ...,
+* writing the output of each to PREFIX.N.out
+* Arguments:
+*   - fp - the um instruction file
+*   - prefix - the prefix of the input files; PREFIX.0 must exist
+* Return: void
+*/
+void run_lanes(FILE *fp, const char *prefix);
+
+#endif
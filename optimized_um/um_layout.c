@@ -0,0 +1,239 @@
+/*
+*   um_layout.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_layout. Transitions are
+*   counted in an open-addressed hash table keyed by the (from, to) pair.
+*   Layout follows Pettis and Hansen: every block starts as a chain of its
+*   own, and edges are taken heaviest first, joining the chain that ends
+*   with the edge's source to the chain that starts with its target. Chains
+*   are then placed by how often their blocks were entered.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "um_layout.h"
+
+#define NO_PC UINT32_MAX
+
+static Um_edge *table = NULL;
+static uint32_t table_capacity = 0;
+static uint32_t table_size = 0;
+
+// The table compacted into a list by layout_edges
+static Um_edge *list = NULL;
+
+static inline uint32_t slot(uint32_t from, uint32_t to)
+{
+    uint64_t key = (uint64_t) from << 32 | to;
+    key *= 0x9e3779b97f4a7c15;
+    return (uint32_t) (key >> 32) & (table_capacity - 1);
+}
+
+/*
+* grow
+* Doubles the hash table, rehashing every edge into it
+*/
+static void grow()
+{
+    Um_edge *old = table;
+    uint32_t old_capacity = table_capacity;
+    table_capacity = old_capacity == 0 ? 1024 : old_capacity * 2;
+    table = calloc(table_capacity, sizeof(*table));
+    assert(table != NULL);
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old[i].count == 0) {
+            continue;
+        }
+        uint32_t s = slot(old[i].from, old[i].to);
+        while (table[s].count != 0) {
+            s = (s + 1) & (table_capacity - 1);
+        }
+        table[s] = old[i];
+    }
+    free(old);
+}
+
+void layout_count(uint32_t from, uint32_t to)
+{
+    if (2 * (table_size + 1) > table_capacity) {
+        grow();
+    }
+    uint32_t s = slot(from, to);
+    while (table[s].count != 0 &&
+           (table[s].from != from || table[s].to != to)) {
+        s = (s + 1) & (table_capacity - 1);
+    }
+    if (table[s].count == 0) {
+        table[s].from = from;
+        table[s].to = to;
+        table_size++;
+    }
+    table[s].count++;
+}
+
+const Um_edge *layout_edges(uint32_t *num_edges)
+{
+    free(list);
+    list = malloc((table_size + 1) * sizeof(*list));
+    assert(list != NULL);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < table_capacity; i++) {
+        if (table[i].count != 0) {
+            list[n++] = table[i];
+        }
+    }
+    *num_edges = n;
+    return list;
+}
+
+void layout_reset()
+{
+    free(table);
+    free(list);
+    table = NULL;
+    list = NULL;
+    table_capacity = 0;
+    table_size = 0;
+}
+
+static int heavier(const void *a, const void *b)
+{
+    const Um_edge *x = a, *y = b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    if (x->from != y->from) {
+        return x->from < y->from ? -1 : 1;
+    }
+    return x->to < y->to ? -1 : x->to > y->to;
+}
+
+static int by_pc(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+* block_id
+* Returns the index of pc in the sorted list of distinct block pcs
+*/
+static inline uint32_t block_id(const uint32_t *pcs, uint32_t num_pcs,
+                                uint32_t pc)
+{
+    const uint32_t *found = bsearch(&pc, pcs, num_pcs, sizeof(*pcs), by_pc);
+    assert(found != NULL);
+    return found - pcs;
+}
+
+/*
+* Chain struct that represents a run of blocks to be laid out in a row,
+* by its first block, and how often its blocks were entered in all
+*/
+typedef struct Chain {
+    uint32_t head;
+    uint64_t weight;
+} Chain;
+
+static int hotter(const void *a, const void *b)
+{
+    const Chain *x = a, *y = b;
+    if (x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    return x->head < y->head ? -1 : x->head > y->head;
+}
+
+uint32_t *layout_order(const Um_edge *edges, uint32_t num_edges,
+                       uint32_t length, uint32_t *num_blocks)
+{
+    // The usable edges, heaviest first, and the distinct blocks they name
+    Um_edge *sorted = malloc((num_edges + 1) * sizeof(*sorted));
+    uint32_t *pcs = malloc((2 * (size_t) num_edges + 1) * sizeof(*pcs));
+    assert(sorted != NULL && pcs != NULL);
+    uint32_t n = 0, m = 0;
+    for (uint32_t i = 0; i < num_edges; i++) {
+        if (edges[i].from < length && edges[i].to < length) {
+            sorted[n++] = edges[i];
+            pcs[m++] = edges[i].from;
+            pcs[m++] = edges[i].to;
+        }
+    }
+    qsort(sorted, n, sizeof(*sorted), heavier);
+    qsort(pcs, m, sizeof(*pcs), by_pc);
+    uint32_t num_pcs = 0;
+    for (uint32_t i = 0; i < m; i++) {
+        if (num_pcs == 0 || pcs[num_pcs - 1] != pcs[i]) {
+            pcs[num_pcs++] = pcs[i];
+        }
+    }
+
+    // Per block: the next block of its chain, whether one precedes it, how
+    // often it was entered, and for chain ends, the other end
+    uint32_t *next = malloc((num_pcs + 1) * sizeof(*next));
+    bool *has_prev = calloc(num_pcs + 1, sizeof(*has_prev));
+    uint64_t *weight = calloc(num_pcs + 1, sizeof(*weight));
+    uint32_t *other_end = malloc((num_pcs + 1) * sizeof(*other_end));
+    assert(next != NULL && has_prev != NULL && weight != NULL &&
+           other_end != NULL);
+    for (uint32_t id = 0; id < num_pcs; id++) {
+        next[id] = NO_PC;
+        other_end[id] = id;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t from = block_id(pcs, num_pcs, sorted[i].from);
+        uint32_t to = block_id(pcs, num_pcs, sorted[i].to);
+        weight[to] += sorted[i].count;
+
+        // Join only a chain's last block to another chain's first
+        if (next[from] != NO_PC || has_prev[to] || other_end[from] == to) {
+            continue;
+        }
+        uint32_t first = other_end[from];
+        uint32_t last = other_end[to];
+        next[from] = to;
+        has_prev[to] = true;
+        other_end[first] = last;
+        other_end[last] = first;
+    }
+
+    Chain *chains = malloc((num_pcs + 1) * sizeof(*chains));
+    assert(chains != NULL);
+    uint32_t num_chains = 0;
+    for (uint32_t id = 0; id < num_pcs; id++) {
+        if (has_prev[id]) {
+            continue;
+        }
+        Chain *chain = &chains[num_chains++];
+        chain->head = id;
+        chain->weight = 0;
+        for (uint32_t b = id; b != NO_PC; b = next[b]) {
+            chain->weight += weight[b];
+        }
+    }
+    qsort(chains, num_chains, sizeof(*chains), hotter);
+
+    uint32_t *order = malloc((num_pcs + 1) * sizeof(*order));
+    assert(order != NULL);
+    uint32_t num_ordered = 0;
+    for (uint32_t c = 0; c < num_chains; c++) {
+        for (uint32_t b = chains[c].head; b != NO_PC; b = next[b]) {
+            order[num_ordered++] = pcs[b];
+        }
+    }
+    assert(num_ordered == num_pcs);
+
+    free(sorted);
+    free(pcs);
+    free(next);
+    free(has_prev);
+    free(weight);
+    free(other_end);
+    free(chains);
+    *num_blocks = num_ordered;
+    return order;
+}
@@ -0,0 +1,69 @@
+/*
+*   um_layout.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_layout, which profiles how
+*   often control passes from one optimized block of m[0] to the next in a
+*   training run, and turns such a profile into an order to lay the blocks
+*   out in memory: hot blocks first, each followed where possible by the
+*   block it most often passes control to. Blocks keep their pcs; only
+*   where their ops live changes.
+*/
+
+#ifndef UM_LAYOUT_INCLUDED
+#define UM_LAYOUT_INCLUDED
+
+#include <inttypes.h>
+
+/*
+* Um_edge struct that represents how many times control passed from the
+* block entered at from to the block entered at to
+*/
+typedef struct Um_edge {
+    uint32_t from;
+    uint32_t to;
+    uint64_t count;
+} Um_edge;
+
+/*
+* layout_count
+* Counts a transition between two block entries of the current m[0]
+* Arguments:
+*   - from, to - the pcs of the blocks
+* Return: void
+*/
+void layout_count(uint32_t from, uint32_t to);
+
+/*
+* layout_edges
+* Returns the transitions counted since the last layout_reset
+* Arguments:
+*   - num_edges - set to the number of edges
+* Return: the edges, owned by um_layout until the next layout_reset
+*/
+const Um_edge *layout_edges(uint32_t *num_edges);
+
+/*
+* layout_reset
+* Forgets every counted transition, since m[0] was replaced
+* Arguments: None
+* Return: void
+*/
+void layout_reset();
+
+/*
+* layout_order
+* Orders the blocks of a profile for layout. Blocks are chained greedily
+* along the heaviest edges, so that a block is followed by its hottest
+* successor, and chains are placed hottest first.
+* Arguments:
+*   - edges, num_edges - the profile; edges naming pcs at or past length
+*                        are ignored
+*   - length - the number of words in m[0]
+*   - num_blocks - set to the number of blocks ordered
+* Return: the newly malloc'd pcs of the blocks, in layout order
+*/
+uint32_t *layout_order(const Um_edge *edges, uint32_t num_edges,
+                       uint32_t length, uint32_t *num_blocks);
+
+#endif
@@ -0,0 +1,771 @@
+/*
+*   um_loop.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_loop. A block is recognized by
+*   running its ops once symbolically, giving every register at every point
+*   a value in terms of the registers at the start of an iteration. Values
+*   that are sums of registers and a constant are kept as Sums; those are
+*   what addresses, steps and counters must reduce to. A register whose
+*   value at the end of the block is itself plus an invariant Sum is an
+*   induction register, so its value at the start of iteration k is its
+*   value at the start of the loop plus k steps.
+*
+*   Running a loop works out, from the registers at its start, how many
+*   iterations leave every branch condition as it was in the first one and
+*   keep every access in bounds, then does their loads and stores at once
+*   with memmove, a fill loop the compiler vectorizes or memcmp.
+*/
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "um_loop.h"
+
+#define MAX_TERMS 4
+#define MAX_ACCESSES 4
+#define MAX_CONDS 4
+#define MAX_TARGETS 15
+#define MAX_NODES (2 * MAX_BLOCK_LENGTH + NUM_REGISTERS)
+#define NO_REG NUM_REGISTERS
+#define NO_LOAD -1
+
+/*
+* Symbolic value of a register partway through an iteration
+*/
+typedef enum Node_kind {
+    NODE_REG,       // the register numbered value at the iteration start
+    NODE_CONST,     // the constant value
+    NODE_LOAD,      // the word loaded by access number value
+    NODE_ADD,       // x + y
+    NODE_NOT,       // ~x
+    NODE_SELECT,    // z != 0 ? x : y
+    NODE_OTHER      // anything else
+} Node_kind;
+
+typedef struct Node {
+    Node_kind kind;
+    uint32_t value;
+    uint16_t x, y, z;
+} Node;
+
+/*
+* Sum struct that represents a constant plus the start-of-loop values of
+* some registers, each complemented where its bit of inverted is set
+*/
+typedef struct Sum {
+    uint8_t num_regs;
+    uint8_t regs[MAX_TERMS];
+    uint8_t inverted;
+    uint32_t constant;
+} Sum;
+
+/*
+* Access struct that represents a load or store walking a segment. The
+* index steps with the induction register it contains; a store writes
+* either the word of an earlier load or an invariant value.
+*/
+typedef struct Access {
+    bool store;
+    uint8_t induction;
+    Sum segment;
+    Sum index;
+    int8_t value_load;
+    Sum value;
+} Access;
+
+/*
+* Cond struct that represents a branch condition, the value
+* L[load] + ~L[not_load] + sum, leaving out the loads that are NO_LOAD.
+* A condition with loads has no induction register in its sum.
+*/
+typedef struct Cond {
+    int8_t load;
+    int8_t not_load;
+    uint8_t induction;
+    Sum sum;
+} Cond;
+
+/*
+* Target struct that represents a node of the LOADP target: either a leaf
+* Sum, or a choice between two targets on a condition
+*/
+typedef struct Target {
+    int8_t cond;
+    uint8_t if_true, if_false;
+    Sum leaf;
+} Target;
+
+/*
+* Um_loop struct that represents a recognized loop. Settled registers are
+* reloaded with the same invariant value every iteration, so they are
+* invariant if they hold it when the loop starts.
+*/
+struct Um_loop {
+    Um_loop_kind kind;
+    uint32_t start;
+    bool induction[NUM_REGISTERS];
+    Sum step[NUM_REGISTERS];
+    bool settled[NUM_REGISTERS];
+    Sum settle[NUM_REGISTERS];
+    Sum program;
+    uint8_t num_accesses, num_conds, num_targets;
+    Access accesses[MAX_ACCESSES];
+    Cond conds[MAX_CONDS];
+    Target targets[MAX_TARGETS];
+};
+
+/*
+* Analysis struct that holds the state of the symbolic run of a block
+*/
+typedef struct Analysis {
+    Node nodes[MAX_NODES];
+    uint16_t num_nodes;
+    uint16_t regs[NUM_REGISTERS];
+    bool written[NUM_REGISTERS];
+    bool read_first[NUM_REGISTERS];
+    bool invariant[NUM_REGISTERS];
+    uint16_t access_nodes[MAX_ACCESSES][3];
+    Um_loop *loop;
+} Analysis;
+
+/*
+* new_node
+* Return: the id of a new node, or MAX_NODES if there is no room
+*/
+static uint16_t new_node(Analysis *an, Node_kind kind, uint32_t value,
+                         uint16_t x, uint16_t y, uint16_t z)
+{
+    if (an->num_nodes == MAX_NODES) {
+        return MAX_NODES;
+    }
+    Node node = { kind, value, x, y, z };
+    an->nodes[an->num_nodes] = node;
+    return an->num_nodes++;
+}
+
+static uint16_t read_reg(Analysis *an, uint8_t r)
+{
+    if (!an->written[r]) {
+        an->read_first[r] = true;
+    }
+    return an->regs[r];
+}
+
+static void write_reg(Analysis *an, uint8_t r, uint16_t node)
+{
+    an->written[r] = true;
+    an->regs[r] = node;
+}
+
+/*
+* flatten
+* Splits a value into the terms it adds up and their constant part
+* Return: false if there are more than MAX_TERMS terms
+*/
+static bool flatten(const Analysis *an, uint16_t id, uint16_t *terms,
+                    uint8_t *num_terms, uint32_t *constant)
+{
+    const Node *node = &an->nodes[id];
+    switch (node->kind) {
+      case NODE_CONST:
+          *constant += node->value;
+          return true;
+      case NODE_ADD:
+          return flatten(an, node->x, terms, num_terms, constant) &&
+                 flatten(an, node->y, terms, num_terms, constant);
+      default:
+          if (*num_terms == MAX_TERMS) {
+              return false;
+          }
+          terms[(*num_terms)++] = id;
+          return true;
+    }
+}
+
+/*
+* to_sum
+* Expresses a value as a Sum of invariant registers or their complements
+* and, if induction is not NULL, at most one induction register, which is
+* stored there
+* Return: false if the value is not such a Sum
+*/
+static bool to_sum(const Analysis *an, uint16_t id, Sum *sum,
+                   uint8_t *induction)
+{
+    uint16_t terms[MAX_TERMS];
+    uint8_t num_terms = 0;
+    sum->num_regs = 0;
+    sum->inverted = 0;
+    sum->constant = 0;
+    if (induction != NULL) {
+        *induction = NO_REG;
+    }
+    if (!flatten(an, id, terms, &num_terms, &sum->constant)) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < num_terms; i++) {
+        const Node *node = &an->nodes[terms[i]];
+        if (node->kind == NODE_NOT && an->nodes[node->x].kind == NODE_REG &&
+            an->invariant[an->nodes[node->x].value]) {
+            sum->inverted |= 1 << sum->num_regs;
+            sum->regs[sum->num_regs++] = an->nodes[node->x].value;
+            continue;
+        }
+        if (node->kind != NODE_REG) {
+            return false;
+        }
+        uint8_t r = node->value;
+        if (!an->invariant[r]) {
+            if (!an->loop->induction[r] || induction == NULL ||
+                *induction != NO_REG) {
+                return false;
+            }
+            *induction = r;
+        }
+        sum->regs[sum->num_regs++] = r;
+    }
+    return true;
+}
+
+/*
+* add_cond
+* Return: the number of the condition a value is tested as, or -1
+*/
+static int add_cond(Analysis *an, uint16_t id)
+{
+    Um_loop *loop = an->loop;
+    if (loop->num_conds == MAX_CONDS) {
+        return -1;
+    }
+    Cond *cond = &loop->conds[loop->num_conds];
+
+    uint16_t terms[MAX_TERMS];
+    uint8_t num_terms = 0;
+    uint32_t constant = 0;
+    if (!flatten(an, id, terms, &num_terms, &constant)) {
+        return -1;
+    }
+
+    // Pull the loaded words out of the sum
+    cond->load = cond->not_load = NO_LOAD;
+    uint16_t rest = new_node(an, NODE_CONST, constant, 0, 0, 0);
+    for (uint8_t i = 0; i < num_terms && rest != MAX_NODES; i++) {
+        const Node *node = &an->nodes[terms[i]];
+        if (node->kind == NODE_LOAD && cond->load == NO_LOAD) {
+            cond->load = node->value;
+        } else if (node->kind == NODE_NOT && cond->not_load == NO_LOAD &&
+                   an->nodes[node->x].kind == NODE_LOAD) {
+            cond->not_load = an->nodes[node->x].value;
+        } else {
+            rest = new_node(an, NODE_ADD, 0, rest, terms[i], 0);
+        }
+    }
+    if (rest == MAX_NODES) {
+        return -1;
+    }
+
+    bool loads = cond->load != NO_LOAD || cond->not_load != NO_LOAD;
+    if (!to_sum(an, rest, &cond->sum, loads ? NULL : &cond->induction)) {
+        return -1;
+    }
+    if (loads) {
+        cond->induction = NO_REG;
+    }
+    return loop->num_conds++;
+}
+
+/*
+* add_target
+* Return: the number of the target node a value becomes, or -1
+*/
+static int add_target(Analysis *an, uint16_t id)
+{
+    Um_loop *loop = an->loop;
+    if (loop->num_targets == MAX_TARGETS) {
+        return -1;
+    }
+    int index = loop->num_targets++;
+    Target *target = &loop->targets[index];
+    const Node *node = &an->nodes[id];
+
+    if (node->kind != NODE_SELECT) {
+        target->cond = -1;
+        return to_sum(an, id, &target->leaf, NULL) ? index : -1;
+    }
+
+    int cond = add_cond(an, node->z);
+    int if_true = add_target(an, node->x);
+    int if_false = add_target(an, node->y);
+    if (cond < 0 || if_true < 0 || if_false < 0) {
+        return -1;
+    }
+    target->cond = cond;
+    target->if_true = if_true;
+    target->if_false = if_false;
+    return index;
+}
+
+/*
+* add_access
+* Records a load or store of the block
+* Return: the number of the access, or -1 if there are too many
+*/
+static int add_access(Analysis *an, bool store, uint16_t segment,
+                      uint16_t index, uint16_t value)
+{
+    Um_loop *loop = an->loop;
+    if (loop->num_accesses == MAX_ACCESSES) {
+        return -1;
+    }
+    loop->accesses[loop->num_accesses].store = store;
+    an->access_nodes[loop->num_accesses][0] = segment;
+    an->access_nodes[loop->num_accesses][1] = index;
+    an->access_nodes[loop->num_accesses][2] = value;
+    return loop->num_accesses++;
+}
+
+/*
+* run_symbolically
+* Gives every register its value at the end of the block, recording the
+* accesses and the LOADP operands on the way
+* Return: false if the block does anything but arithmetic and accesses
+* before a final LOADP
+*/
+static bool run_symbolically(Analysis *an, const Um_block *block,
+                             uint16_t *program, uint16_t *target)
+{
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        an->regs[r] = new_node(an, NODE_REG, r, 0, 0, 0);
+    }
+
+    for (uint32_t i = 0; i < block->num_ops; i++) {
+        const Um_decoded *d = &block->ops[i].d;
+        bool last = i + 1 == block->num_ops;
+        uint16_t x, y, z, node;
+        int access;
+
+        if (last != (d->op == DOP_LOADP)) {
+            return false;
+        }
+        switch (d->op) {
+          case DOP_LV:
+          case DOP_CONST:
+              node = new_node(an, NODE_CONST, d->value, 0, 0, 0);
+              break;
+          case DOP_MOV:
+              node = read_reg(an, d->b);
+              break;
+          case DOP_ADD:
+          case DOP_MUL:
+          case DOP_NAND:
+              x = read_reg(an, d->b);
+              y = read_reg(an, d->c);
+              if (d->op == DOP_ADD) {
+                  node = new_node(an, NODE_ADD, 0, x, y, 0);
+              } else if (d->op == DOP_NAND && x == y) {
+                  node = new_node(an, NODE_NOT, 0, x, 0, 0);
+              } else {
+                  node = new_node(an, NODE_OTHER, 0, 0, 0, 0);
+              }
+              break;
+          case DOP_CMOV:
+              z = read_reg(an, d->c);
+              x = read_reg(an, d->b);
+              y = read_reg(an, d->a);
+              node = new_node(an, NODE_SELECT, 0, x, y, z);
+              break;
+          case DOP_SLOAD:
+              x = read_reg(an, d->b);
+              y = read_reg(an, d->c);
+              access = add_access(an, false, x, y, 0);
+              if (access < 0) {
+                  return false;
+              }
+              node = new_node(an, NODE_LOAD, access, 0, 0, 0);
+              break;
+          case DOP_SSTORE:
+              x = read_reg(an, d->a);
+              y = read_reg(an, d->b);
+              z = read_reg(an, d->c);
+              if (add_access(an, true, x, y, z) < 0) {
+                  return false;
+              }
+              continue;
+          case DOP_LOADP:
+              *program = read_reg(an, d->b);
+              *target = read_reg(an, d->c);
+              continue;
+          default:
+              return false;
+        }
+        if (node == MAX_NODES) {
+            return false;
+        }
+        write_reg(an, d->a, node);
+    }
+    return block->num_ops > 0;
+}
+
+/*
+* classify_registers
+* Sorts the registers into invariant, settled, induction and temporary ones
+* Return: false if a register read before being written is temporary
+*/
+static bool classify_registers(Analysis *an)
+{
+    Um_loop *loop = an->loop;
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        const Node *end = &an->nodes[an->regs[r]];
+        an->invariant[r] = end->kind == NODE_REG && end->value == r;
+    }
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        loop->settled[r] = !an->invariant[r] && an->read_first[r] &&
+                           to_sum(an, an->regs[r], &loop->settle[r], NULL);
+    }
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        an->invariant[r] |= loop->settled[r];
+    }
+
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        if (an->invariant[r]) {
+            continue;
+        }
+
+        // An induction register ends as itself plus an invariant step
+        uint16_t terms[MAX_TERMS];
+        uint8_t num_terms = 0;
+        uint32_t constant = 0;
+        int self = -1;
+        if (flatten(an, an->regs[r], terms, &num_terms, &constant)) {
+            for (uint8_t i = 0; i < num_terms; i++) {
+                const Node *node = &an->nodes[terms[i]];
+                if (node->kind == NODE_REG && node->value == r) {
+                    self = i;
+                }
+            }
+        }
+        if (self >= 0) {
+            uint16_t step = new_node(an, NODE_CONST, constant, 0, 0, 0);
+            for (uint8_t i = 0; i < num_terms && step != MAX_NODES; i++) {
+                if (i != self) {
+                    step = new_node(an, NODE_ADD, 0, step, terms[i], 0);
+                }
+            }
+            if (step != MAX_NODES && to_sum(an, step, &loop->step[r], NULL)) {
+                loop->induction[r] = true;
+                continue;
+            }
+        }
+
+        if (an->read_first[r]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+* classify_accesses
+* Return: false if an access does not walk a segment, or a store writes
+* something other than a loaded word or an invariant value
+*/
+static bool classify_accesses(Analysis *an)
+{
+    Um_loop *loop = an->loop;
+    for (uint8_t i = 0; i < loop->num_accesses; i++) {
+        Access *access = &loop->accesses[i];
+        if (!to_sum(an, an->access_nodes[i][0], &access->segment, NULL) ||
+            !to_sum(an, an->access_nodes[i][1], &access->index,
+                    &access->induction) ||
+            access->induction == NO_REG) {
+            return false;
+        }
+
+        access->value_load = NO_LOAD;
+        if (access->store) {
+            const Node *value = &an->nodes[an->access_nodes[i][2]];
+            if (value->kind == NODE_LOAD) {
+                access->value_load = value->value;
+            } else if (!to_sum(an, an->access_nodes[i][2], &access->value,
+                               NULL)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Um_loop *loop_recognize(const Um_block *block)
+{
+    Analysis *an = calloc(1, sizeof(*an));
+    Um_loop *loop = calloc(1, sizeof(*loop));
+    assert(an != NULL && loop != NULL);
+    an->loop = loop;
+    loop->start = block->start;
+
+    uint16_t program = 0, target = 0;
+    bool recognized = run_symbolically(an, block, &program, &target) &&
+                      classify_registers(an) && classify_accesses(an) &&
+                      to_sum(an, program, &loop->program, NULL) &&
+                      add_target(an, target) == 0;
+
+    // The loop must be able to branch back to its start
+    bool loops = false;
+    for (uint8_t i = 0; recognized && i < loop->num_targets; i++) {
+        const Target *t = &loop->targets[i];
+        loops |= t->cond < 0 &&
+                 (t->leaf.num_regs > 0 || t->leaf.constant == block->start);
+    }
+
+    // Name the idiom; a loop with no store must stop on a loaded word
+    int stores = 0;
+    bool compares = false;
+    for (uint8_t i = 0; i < loop->num_accesses; i++) {
+        if (loop->accesses[i].store) {
+            stores++;
+            loop->kind = loop->accesses[i].value_load != NO_LOAD ?
+                         LOOP_COPY : LOOP_FILL;
+        }
+    }
+    for (uint8_t i = 0; i < loop->num_conds; i++) {
+        compares |= loop->conds[i].load != NO_LOAD ||
+                    loop->conds[i].not_load != NO_LOAD;
+    }
+    if (stores == 0) {
+        loop->kind = LOOP_COMPARE;
+    }
+
+    free(an);
+    if (!recognized || !loops || stores > 1 || (stores == 0 && !compares)) {
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+Um_loop_kind loop_kind(const Um_loop *loop)
+{
+    return loop->kind;
+}
+
+/*
+* sum_value
+* Return: the value of a Sum for the registers at the start of the loop
+*/
+static inline uint32_t sum_value(const uint32_t *registers, const Sum *sum)
+{
+    uint32_t value = sum->constant;
+    for (uint8_t i = 0; i < sum->num_regs; i++) {
+        uint32_t term = registers[sum->regs[i]];
+        value += (sum->inverted >> i) & 1 ? ~term : term;
+    }
+    return value;
+}
+
+/*
+* loads_back
+* Return: whether the LOADP target is the loop start for the given
+* condition states
+*/
+static bool loads_back(const Um_loop *loop, const uint32_t *registers,
+                       const bool *nonzero)
+{
+    const Target *target = &loop->targets[0];
+    while (target->cond >= 0) {
+        target = &loop->targets[nonzero[target->cond] ? target->if_true
+                                                      : target->if_false];
+    }
+    return sum_value(registers, &target->leaf) == loop->start;
+}
+
+/*
+* first_change
+* Finds the first of count iterations where a condition on loaded words is
+* no longer nonzero or zero as given
+* Arguments:
+*   - cond - the condition
+*   - a, b - the words its load and not_load read in the first iteration,
+*            or NULL
+*   - stride - how far the loads move each iteration, 1 or -1
+*   - constant - the value of its sum
+* Return: the number of the iteration, or count if there is none
+*/
+static uint32_t first_change(const Cond *cond, const uint32_t *a,
+                             const uint32_t *b, ptrdiff_t stride,
+                             uint32_t constant, bool nonzero, uint32_t count)
+{
+    uint32_t k = 0;
+
+    // An equality test of two forward walks skips ahead with memcmp
+    if (a != NULL && b != NULL && constant == 1 && !nonzero && stride == 1) {
+        enum { CHUNK = 64 };
+        while (count - k >= CHUNK &&
+               memcmp(a + k, b + k, CHUNK * sizeof(*a)) == 0) {
+            k += CHUNK;
+        }
+    }
+
+    for (; k < count; k++) {
+        uint32_t value = constant;
+        if (cond->load != NO_LOAD) {
+            value += a[k * stride];
+        }
+        if (cond->not_load != NO_LOAD) {
+            value += ~b[k * stride];
+        }
+        if ((value != 0) != nonzero) {
+            return k;
+        }
+    }
+    return count;
+}
+
+uint32_t loop_run(UM *um, const Um_loop *loop)
+{
+    uint32_t *registers = um->registers;
+    if (sum_value(registers, &loop->program) != 0) {
+        return 0;
+    }
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        if (loop->settled[r] &&
+            registers[r] != sum_value(registers, &loop->settle[r])) {
+            return 0;
+        }
+    }
+
+    uint32_t step[NUM_REGISTERS];
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        step[r] = loop->induction[r] ? sum_value(registers, &loop->step[r])
+                                     : 0;
+    }
+
+    // Every access walks its segment in the same direction a word at a time
+    uint32_t direction = step[loop->accesses[0].induction];
+    if (direction != 1 && direction != UINT32_MAX) {
+        return 0;
+    }
+    ptrdiff_t stride = direction == 1 ? 1 : -1;
+    uint64_t count = UINT32_MAX;
+
+    uint32_t ids[MAX_ACCESSES], first[MAX_ACCESSES];
+    int store = -1;
+    for (uint8_t i = 0; i < loop->num_accesses; i++) {
+        const Access *access = &loop->accesses[i];
+        ids[i] = sum_value(registers, &access->segment);
+        first[i] = sum_value(registers, &access->index);
+        if (step[access->induction] != direction ||
+            ids[i] >= um->num_segments || first[i] >= um->lengths[ids[i]] ||
+            (access->store && ids[i] == 0)) {
+            return 0;
+        }
+        uint64_t in_bounds = stride == 1 ? um->lengths[ids[i]] - first[i]
+                                         : (uint64_t)first[i] + 1;
+        count = in_bounds < count ? in_bounds : count;
+        if (access->store) {
+            store = i;
+        }
+    }
+
+    // The store must not run ahead into words a load has yet to read
+    for (uint8_t i = 0; store >= 0 && i < loop->num_accesses; i++) {
+        if (i == store || ids[i] != ids[store]) {
+            continue;
+        }
+        int64_t ahead = ((int64_t)first[store] - first[i]) * stride;
+        if (ahead > 0 && (uint64_t)ahead < count) {
+            count = ahead;
+        } else if (ahead == 0 && i > store) {
+            return 0;
+        }
+    }
+
+    // Counters stay nonzero until they reach zero
+    bool nonzero[MAX_CONDS];
+    uint32_t constants[MAX_CONDS];
+    for (uint8_t i = 0; i < loop->num_conds; i++) {
+        const Cond *cond = &loop->conds[i];
+        constants[i] = sum_value(registers, &cond->sum);
+        if (cond->load != NO_LOAD || cond->not_load != NO_LOAD) {
+            continue;
+        }
+
+        nonzero[i] = constants[i] != 0;
+        uint32_t counter_step = cond->induction == NO_REG ? 0
+                                : step[cond->induction];
+        if (counter_step == 0) {
+            continue;
+        }
+        if (counter_step != 1 && counter_step != UINT32_MAX) {
+            return 0;
+        }
+        uint32_t until = !nonzero[i] ? 1 :
+                         counter_step == 1 ? -constants[i] : constants[i];
+        count = until < count ? until : count;
+    }
+
+    // Conditions on loaded words stay as in the first iteration until a
+    // word changes them
+    const uint32_t *words[MAX_ACCESSES];
+    for (uint8_t i = 0; i < loop->num_accesses; i++) {
+        words[i] = um->words[ids[i]] + first[i];
+        um->referenced[ids[i]] = 1;
+    }
+    for (uint8_t i = 0; i < loop->num_conds; i++) {
+        const Cond *cond = &loop->conds[i];
+        if (cond->load == NO_LOAD && cond->not_load == NO_LOAD) {
+            continue;
+        }
+        const uint32_t *a = cond->load == NO_LOAD ? NULL : words[cond->load];
+        const uint32_t *b = cond->not_load == NO_LOAD ? NULL
+                            : words[cond->not_load];
+        nonzero[i] = first_change(cond, a, b, stride, constants[i], false,
+                                  1) == 0;
+    }
+    if (count == 0 || !loads_back(loop, registers, nonzero)) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < loop->num_conds; i++) {
+        const Cond *cond = &loop->conds[i];
+        if (cond->load == NO_LOAD && cond->not_load == NO_LOAD) {
+            continue;
+        }
+        const uint32_t *a = cond->load == NO_LOAD ? NULL : words[cond->load];
+        const uint32_t *b = cond->not_load == NO_LOAD ? NULL
+                            : words[cond->not_load];
+        count = first_change(cond, a, b, stride, constants[i], nonzero[i],
+                             count);
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    // Do the stores of every iteration at once
+    if (store >= 0) {
+        const Access *access = &loop->accesses[store];
+        uint32_t *to = um->words[ids[store]] + first[store];
+        if (stride < 0) {
+            to -= count - 1;
+        }
+        if (access->value_load != NO_LOAD) {
+            const uint32_t *from = words[access->value_load];
+            if (stride < 0) {
+                from -= count - 1;
+            }
+            memmove(to, from, count * sizeof(*to));
+        } else {
+            uint32_t value = sum_value(registers, &access->value);
+            for (uint32_t k = 0; k < count; k++) {
+                to[k] = value;
+            }
+        }
+    }
+
+    for (uint8_t r = 0; r < NUM_REGISTERS; r++) {
+        registers[r] += (uint32_t)count * step[r];
+    }
+    return count;
+}
@@ -0,0 +1,65 @@
+/*
+*   um_loop.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_loop, which recognizes optimized
+*   blocks that loop back to their own start as counted copy, fill and
+*   compare loops, and runs their iterations as bulk memory operations
+*/
+
+#ifndef UM_LOOP_INCLUDED
+#define UM_LOOP_INCLUDED
+
+#include <inttypes.h>
+#include "um_util.h"
+#include "um_optimize.h"
+
+/*
+* The loop idioms, by what a single iteration does to memory
+*/
+typedef enum Um_loop_kind {
+    LOOP_COPY,      // stores a word it loaded
+    LOOP_FILL,      // stores a loop-invariant value
+    LOOP_COMPARE,   // loads until a loaded word or pair of words differs
+    NUM_LOOP_KINDS
+} Um_loop_kind;
+
+typedef struct Um_loop Um_loop;
+
+/*
+* loop_recognize
+* Checks whether an optimized block is a loop idiom: its ops only move
+* registers, do arithmetic, load and store, and it ends in a LOADP of m[0]
+* that may target its own start. Every register read before being written
+* must be invariant or step by an invariant amount per iteration, every
+* access must walk a segment one word at a time, and the LOADP target must
+* depend only on whether counters, loaded words or differences of loaded
+* words are zero.
+* Arguments:
+*   - block - the optimized block
+* Return: the newly malloc'd loop, or NULL if the block is not an idiom
+*/
+Um_loop *loop_recognize(const Um_block *block);
+
+/*
+* loop_kind
+* Return: which idiom a recognized loop is
+*/
+Um_loop_kind loop_kind(const Um_loop *loop);
+
+/*
+* loop_run
+* Runs as many iterations of a loop as possible, from the start of its
+* block, as bulk operations on um. Every iteration run leaves the loop
+* taking the branch back to its start with the same counters nonzero and
+* the same compared words equal or different as the first; the iteration
+* where that changes, or that would fault or store into m[0], is left for
+* the caller to run one instruction at a time.
+* Arguments:
+*   - um - the machine, with its counter at the start of the loop block
+*   - loop - the recognized loop
+* Return: the number of iterations run, possibly 0
+*/
+uint32_t loop_run(UM *um, const Um_loop *loop);
+
+#endif
@@ -0,0 +1,249 @@
+/*
+*   um_optimize.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_optimize. A block is analysed
+*   in two passes over its decoded ops:
+*
+*   - a forward pass tracks which registers hold known constants, folds
+*     ADD/MUL/DIV/NAND/CMOV over them into CONST/MOV ops, and turns a LOADP
+*     of segment 0 to a known pc into a static JUMP;
+*   - a backward pass drops writes to registers that are overwritten before
+*     being read. Every register is assumed live at the end of the block and
+*     after each SSTORE, since a store into m[0] makes the engine leave the
+*     block there and the registers must be exact at that point.
+*
+*   Instructions that can fault or have effects beyond their target register
+*   (SLOAD, DIV by an unknown divisor, IN, map/unmap) are never dropped.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "um_optimize.h"
+#include "um_loop.h"
+
+/*
+* decode_generic
+* Unpacks an instruction word into a decoded entry with its generic op
+*/
+static Um_decoded decode_generic(uint32_t word)
+{
+    Um_decoded decoded = { 0, 0, 0, 0, 0 };
+    Um_opcode opcode = word >> 28;
+
+    decoded.op = DOP_OF(opcode);
+    if (opcode == LV) {
+        decoded.a = (word >> 25) & 0x7;
+        decoded.value = word & 0x1ffffff;
+    } else {
+        decoded.a = (word >> 6) & 0x7;
+        decoded.b = (word >> 3) & 0x7;
+        decoded.c = word & 0x7;
+    }
+    return decoded;
+}
+
+/*
+* fold_constants
+* Forward pass: rewrites ops whose inputs are known constants
+*/
+static void fold_constants(Um_block *block)
+{
+    bool known[NUM_REGISTERS] = { false };
+    uint32_t value[NUM_REGISTERS] = { 0 };
+
+    for (uint32_t i = 0; i < block->num_ops; i++) {
+        Um_decoded *d = &block->ops[i].d;
+        bool inputs_known = known[d->b] && known[d->c];
+        uint32_t b = value[d->b];
+        uint32_t c = value[d->c];
+
+        switch (d->op) {
+          case DOP_LV:
+              known[d->a] = true;
+              value[d->a] = d->value;
+              break;
+          case DOP_ADD:
+          case DOP_MUL:
+          case DOP_NAND:
+          case DOP_DIV:
+              if (!inputs_known || (d->op == DOP_DIV && c == 0)) {
+                  known[d->a] = false;
+                  break;
+              }
+              d->value = d->op == DOP_ADD ? b + c :
+                         d->op == DOP_MUL ? b * c :
+                         d->op == DOP_NAND ? ~(b & c) : b / c;
+              d->op = DOP_CONST;
+              known[d->a] = true;
+              value[d->a] = d->value;
+              break;
+          case DOP_CMOV:
+              if (!known[d->c]) {
+                  // Either value may end up in ra
+                  known[d->a] = known[d->a] && known[d->b] &&
+                                value[d->a] == b;
+              } else if (c == 0) {
+                  d->op = DOP_INVALID;
+              } else if (known[d->b]) {
+                  d->op = DOP_CONST;
+                  d->value = b;
+                  known[d->a] = true;
+                  value[d->a] = b;
+              } else {
+                  d->op = DOP_MOV;
+                  known[d->a] = false;
+              }
+              break;
+          case DOP_SLOAD:
+              known[d->a] = false;
+              break;
+          case DOP_ACTIVATE:
+              known[d->b] = false;
+              break;
+          case DOP_IN:
+              known[d->c] = false;
+              break;
+          case DOP_LOADP:
+              if (inputs_known && b == 0) {
+                  d->op = DOP_JUMP;
+                  d->value = c;
+              }
+              break;
+          default:
+              break;
+        }
+    }
+}
+
+/*
+* eliminate_dead_writes
+* Backward pass: drops pure ops whose target register is dead
+*/
+static void eliminate_dead_writes(Um_block *block)
+{
+    bool live[NUM_REGISTERS];
+    memset(live, true, sizeof(live));
+
+    for (uint32_t i = block->num_ops; i-- > 0; ) {
+        Um_decoded *d = &block->ops[i].d;
+        switch (d->op) {
+          case DOP_LV:
+          case DOP_CONST:
+              if (!live[d->a]) {
+                  d->op = DOP_INVALID;
+              }
+              live[d->a] = false;
+              break;
+          case DOP_ADD:
+          case DOP_MUL:
+          case DOP_NAND:
+          case DOP_MOV:
+              if (!live[d->a]) {
+                  d->op = DOP_INVALID;
+                  break;
+              }
+              live[d->a] = false;
+              live[d->b] = true;
+              if (d->op != DOP_MOV) {
+                  live[d->c] = true;
+              }
+              break;
+          case DOP_CMOV:
+              // A conditional write does not kill ra
+              if (!live[d->a]) {
+                  d->op = DOP_INVALID;
+                  break;
+              }
+              live[d->b] = live[d->c] = true;
+              break;
+          case DOP_SSTORE:
+              memset(live, true, sizeof(live));
+              break;
+          case DOP_SLOAD:
+          case DOP_DIV:
+              live[d->a] = false;
+              live[d->b] = live[d->c] = true;
+              break;
+          case DOP_ACTIVATE:
+              live[d->b] = false;
+              live[d->c] = true;
+              break;
+          case DOP_IN:
+              live[d->c] = false;
+              break;
+          case DOP_INACTIVATE:
+          case DOP_OUT:
+              live[d->c] = true;
+              break;
+          case DOP_LOADP:
+              live[d->b] = live[d->c] = true;
+              break;
+          default:
+              break;
+        }
+    }
+}
+
+/*
+* compact_ops
+* Removes the ops the passes turned into no-ops
+*/
+static void compact_ops(Um_block *block)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < block->num_ops; i++) {
+        if (block->ops[i].d.op != DOP_INVALID) {
+            block->ops[kept++] = block->ops[i];
+        }
+    }
+    block->num_ops = kept;
+}
+
+Um_block *optimize_block(const uint32_t *words, uint32_t count,
+                         uint32_t start)
+{
+    assert(count > 0);
+
+    // The block runs up to and including its first LOADP or HALT
+    uint32_t end = start;
+    while (end - start < count && end - start < MAX_BLOCK_LENGTH) {
+        Um_opcode opcode = words[end++ - start] >> 28;
+        if (opcode == LOADP || opcode == HALT) {
+            break;
+        }
+    }
+
+    Um_block *block = malloc(sizeof(*block) +
+                             (end - start) * sizeof(Um_block_op));
+    assert(block != NULL);
+    block->start = start;
+    block->length = end - start;
+    block->exit_pc = end;
+    block->placed = false;
+    block->num_ops = end - start;
+    for (uint32_t pc = start; pc < end; pc++) {
+        block->ops[pc - start].d = decode_generic(words[pc - start]);
+        block->ops[pc - start].pc = pc;
+    }
+
+    // Invalid opcodes do nothing, so they can go right away
+    compact_ops(block);
+    fold_constants(block);
+    eliminate_dead_writes(block);
+    compact_ops(block);
+    block->loop = loop_recognize(block);
+    return block;
+}
+
+void free_block(Um_block *block)
+{
+    if (block != NULL) {
+        free(block->loop);
+        if (!block->placed) {
+            free(block);
+        }
+    }
+}
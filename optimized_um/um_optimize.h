@@ -0,0 +1,75 @@
+/*
+*   um_optimize.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_optimize, the optimizing tier
+*   of the engine. It turns a basic block of m[0], entered at its first
+*   instruction, into a list of decoded ops with constants folded, constant
+*   jumps resolved and dead register writes dropped, and recognizes blocks
+*   that are copy, fill or compare loops (see um_loop.h).
+*/
+
+#ifndef UM_OPTIMIZE_INCLUDED
+#define UM_OPTIMIZE_INCLUDED
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "um_decode.h"
+
+/*
+* Most words of m[0] a block may cover
+*/
+#define MAX_BLOCK_LENGTH 256
+
+/*
+* Um_block_op struct that represents one op of an optimized block, with the
+* pc of the instruction it came from
+*/
+typedef struct Um_block_op {
+    Um_decoded d;
+    uint32_t pc;
+} Um_block_op;
+
+/*
+* Um_block struct that represents an optimized basic block. A block ends at
+* its first LOADP or HALT; otherwise execution falls off it at exit_pc.
+* A block that is a loop idiom carries the recognized loop. A placed block
+* was copied into memory shared with other blocks (see um_layout.h) and is
+* not freed on its own.
+*/
+typedef struct Um_block {
+    uint32_t start;
+    uint32_t length;
+    uint32_t exit_pc;
+    struct Um_loop *loop;
+    bool placed;
+    uint32_t num_ops;
+    Um_block_op ops[];
+} Um_block;
+
+/*
+* Bytes a block takes up, rounded so blocks can be placed back to back
+*/
+#define BLOCK_SIZE(block) \
+    ((sizeof(Um_block) + (block)->num_ops * sizeof(Um_block_op) + 7) & ~7ul)
+
+/*
+* optimize_block
+* Builds the optimized block entered at m[0][start]
+* Arguments:
+*   - words - the words of m[0] from start on, or a copy of them
+*   - count - the number of words from start to the end of m[0], at least 1;
+*             only the first MAX_BLOCK_LENGTH are read
+*   - start - the pc the block is entered at
+* Return: the newly malloc'd block
+*/
+Um_block *optimize_block(const uint32_t *words, uint32_t count,
+                         uint32_t start);
+
+/*
+* free_block
+* Frees an optimized block, unless it was placed, and its loop
+*/
+void free_block(Um_block *block);
+
+#endif
@@ -0,0 +1,308 @@
+/*
+*   um_pipe.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_pipe. Each side of a ring
+*   keeps its own position privately and publishes it only once per batch
+*   of bytes, or before it sleeps, so the other side's cache line is
+*   touched once per batch rather than once per byte.
+*
+*   Sleeping uses an event counter per direction: a side that finds the
+*   ring empty (or full) reads the counter, raises its waiting flag, looks
+*   at the ring once more and only then sleeps on the counter. The other
+*   side bumps the counter and wakes it after publishing whenever it sees
+*   the flag raised. Both the flag and the published positions are
+*   sequentially consistent, so one of the two always sees the other.
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "um_pipe.h"
+
+// Bytes a ring holds; a power of two
+#define RING_SIZE (1 << 16)
+
+// Bytes a side moves before publishing its position
+#define RING_BATCH 4096
+
+// Times a side looks at an empty or full ring before it sleeps, when the
+// other side can be running on another core
+#define RING_SPIN 1024
+
+#define CACHE_LINE 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPIN_PAUSE() __builtin_ia32_pause()
+#else
+#define SPIN_PAUSE() ((void) 0)
+#endif
+
+/*
+* Um_ring struct, shared by the writing and reading processes. Each line
+* holds the fields written by only one side.
+*/
+struct Um_ring {
+    // Published by the writer
+    uint32_t head __attribute__((aligned(CACHE_LINE)));
+    uint32_t writer_closed;
+    uint32_t writer_waiting;
+    uint32_t data_event;
+
+    // The writer's own
+    uint32_t write_head __attribute__((aligned(CACHE_LINE)));
+    uint32_t cached_tail;
+
+    // Published by the reader
+    uint32_t tail __attribute__((aligned(CACHE_LINE)));
+    uint32_t reader_closed;
+    uint32_t reader_waiting;
+    uint32_t space_event;
+
+    // The reader's own
+    uint32_t read_tail __attribute__((aligned(CACHE_LINE)));
+    uint32_t cached_head;
+
+    uint8_t bytes[RING_SIZE] __attribute__((aligned(CACHE_LINE)));
+};
+
+// Spins before sleeping: RING_SPIN, or 0 on a single core
+static uint32_t spin_limit = RING_SPIN;
+
+static inline uint32_t load(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void store(uint32_t *p, uint32_t value)
+{
+    __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+static void futex_wait(uint32_t *event, uint32_t seen)
+{
+    syscall(SYS_futex, event, FUTEX_WAIT, seen, NULL, NULL, 0);
+}
+
+/*
+* wake_other
+* Wakes the other side if it is waiting on event
+*/
+static inline void wake_other(uint32_t *waiting, uint32_t *event)
+{
+    if (load(waiting)) {
+        __atomic_add_fetch(event, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, event, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+void ring_flush(Um_ring *ring)
+{
+    store(&ring->head, ring->write_head);
+    wake_other(&ring->reader_waiting, &ring->data_event);
+}
+
+/*
+* release_space
+* Publishes the reader's position, handing the bytes read back to the
+* writer
+*/
+static void release_space(Um_ring *ring)
+{
+    store(&ring->tail, ring->read_tail);
+    wake_other(&ring->writer_waiting, &ring->space_event);
+}
+
+/*
+* wait_for_space
+* Waits until the ring has room for a byte or the reader has closed it
+* Return: false if the reader has closed the ring
+*/
+static bool wait_for_space(Um_ring *ring)
+{
+    ring_flush(ring);
+    for (uint32_t spin = 0; spin < spin_limit; spin++) {
+        ring->cached_tail = load(&ring->tail);
+        if (ring->write_head - ring->cached_tail < RING_SIZE) {
+            return true;
+        }
+        SPIN_PAUSE();
+    }
+    while (true) {
+        uint32_t seen = load(&ring->space_event);
+        store(&ring->writer_waiting, 1);
+        ring->cached_tail = load(&ring->tail);
+        bool closed = load(&ring->reader_closed);
+        if (ring->write_head - ring->cached_tail < RING_SIZE || closed) {
+            store(&ring->writer_waiting, 0);
+            return !closed;
+        }
+        futex_wait(&ring->space_event, seen);
+    }
+}
+
+void ring_put(Um_ring *ring, uint8_t byte)
+{
+    if (ring->write_head - ring->cached_tail == RING_SIZE &&
+        !wait_for_space(ring)) {
+        return;
+    }
+    ring->bytes[ring->write_head % RING_SIZE] = byte;
+    ring->write_head++;
+    if (ring->write_head - ring->head >= RING_BATCH) {
+        ring_flush(ring);
+    }
+}
+
+/*
+* wait_for_data
+* Waits until the ring holds a byte or the writer has closed it, first
+* flushing the ring flush if not NULL
+* Return: false if the ring is empty and closed
+*/
+static bool wait_for_data(Um_ring *ring, Um_ring *flush)
+{
+    release_space(ring);
+    if (flush != NULL) {
+        ring_flush(flush);
+    }
+    for (uint32_t spin = 0; spin < spin_limit; spin++) {
+        ring->cached_head = load(&ring->head);
+        if (ring->cached_head != ring->read_tail) {
+            return true;
+        }
+        SPIN_PAUSE();
+    }
+    while (true) {
+        uint32_t seen = load(&ring->data_event);
+        store(&ring->reader_waiting, 1);
+        bool closed = load(&ring->writer_closed);
+        ring->cached_head = load(&ring->head);
+        if (ring->cached_head != ring->read_tail || closed) {
+            store(&ring->reader_waiting, 0);
+            return ring->cached_head != ring->read_tail;
+        }
+        futex_wait(&ring->data_event, seen);
+    }
+}
+
+int ring_get(Um_ring *ring, Um_ring *flush)
+{
+    if (ring->read_tail == ring->cached_head && !wait_for_data(ring, flush)) {
+        return EOF;
+    }
+    uint8_t byte = ring->bytes[ring->read_tail % RING_SIZE];
+    ring->read_tail++;
+    if (ring->read_tail - ring->tail >= RING_BATCH) {
+        release_space(ring);
+    }
+    return byte;
+}
+
+void ring_close_writer(Um_ring *ring)
+{
+    store(&ring->head, ring->write_head);
+    store(&ring->writer_closed, 1);
+    __atomic_add_fetch(&ring->data_event, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &ring->data_event, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+void ring_close_reader(Um_ring *ring)
+{
+    store(&ring->reader_closed, 1);
+    __atomic_add_fetch(&ring->space_event, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &ring->space_event, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/*
+* run_stage
+* Runs one stage of a pipeline in the calling process, pinned to a core
+*/
+static void run_stage(const char *path, int stage, Um_ring *input,
+                      Um_ring *output, const Um_options *options)
+{
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cores <= 1) {
+        spin_limit = 0;
+    } else {
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        CPU_SET(stage % num_cores, &cores);
+        sched_setaffinity(0, sizeof(cores), &cores);
+    }
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Specified um instruction file does not exist.\n");
+        exit(EXIT_FAILURE);
+    }
+    Um_options stage_options = *options;
+    stage_options.input_ring = input;
+    stage_options.output_ring = output;
+    run_um(fp, &stage_options);
+    fclose(fp);
+}
+
+bool run_pipeline(char **paths, int num_paths, const Um_options *options)
+{
+    // The rings between neighbouring stages, shared with every stage
+    int num_rings = num_paths - 1;
+    Um_ring *rings = NULL;
+    if (num_rings > 0) {
+        rings = mmap(NULL, num_rings * sizeof(*rings),
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                     -1, 0);
+        assert(rings != MAP_FAILED);
+    }
+
+    // Output buffered before the fork must not be written twice
+    fflush(stdout);
+    pid_t *stages = malloc(num_paths * sizeof(*stages));
+    assert(stages != NULL);
+    for (int i = 0; i < num_paths; i++) {
+        stages[i] = fork();
+        assert(stages[i] >= 0);
+        if (stages[i] == 0) {
+            run_stage(paths[i], i, i > 0 ? &rings[i - 1] : NULL,
+                      i < num_rings ? &rings[i] : NULL, options);
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    // Close the rings of a stage that exits, which it already has unless
+    // it failed, so that its neighbours do not wait on it forever
+    bool succeeded = true;
+    for (int left = num_paths; left > 0; left--) {
+        int status;
+        pid_t pid = wait(&status);
+        assert(pid > 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            succeeded = false;
+        }
+        for (int i = 0; i < num_paths; i++) {
+            if (stages[i] != pid) {
+                continue;
+            }
+            if (i > 0) {
+                ring_close_reader(&rings[i - 1]);
+            }
+            if (i < num_rings) {
+                ring_close_writer(&rings[i]);
+            }
+        }
+    }
+
+    free(stages);
+    if (rings != NULL) {
+        munmap(rings, num_rings * sizeof(*rings));
+    }
+    return succeeded;
+}
@@ -0,0 +1,78 @@
+/*
+*   um_pipe.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_pipe, which runs a pipeline of
+*   machines, each in a process of its own pinned to a core, with the
+*   output of each feeding the input of the next. Neighbouring machines
+*   share a single-producer, single-consumer byte ring in shared memory in
+*   place of a kernel pipe: output and input instructions only touch the
+*   ring, and a machine sleeps on a futex only when its ring is empty (or
+*   full) after a short spin.
+*/
+
+#ifndef UM_PIPE_INCLUDED
+#define UM_PIPE_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include "um_engine.h"
+
+typedef struct Um_ring Um_ring;
+
+/*
+* ring_put
+* Writes a byte into a ring, waiting while it is full. The byte is seen by
+* the reader once a batch of bytes is ready or at the next ring_flush. A
+* byte written after the reader has closed the ring is dropped.
+* Arguments:
+*   - ring - the ring
+*   - byte - the byte
+* Return: void
+*/
+void ring_put(Um_ring *ring, uint8_t byte);
+
+/*
+* ring_flush
+* Lets the reader see every byte written so far
+* Arguments:
+*   - ring - the ring
+* Return: void
+*/
+void ring_flush(Um_ring *ring);
+
+/*
+* ring_get
+* Reads a byte from a ring, waiting while it is empty
+* Arguments:
+*   - ring - the ring
+*   - flush - a ring to flush before waiting, so that a machine waiting for
+*             input has passed on all of its output, or NULL
+* Return: the byte, or EOF once the writer has closed the ring and every
+*         byte has been read
+*/
+int ring_get(Um_ring *ring, Um_ring *flush);
+
+/*
+* ring_close_writer, ring_close_reader
+* Closes one end of a ring, flushing it and waking the other end
+* Arguments:
+*   - ring - the ring
+* Return: void
+*/
+void ring_close_writer(Um_ring *ring);
+void ring_close_reader(Um_ring *ring);
+
+/*
+* run_pipeline
+* Runs each um instruction file as a stage of a pipeline: the first stage
+* reads stdin, the last writes stdout, and every stage runs with options
+* Arguments:
+*   - paths - the um instruction files, in pipeline order
+*   - num_paths - their number
+*   - options - the engine options every stage runs with
+* Return: whether every stage exited successfully
+*/
+bool run_pipeline(char **paths, int num_paths, const Um_options *options);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+*   um_pool.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_pool. The region is reserved
+*   inaccessible and opened up a chunk at a time as a bump pointer moves
+*   through it. A freed segment goes on the free list of its size class:
+*   one class per length up to POOL_EXACT words, and one per power of two
+*   above that, whose blocks are rounded up to the power. The link of a
+*   free list lives in the first words of each free block.
+*
+*   Memory below the highest point the bump pointer has reached may hold
+*   words of earlier segments, so it is zeroed as it is handed out again;
+*   memory above it is still zero from the kernel. A reset rewinds the bump
+*   pointer and empties the free lists, and a releasing reset also drops the
+*   pages that were used, so that they are zero again.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include "um_pool.h"
+
+/*
+* Tuning constants
+*/
+#define POOL_RESERVE ((size_t) 1 << 40)
+#define POOL_CHUNK ((size_t) 64 << 20)
+#define POOL_EXACT 64
+#define POOL_ALIGN 16
+#define NUM_CLASSES (POOL_EXACT + 27)
+
+static char *base = NULL;
+
+// The bump pointer, the end of the part opened up, and the highest point
+// the bump pointer has reached since the memory was last known zero
+static char *next = NULL;
+static char *committed = NULL;
+static char *dirty_end = NULL;
+
+// Head of the free list of each size class
+static char *free_blocks[NUM_CLASSES];
+
+/*
+* size_class
+* Returns the class of a segment of length words
+*/
+static inline uint32_t size_class(uint32_t length)
+{
+    if (length <= POOL_EXACT) {
+        return length;
+    }
+    return POOL_EXACT + (32 - __builtin_clz(length - 1)) - 6;
+}
+
+/*
+* class_bytes
+* Returns the bytes of a block of the given class, which holds the link of
+* a free list even for an empty segment
+*/
+static inline size_t class_bytes(uint32_t class)
+{
+    size_t words = class <= POOL_EXACT ? class :
+                   (size_t) 1 << (class - POOL_EXACT + 6);
+    size_t bytes = words * sizeof(uint32_t);
+    if (bytes < sizeof(char *)) {
+        bytes = sizeof(char *);
+    }
+    return (bytes + POOL_ALIGN - 1) & ~((size_t) POOL_ALIGN - 1);
+}
+
+void pool_init()
+{
+    base = mmap(NULL, POOL_RESERVE, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(base != MAP_FAILED);
+    next = committed = dirty_end = base;
+    memset(free_blocks, 0, sizeof(free_blocks));
+}
+
+/*
+* carve
+* Takes a block off the top of the region, opening up more of it as needed
+*/
+static char *carve(size_t bytes)
+{
+    if (bytes > (size_t) (base + POOL_RESERVE - next)) {
+        fprintf(stderr, "um: segment pool exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+    if (next + bytes > committed) {
+        size_t more = next + bytes - committed;
+        more = (more + POOL_CHUNK - 1) & ~(POOL_CHUNK - 1);
+        if (more > (size_t) (base + POOL_RESERVE - committed)) {
+            more = base + POOL_RESERVE - committed;
+        }
+        int status = mprotect(committed, more, PROT_READ | PROT_WRITE);
+        assert(status == 0);
+        (void) status;
+        committed += more;
+    }
+    char *block = next;
+    next += bytes;
+    return block;
+}
+
+uint32_t *pool_words_new(uint32_t length)
+{
+    uint32_t class = size_class(length);
+    size_t bytes = (size_t) length * sizeof(uint32_t);
+    char *block = free_blocks[class];
+
+    if (block != NULL) {
+        memcpy(&free_blocks[class], block, sizeof(char *));
+        memset(block, 0, bytes);
+        return (uint32_t *) block;
+    }
+
+    // Only what lies below the high-water mark can be dirty
+    block = carve(class_bytes(class));
+    if (block < dirty_end) {
+        size_t dirty = dirty_end - block;
+        memset(block, 0, dirty < bytes ? dirty : bytes);
+    }
+    if (next > dirty_end) {
+        dirty_end = next;
+    }
+    return (uint32_t *) block;
+}
+
+void pool_words_free(uint32_t *words, uint32_t length)
+{
+    uint32_t class = size_class(length);
+    memcpy(words, &free_blocks[class], sizeof(char *));
+    free_blocks[class] = (char *) words;
+}
+
+void pool_reset(bool release)
+{
+    if (release && dirty_end > base) {
+        madvise(base, dirty_end - base, MADV_DONTNEED);
+        dirty_end = base;
+    }
+    next = base;
+    memset(free_blocks, 0, sizeof(free_blocks));
+}
+
+void pool_finish()
+{
+    munmap(base, POOL_RESERVE);
+    base = next = committed = dirty_end = NULL;
+}
@@ -0,0 +1,63 @@
+/*
+*   um_pool.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_pool, a segment memory backend
+*   for machines that are reset and run again. Segments are carved from a
+*   single reserved region and recycled through free lists by size, so
+*   releasing every segment of a machine at once takes no walk over them:
+*   the region is simply rewound, and optionally handed back to the
+*   operating system in a single call.
+*/
+
+#ifndef UM_POOL_INCLUDED
+#define UM_POOL_INCLUDED
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+* pool_init
+* Reserves the region segments are carved from
+* Arguments: None
+* Return: void
+*/
+void pool_init();
+
+/*
+* pool_words_new
+* Allocates zeroed words for a segment
+* Arguments:
+*   - length - the number of words in the segment
+* Return: the first word of the segment
+*/
+uint32_t *pool_words_new(uint32_t length);
+
+/*
+* pool_words_free
+* Puts the words of a segment on the free list for its size
+* Arguments:
+*   - words, length - the segment, as returned by pool_words_new
+* Return: void
+*/
+void pool_words_free(uint32_t *words, uint32_t length);
+
+/*
+* pool_reset
+* Releases every segment at once
+* Arguments:
+*   - release - whether to hand the memory back to the operating system,
+*               rather than keep it to be zeroed and reused
+* Return: void
+*/
+void pool_reset(bool release);
+
+/*
+* pool_finish
+* Unmaps the region
+* Arguments: None
+* Return: void
+*/
+void pool_finish();
+
+#endif
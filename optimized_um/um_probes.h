@@ -0,0 +1,93 @@
+/*
+*   um_probes.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This file defines the static probes of the engine, for bpftrace,
+*   perf or SystemTap to attach to on a running machine (see the scripts
+*   in bpftrace/). Each probe is a single nop in the code with a note in
+*   the binary naming it and saying where its arguments are, so it costs
+*   nothing until a tracer attaches and turns the nop into a trap. The
+*   provider is um:
+*
+*       program_load(words)             m[0] loaded from the program file
+*       map_begin(words)                a map instruction starts
+*       map_end(segment, words)         ... and has mapped the segment
+*       unmap(segment, words)           a segment is unmapped
+*       load_program(segment, words, pc)  a segment is copied into m[0]
+*       input(pc, value)                an input, 0xffffffff at EOF
+*       output(byte)                    an output
+*       halt(segments)                  the machine halted, with the
+*                                       segments still mapped besides m[0]
+*
+*   The probes come from <sys/sdt.h> where it is installed. Without it, on
+*   x86-64, the same notes are written here, in the layout sdt.h uses
+*   (version 3 of the stapsdt note); elsewhere the probes compile to
+*   nothing. Defining UM_NO_SDT_H writes the notes here even where sdt.h
+*   is installed, and UM_NO_PROBES compiles the probes out everywhere, for
+*   check_probes.sh to compare builds.
+*/
+
+#ifndef UM_PROBES_INCLUDED
+#define UM_PROBES_INCLUDED
+
+#include <inttypes.h>
+
+#if defined(__has_include) && !defined(UM_NO_SDT_H) && !defined(UM_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define UM_PROBE1(name, a) DTRACE_PROBE1(um, name, a)
+#define UM_PROBE2(name, a, b) DTRACE_PROBE2(um, name, a, b)
+#define UM_PROBE3(name, a, b, c) DTRACE_PROBE3(um, name, a, b, c)
+#endif
+#endif
+
+#if !defined(UM_PROBE1) && !defined(UM_NO_PROBES) && defined(__x86_64__) && \
+    defined(__ELF__)
+
+// The probe's nop, its note, and the section notes are addressed from,
+// which is emitted once per object
+#define UM_PROBE_ASM(name, args)                                            \
+    "990: nop\n"                                                            \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+    ".balign 4\n"                                                           \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+    "991: .asciz \"stapsdt\"\n"                                             \
+    "992: .balign 4\n"                                                      \
+    "993: .8byte 990b\n"                                                    \
+    ".8byte _.stapsdt.base\n"                                               \
+    ".8byte 0\n"                                                            \
+    ".asciz \"um\"\n"                                                       \
+    ".asciz \"" #name "\"\n"                                                \
+    ".asciz \"" args "\"\n"                                                 \
+    "994: .balign 4\n"                                                      \
+    ".popsection\n"                                                         \
+    ".ifndef _.stapsdt.base\n"                                              \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n"                                                \
+    ".hidden _.stapsdt.base\n"                                              \
+    "_.stapsdt.base: .space 1\n"                                            \
+    ".size _.stapsdt.base, 1\n"                                             \
+    ".popsection\n"                                                         \
+    ".endif\n"
+
+// Every argument is passed as an unsigned 64-bit value, wherever the
+// compiler has it: a register, memory or a constant
+#define UM_PROBE1(name, a)                                                  \
+    __asm__ __volatile__(UM_PROBE_ASM(name, "8@%0")                         \
+                         : : "nor" ((uint64_t) (a)))
+#define UM_PROBE2(name, a, b)                                               \
+    __asm__ __volatile__(UM_PROBE_ASM(name, "8@%0 8@%1")                    \
+                         : : "nor" ((uint64_t) (a)), "nor" ((uint64_t) (b)))
+#define UM_PROBE3(name, a, b, c)                                            \
+    __asm__ __volatile__(UM_PROBE_ASM(name, "8@%0 8@%1 8@%2")               \
+                         : : "nor" ((uint64_t) (a)), "nor" ((uint64_t) (b)), \
+                             "nor" ((uint64_t) (c)))
+#endif
+
+#ifndef UM_PROBE1
+#define UM_PROBE1(name, a) ((void) (a))
+#define UM_PROBE2(name, a, b) ((void) (a), (void) (b))
+#define UM_PROBE3(name, a, b, c) ((void) (a), (void) (b), (void) (c))
+#endif
+
+#endif
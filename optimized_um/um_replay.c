@@ -0,0 +1,200 @@
+/*
+*   um_replay.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_replay. A recording starts
+*   with a header naming the program (its length and a hash of its words),
+*   followed by one record per input: the change in pc since the previous
+*   input, zigzag encoded, and the byte read, or 256 for EOF, each as a
+*   little-endian base-128 varint. An input loop reading a line at a time
+*   stays at one pc, so most inputs take two or three bytes.
+*
+*   A replay reads the whole recording into memory up front, so replayed
+*   input costs no system call.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "um_replay.h"
+
+#define REPLAY_MAGIC "UMRP"
+#define REPLAY_VERSION 1
+#define HEADER_BYTES 16
+#define EOF_VALUE 256
+
+static FILE *recording = NULL;
+static uint32_t last_pc = 0;
+
+static uint8_t *replay = NULL;
+static size_t replay_bytes = 0;
+static size_t replay_at = 0;
+static uint64_t num_replayed = 0;
+
+/*
+* program_hash
+* Returns the 32-bit FNV-1a hash of a program's words
+*/
+static uint32_t program_hash(const uint32_t *words, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash = (hash ^ ((words[i] >> shift) & 0xff)) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static void put32(uint8_t *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = value >> (8 * i);
+    }
+}
+
+static uint32_t get32(const uint8_t *bytes)
+{
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+           (uint32_t) bytes[3] << 24;
+}
+
+/*
+* header
+* Fills in the header of a recording of a program
+*/
+static void header(uint8_t *bytes, const uint32_t *words, uint32_t length)
+{
+    memcpy(bytes, REPLAY_MAGIC, 4);
+    put32(bytes + 4, REPLAY_VERSION);
+    put32(bytes + 8, length);
+    put32(bytes + 12, program_hash(words, length));
+}
+
+static void put_varint(uint32_t value)
+{
+    while (value >= 0x80) {
+        putc((value & 0x7f) | 0x80, recording);
+        value >>= 7;
+    }
+    putc(value, recording);
+}
+
+void record_start(const char *path, const uint32_t *words, uint32_t length)
+{
+    recording = fopen(path, "wb");
+    if (recording == NULL) {
+        fprintf(stderr, "um: could not create the recording %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    uint8_t bytes[HEADER_BYTES];
+    header(bytes, words, length);
+    fwrite(bytes, 1, HEADER_BYTES, recording);
+    last_pc = 0;
+}
+
+void record_input(uint32_t pc, int input)
+{
+    int32_t delta = (int32_t) (pc - last_pc);
+    put_varint(((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31));
+    put_varint(input == EOF ? EOF_VALUE : (uint32_t) input);
+    last_pc = pc;
+}
+
+void record_finish()
+{
+    if (recording != NULL) {
+        fclose(recording);
+        recording = NULL;
+    }
+}
+
+void replay_start(const char *path, const uint32_t *words, uint32_t length)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "um: could not open the recording %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    size_t capacity = 1 << 16;
+    replay = malloc(capacity);
+    assert(replay != NULL);
+    size_t got;
+    while ((got = fread(replay + replay_bytes, 1, capacity - replay_bytes,
+                        fp)) > 0) {
+        replay_bytes += got;
+        if (replay_bytes == capacity) {
+            capacity *= 2;
+            replay = realloc(replay, capacity);
+            assert(replay != NULL);
+        }
+    }
+    fclose(fp);
+
+    uint8_t expected[HEADER_BYTES];
+    header(expected, words, length);
+    if (replay_bytes < HEADER_BYTES || memcmp(replay, expected, 8) != 0) {
+        fprintf(stderr, "um: %s is not a recording\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (memcmp(replay + 8, expected + 8, 8) != 0) {
+        fprintf(stderr, "um: %s is a recording of another program (%"
+                        PRIu32 " words)\n", path, get32(replay + 8));
+        exit(EXIT_FAILURE);
+    }
+    replay_at = HEADER_BYTES;
+    last_pc = 0;
+    num_replayed = 0;
+}
+
+/*
+* get_varint
+* Reads a varint of the recording
+* Return: false at the end of the recording
+*/
+static bool get_varint(uint32_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (replay_at == replay_bytes) {
+            return false;
+        }
+        uint8_t byte = replay[replay_at++];
+        *value |= (uint32_t) (byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int replay_input(uint32_t pc)
+{
+    uint32_t zigzag, value;
+    if (!get_varint(&zigzag) || !get_varint(&value)) {
+        fprintf(stderr, "um: replay diverged: input %" PRIu64 " at pc %"
+                        PRIu32 " is past the end of the recording\n",
+                num_replayed, pc);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t recorded = last_pc + ((zigzag >> 1) ^ -(zigzag & 1));
+    if (recorded != pc) {
+        fprintf(stderr, "um: replay diverged: input %" PRIu64 " was read "
+                        "at pc %" PRIu32 ", now at pc %" PRIu32 "\n",
+                num_replayed, recorded, pc);
+        exit(EXIT_FAILURE);
+    }
+    last_pc = pc;
+    num_replayed++;
+    return value == EOF_VALUE ? EOF : (int) value;
+}
+
+void replay_finish()
+{
+    free(replay);
+    replay = NULL;
+    replay_bytes = 0;
+    replay_at = 0;
+}
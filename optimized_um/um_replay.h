@@ -0,0 +1,78 @@
+/*
+*   um_replay.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_replay, which records every
+*   result of the input instruction of a run to a file and feeds the same
+*   results back to a later run of the same program, so that a session
+*   typed at a terminal or read from a pipe can be run again exactly, for
+*   benchmarking or debugging, without anyone at the keyboard.
+*
+*   Each input is recorded with the pc of the input instruction that read
+*   it. The machine is deterministic given its input, so a replay reads
+*   each input at the same pc as the recorded run did; a replay that finds
+*   itself elsewhere reports where the runs diverged.
+*/
+
+#ifndef UM_REPLAY_INCLUDED
+#define UM_REPLAY_INCLUDED
+
+#include <inttypes.h>
+
+/*
+* record_start
+* Creates a recording of a run of a program
+* Arguments:
+*   - path - the file to record to; any file there is replaced
+*   - words, length - the program as loaded into m[0]
+* Return: void
+*/
+void record_start(const char *path, const uint32_t *words, uint32_t length);
+
+/*
+* record_input
+* Records the result of an input instruction
+* Arguments:
+*   - pc - the pc of the input instruction
+*   - input - the byte read, or EOF
+* Return: void
+*/
+void record_input(uint32_t pc, int input);
+
+/*
+* record_finish
+* Writes out and closes the recording
+* Arguments: None
+* Return: void
+*/
+void record_finish();
+
+/*
+* replay_start
+* Reads a recording to replay, which must be of the same program
+* Arguments:
+*   - path - the recording
+*   - words, length - the program as loaded into m[0]
+* Return: void
+*/
+void replay_start(const char *path, const uint32_t *words, uint32_t length);
+
+/*
+* replay_input
+* Returns the next recorded input, exiting with a report if the run has
+* diverged from the recorded one
+* Arguments:
+*   - pc - the pc of the input instruction
+* Return: the byte, or EOF
+*/
+int replay_input(uint32_t pc);
+
+/*
+* replay_finish
+* Releases the recording
+* Arguments: None
+* Return: void
+*/
+void replay_finish();
+
+#endif
@@ -0,0 +1,207 @@
+/*
+*   um_safe.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_safe. The decoded form of m[0]
+*   is placed so that one past its last entry is the first byte of a
+*   PROT_NONE page, unmapped ids point at an inaccessible trap page, and the
+*   segment table itself is a reservation covering every 32-bit id. Running
+*   off m[0], touching an id past the table or dividing by zero then raises a
+*   hardware fault, which the handlers here turn into a report of the
+*   faulting UM state. The faults the engine catches itself are reported the
+*   same way.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "um_safe.h"
+
+/*
+* Bytes reserved for a segment table that any uint32_t id can index
+*/
+#define TABLE_RESERVE (((size_t) 1 << 32) * sizeof(uint32_t *))
+
+uint32_t *safe_trap_words = NULL;
+
+static UM *faulting_um = NULL;
+static char *reserved_table = NULL;
+static size_t page_size = 0;
+
+static inline size_t round_to_page(size_t bytes)
+{
+    return (bytes + page_size - 1) & ~(page_size - 1);
+}
+
+/*
+* print_report
+* Prints the UM state at the faulting instruction and exits. Only snprintf
+* and write are used so the report is not lost in a stdio buffer of the
+* interrupted program.
+*/
+static void print_report(const char *kind) __attribute__((noreturn));
+static void print_report(const char *kind)
+{
+    char report[512];
+    uint32_t pc = faulting_um->counter;
+    uint32_t opcode = 0;
+
+    // Running off the end of m[0] faults on the fetch itself
+    if (pc < faulting_um->lengths[0]) {
+        opcode = faulting_um->words[0][pc] >> 28;
+    }
+
+    const uint32_t *r = faulting_um->registers;
+    int n = snprintf(report, sizeof(report),
+                     "um: %s at pc %" PRIu32 " (opcode %" PRIu32 ")\n"
+                     "    r0=%08" PRIx32 " r1=%08" PRIx32 " r2=%08" PRIx32
+                     " r3=%08" PRIx32 "\n"
+                     "    r4=%08" PRIx32 " r5=%08" PRIx32 " r6=%08" PRIx32
+                     " r7=%08" PRIx32 "\n",
+                     kind, pc, opcode, r[0], r[1], r[2], r[3],
+                     r[4], r[5], r[6], r[7]);
+    if (n > 0) {
+        ssize_t written = write(STDERR_FILENO, report,
+                                (size_t) n < sizeof(report) ?
+                                (size_t) n : sizeof(report) - 1);
+        (void) written;
+    }
+    _exit(EXIT_FAILURE);
+}
+
+/*
+* report_fault
+* Signal handler that classifies a hardware fault and reports it
+*/
+static void report_fault(int signo, siginfo_t *info, void *context)
+{
+    (void) context;
+    const char *kind;
+
+    if (faulting_um->counter >= faulting_um->lengths[0]) {
+        kind = "program counter past the end of m[0]";
+    } else if (signo == SIGFPE) {
+        kind = "division by zero";
+    } else if (((char *) info->si_addr >= (char *) safe_trap_words &&
+                (char *) info->si_addr < (char *) safe_trap_words + page_size)
+               || ((char *) info->si_addr >= reserved_table &&
+                   (char *) info->si_addr < reserved_table + TABLE_RESERVE)) {
+        kind = "access to an unmapped segment";
+    } else {
+        kind = "out-of-bounds segment access";
+    }
+    print_report(kind);
+}
+
+void safe_fault(const char *kind)
+{
+    print_report(kind);
+}
+
+void safe_init(UM *um)
+{
+    page_size = sysconf(_SC_PAGESIZE);
+    faulting_um = um;
+
+    // The trap page has no access at all
+    safe_trap_words = mmap(NULL, page_size, PROT_NONE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(safe_trap_words != MAP_FAILED);
+
+    // Report faults instead of dumping core
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = report_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, NULL);
+    sigaction(SIGBUS, &action, NULL);
+    sigaction(SIGFPE, &action, NULL);
+}
+
+uint32_t **safe_table_new(uint32_t capacity)
+{
+    uint32_t **table = mmap(NULL, TABLE_RESERVE, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                            -1, 0);
+    assert(table != MAP_FAILED);
+    reserved_table = (char *) table;
+    safe_table_grow(table, 0, capacity);
+    return table;
+}
+
+void safe_table_grow(uint32_t **table, uint32_t old_capacity,
+                     uint32_t new_capacity)
+{
+    // Open up the pages covering the new entries
+    int status = mprotect(table, round_to_page(new_capacity *
+                                               sizeof(uint32_t *)),
+                          PROT_READ | PROT_WRITE);
+    assert(status == 0);
+    (void) status;
+
+    for (uint32_t i = old_capacity; i < new_capacity; i++) {
+        table[i] = safe_trap_words;
+    }
+}
+
+void safe_table_free(uint32_t **table)
+{
+    munmap(table, TABLE_RESERVE);
+}
+
+/*
+* Only one decoded m[0] is live at a time, and the engine frees the last
+* before mapping the next, so the last freed region is kept mapped, guard
+* page and all, and handed out again if the next needs as many pages. A
+* program that loads programs of one size over and over then makes no
+* system calls for them.
+*/
+static char *spare_region = NULL;
+static size_t spare_bytes = 0;
+
+uint32_t *safe_words_new(uint32_t length)
+{
+    size_t data_bytes = round_to_page((size_t) length * sizeof(uint32_t));
+    uint32_t *words;
+
+    // Reuse the spare region, zeroing only the words handed out
+    if (spare_region != NULL && spare_bytes == data_bytes) {
+        words = (uint32_t *) (spare_region + data_bytes) - length;
+        spare_region = NULL;
+        memset(words, 0, (size_t) length * sizeof(uint32_t));
+        return words;
+    }
+
+    // Fresh anonymous pages are already zeroed
+    char *region = mmap(NULL, data_bytes + page_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Close off the page right after the segment
+    if (mprotect(region + data_bytes, page_size, PROT_NONE) != 0) {
+        munmap(region, data_bytes + page_size);
+        return NULL;
+    }
+
+    return (uint32_t *) (region + data_bytes) - length;
+}
+
+void safe_words_free(uint32_t *words, uint32_t length)
+{
+    size_t data_bytes = round_to_page((size_t) length * sizeof(uint32_t));
+    char *region = (char *) (words + length) - data_bytes;
+
+    if (spare_region != NULL) {
+        munmap(spare_region, spare_bytes + page_size);
+    }
+    spare_region = region;
+    spare_bytes = data_bytes;
+}
@@ -0,0 +1,93 @@
+/*
+*   um_safe.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_safe, which reports UM faults.
+*   Division by zero, running off the end of m[0] and touching an id past
+*   the segment table raise hardware faults, which signal handlers report,
+*   so the engine needs no checks for them; segment accesses are checked by
+*   the engine, since no guard page short of 16 GiB per segment would catch
+*   every 32-bit index.
+*/
+
+#ifndef UM_SAFE_INCLUDED
+#define UM_SAFE_INCLUDED
+
+#include <inttypes.h>
+#include "um_util.h"
+
+/*
+* Inaccessible page that every unmapped segment id points at
+*/
+extern uint32_t *safe_trap_words;
+
+/*
+* safe_init
+* Maps the trap page and installs the SIGSEGV/SIGFPE fault reporters
+* Arguments:
+*   - um - the machine whose PC and registers are reported on a fault
+* Return: void
+*/
+void safe_init(UM *um);
+
+/*
+* safe_table_new
+* Reserves a segment table large enough to be indexed by any 32-bit id; only
+* the first capacity entries are accessible, and they all hold the trap page
+* Arguments:
+*   - capacity - the number of entries to make accessible
+* Return: the table
+*/
+uint32_t **safe_table_new(uint32_t capacity);
+
+/*
+* safe_table_grow
+* Makes entries [old_capacity, new_capacity) accessible, pointing at the trap
+* Arguments:
+*   - table - a table from safe_table_new
+*   - old_capacity, new_capacity - the accessible entries before and after
+* Return: void
+*/
+void safe_table_grow(uint32_t **table, uint32_t old_capacity,
+                     uint32_t new_capacity);
+
+/*
+* safe_table_free
+* Releases a table from safe_table_new
+* Arguments:
+*   - table - the table to release
+* Return: void
+*/
+void safe_table_free(uint32_t **table);
+
+/*
+* safe_words_new
+* Maps zeroed words whose last word ends exactly at a guard page, as the
+* decoded form of m[0] is, so that fetching past its end faults
+* Arguments:
+*   - length - the number of words
+* Return: the first word, or NULL if the kernel refused another mapping
+*/
+uint32_t *safe_words_new(uint32_t length);
+
+/*
+* safe_words_free
+* Unmaps words from safe_words_new, along with their guard page
+* Arguments:
+*   - words - the words to unmap
+*   - length - the number of words it was mapped with
+* Return: void
+*/
+void safe_words_free(uint32_t *words, uint32_t length);
+
+/*
+* safe_fault
+* Reports a fault the engine caught itself at the current instruction,
+* with the UM state as the fault handlers print it, and exits
+* Arguments:
+*   - kind - what went wrong
+* Return: does not return
+*/
+void safe_fault(const char *kind) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,561 @@
+/*
+*   um_serve.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_serve. The server process
+*   accepts connections and reads each program name as its bytes arrive,
+*   polling every connection still naming its program alongside the
+*   listening socket, so a client slow to name one holds up no other job.
+*   Once a name is complete, the server answers with the status byte and
+*   hands the connection itself, with the time it was accepted, to the
+*   program's loader process over a datagram socket pair. Every waiting machine of that program
+*   blocks receiving on the other end, so the kernel gives each job to one
+*   of them and queues jobs while all are busy. A machine runs each job
+*   with the connection as its stdin and stdout, sends its start and end
+*   times back to the server on a second socket pair, and resets itself to
+*   the loaded state for the next job, releasing its segments from the
+*   pool at once. Only when a machine exits, as one that faults in safe
+*   mode does, the loader forks a fresh copy of the loaded machine in its
+*   place.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "um_serve.h"
+
+// Longest program name a job may give
+#define MAX_NAME 255
+
+// Connections waiting to be accepted, and accepted connections still
+// naming their program, which are dropped after NAME_TIMEOUT_MS
+#define BACKLOG 64
+#define MAX_NAMING 64
+#define NAME_TIMEOUT_MS 10000
+
+/*
+* Job_times struct that a machine reports for each job, in nanoseconds of
+* CLOCK_MONOTONIC
+*/
+typedef struct Job_times {
+    uint64_t accepted;
+    uint64_t started;
+    uint64_t finished;
+} Job_times;
+
+/*
+* Latencies struct that collects one kind of latency over all jobs
+*/
+typedef struct Latencies {
+    uint64_t *samples;
+    size_t count;
+    size_t capacity;
+} Latencies;
+
+/*
+* Naming struct, an accepted connection whose program name is still being
+* read
+*/
+typedef struct Naming {
+    int connection;
+    uint64_t accepted;
+    size_t length;
+    char name[MAX_NAME + 1];
+} Naming;
+
+/*
+* What read_name found
+*/
+typedef enum Name_status {
+    NAME_READ,      // the whole line is in
+    NAME_PENDING,   // more of it is still to come
+    NAME_FAILED     // the connection closed, or the name is too long
+} Name_status;
+
+static volatile sig_atomic_t stopping = 0;
+
+static uint64_t now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static void stop(int signo)
+{
+    (void) signo;
+    stopping = 1;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash == NULL ? path : slash + 1;
+}
+
+/*
+* send_job, receive_job
+* Pass a connection and the time it was accepted across a socket pair
+*/
+static bool send_job(int channel, int connection, uint64_t accepted)
+{
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec data = { .iov_base = &accepted,
+                          .iov_len = sizeof(accepted) };
+    struct msghdr message = { .msg_iov = &data, .msg_iovlen = 1,
+                              .msg_control = control,
+                              .msg_controllen = sizeof(control) };
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &connection, sizeof(int));
+    return sendmsg(channel, &message, 0) == sizeof(accepted);
+}
+
+static int receive_job(int channel, uint64_t *accepted)
+{
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec data = { .iov_base = accepted,
+                          .iov_len = sizeof(*accepted) };
+    struct msghdr message = { .msg_iov = &data, .msg_iovlen = 1,
+                              .msg_control = control,
+                              .msg_controllen = sizeof(control) };
+    if (recvmsg(channel, &message, 0) != sizeof(*accepted)) {
+        return -1;
+    }
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == NULL || header->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int connection;
+    memcpy(&connection, CMSG_DATA(header), sizeof(int));
+    return connection;
+}
+
+/*
+* run_machine
+* Runs jobs on the loaded machine one after another, reporting the times of
+* each and resetting the machine after it
+*/
+static void run_machine(int jobs, int reports)
+{
+    while (true) {
+        Job_times times;
+        int connection = receive_job(jobs, &times.accepted);
+        if (connection < 0) {
+            exit(EXIT_FAILURE);
+        }
+        times.started = now();
+        dup2(connection, STDIN_FILENO);
+        dup2(connection, STDOUT_FILENO);
+        close(connection);
+
+        // Nothing read ahead from the last job's input may leak into this
+        __fpurge(stdin);
+        clearerr(stdin);
+        clearerr(stdout);
+
+        run_loaded();
+        fflush(stdout);
+        shutdown(STDOUT_FILENO, SHUT_RDWR);
+
+        times.finished = now();
+        send(reports, &times, sizeof(times), 0);
+        reset_um(false);
+    }
+}
+
+/*
+* run_loader
+* Loads a program and keeps SERVE_POOL forked copies of it waiting for jobs
+*/
+static void run_loader(const char *path, const Um_options *options,
+                       int jobs, int reports)
+{
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    Um_options pooled = *options;
+    pooled.pool = true;
+    load_um(fp, &pooled);
+    fclose(fp);
+
+    // Replace each machine that exits
+    unsigned num_machines = 0;
+    while (true) {
+        for (; num_machines < SERVE_POOL; num_machines++) {
+            pid_t machine = fork();
+            assert(machine >= 0);
+            if (machine == 0) {
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+                run_machine(jobs, reports);
+            }
+        }
+        if (wait(NULL) > 0) {
+            num_machines--;
+        }
+    }
+}
+
+static void add_latency(Latencies *latencies, uint64_t sample)
+{
+    if (latencies->count == latencies->capacity) {
+        latencies->capacity = latencies->capacity == 0 ?
+                              1024 : 2 * latencies->capacity;
+        latencies->samples = realloc(latencies->samples,
+                                     latencies->capacity *
+                                     sizeof(*latencies->samples));
+        assert(latencies->samples != NULL);
+    }
+    latencies->samples[latencies->count++] = sample;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+* percentile
+* Return: the p-th percentile of count sorted samples by nearest rank: the
+*         smallest sample no lower than p percent of them
+*/
+static uint64_t percentile(const uint64_t *sorted, size_t count, unsigned p)
+{
+    return sorted[(p * count + 99) / 100 - 1];
+}
+
+/*
+* report_latencies
+* Prints the 50th, 90th, 99th percentile and the largest of some
+* latencies, in microseconds
+*/
+static void report_latencies(FILE *out, const char *kind,
+                             Latencies *latencies)
+{
+    size_t count = latencies->count;
+    if (count == 0) {
+        fprintf(out, "%-6s no jobs\n", kind);
+        return;
+    }
+    qsort(latencies->samples, count, sizeof(uint64_t), compare_samples);
+    const uint64_t *sorted = latencies->samples;
+    fprintf(out, "%-6s p50 %.1f p90 %.1f p99 %.1f max %.1f us over %zu "
+                 "jobs\n", kind,
+            percentile(sorted, count, 50) / 1000.0,
+            percentile(sorted, count, 90) / 1000.0,
+            percentile(sorted, count, 99) / 1000.0,
+            sorted[count - 1] / 1000.0, count);
+}
+
+static void report(FILE *out, Latencies *queued, Latencies *ran)
+{
+    report_latencies(out, "queue", queued);
+    report_latencies(out, "run", ran);
+}
+
+/*
+* read_name
+* Reads as much of the program name line of a job as has arrived, without
+* waiting. Bytes are peeked first so that none past the newline, which are
+* the job's input, is taken from the connection.
+*/
+static Name_status read_name(Naming *naming)
+{
+    char *next = naming->name + naming->length;
+    ssize_t got = recv(naming->connection, next,
+                       sizeof(naming->name) - naming->length,
+                       MSG_PEEK | MSG_DONTWAIT);
+    if (got < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ?
+               NAME_PENDING : NAME_FAILED;
+    }
+    if (got == 0) {
+        return NAME_FAILED;
+    }
+
+    char *newline = memchr(next, '\n', got);
+    size_t take = newline != NULL ? (size_t) (newline - next) + 1 :
+                                    (size_t) got;
+    if (recv(naming->connection, next, take, MSG_DONTWAIT) !=
+        (ssize_t) take) {
+        return NAME_FAILED;
+    }
+    naming->length += take;
+    if (newline != NULL) {
+        *newline = '\0';
+        return NAME_READ;
+    }
+    return naming->length < sizeof(naming->name) ? NAME_PENDING :
+                                                    NAME_FAILED;
+}
+
+/*
+* answer
+* Writes the status byte of a job, which a fresh connection always has
+* room for
+*/
+static void answer(int connection, char status)
+{
+    send(connection, &status, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/*
+* start_job
+* Hands a job whose name has been read to a machine of its program, or
+* answers a request for the latency report, or refuses the job
+*/
+static void start_job(const Naming *naming, char **paths, int num_paths,
+                      const int *jobs, Latencies *queued, Latencies *ran)
+{
+    for (int i = 0; i < num_paths; i++) {
+        if (strcmp(naming->name, base_name(paths[i])) == 0) {
+            answer(naming->connection, JOB_ACCEPTED);
+            send_job(jobs[i], naming->connection, naming->accepted);
+            return;
+        }
+    }
+    if (strcmp(naming->name, "stats") == 0) {
+        answer(naming->connection, JOB_ACCEPTED);
+        FILE *out = fdopen(dup(naming->connection), "w");
+        if (out != NULL) {
+            report(out, queued, ran);
+            fclose(out);
+        }
+        return;
+    }
+    answer(naming->connection, JOB_REFUSED);
+    dprintf(naming->connection, "um: no program named %s\n", naming->name);
+}
+
+/*
+* listen_on
+* Creates a stream socket listening at path
+* Return: the socket, or -1
+*/
+static int listen_on(const char *path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(listener, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+        listen(listener, BACKLOG) < 0) {
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+bool serve(const char *socket_path, char **paths, int num_paths,
+           const Um_options *options)
+{
+    int listener = listen_on(socket_path);
+    if (listener < 0) {
+        fprintf(stderr, "Cannot listen on %s.\n", socket_path);
+        return false;
+    }
+
+    // Machines report the times of their jobs here
+    int report_pair[2];
+    int status = socketpair(AF_UNIX, SOCK_DGRAM, 0, report_pair);
+    assert(status == 0);
+    (void) status;
+
+    // A loader process per program, each with its own job channel
+    int *jobs = malloc(num_paths * sizeof(*jobs));
+    pid_t *loaders = malloc(num_paths * sizeof(*loaders));
+    assert(jobs != NULL && loaders != NULL);
+    fflush(stdout);
+    for (int i = 0; i < num_paths; i++) {
+        int job_pair[2];
+        status = socketpair(AF_UNIX, SOCK_DGRAM, 0, job_pair);
+        assert(status == 0);
+        loaders[i] = fork();
+        assert(loaders[i] >= 0);
+        if (loaders[i] == 0) {
+            close(listener);
+            close(job_pair[0]);
+            close(report_pair[0]);
+            run_loader(paths[i], options, job_pair[1], report_pair[1]);
+        }
+        close(job_pair[1]);
+        jobs[i] = job_pair[0];
+    }
+    close(report_pair[1]);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    Latencies queued = { NULL, 0, 0 }, ran = { NULL, 0, 0 };
+    Naming naming[MAX_NAMING];
+    int num_naming = 0;
+    struct pollfd events[2 + MAX_NAMING];
+    while (!stopping) {
+        // Accept no more connections while MAX_NAMING are still naming
+        // their programs; wake up for the first of them to time out
+        events[0] = (struct pollfd) { .fd = num_naming < MAX_NAMING ?
+                                            listener : -1,
+                                      .events = POLLIN };
+        events[1] = (struct pollfd) { .fd = report_pair[0],
+                                      .events = POLLIN };
+        int timeout = -1;
+        for (int i = 0; i < num_naming; i++) {
+            events[2 + i] = (struct pollfd) { .fd = naming[i].connection,
+                                              .events = POLLIN };
+            uint64_t waited = (now() - naming[i].accepted) / 1000000;
+            int left = waited < NAME_TIMEOUT_MS ?
+                       (int) (NAME_TIMEOUT_MS - waited) : 0;
+            if (timeout < 0 || left < timeout) {
+                timeout = left;
+            }
+        }
+        if (poll(events, 2 + num_naming, timeout) < 0) {
+            continue;
+        }
+
+        // Collect the times of finished jobs
+        if (events[1].revents & POLLIN) {
+            Job_times times;
+            if (recv(report_pair[0], &times, sizeof(times), 0) ==
+                sizeof(times)) {
+                add_latency(&queued, times.started - times.accepted);
+                add_latency(&ran, times.finished - times.started);
+            }
+        }
+
+        // Read what has arrived of each name, and start each job named;
+        // a connection is dropped once named, failed or timed out
+        int kept = 0;
+        for (int i = 0; i < num_naming; i++) {
+            Name_status status = NAME_PENDING;
+            if (events[2 + i].revents != 0) {
+                status = read_name(&naming[i]);
+            }
+            if (status == NAME_READ) {
+                start_job(&naming[i], paths, num_paths, jobs, &queued, &ran);
+            }
+            if (status == NAME_PENDING && (now() - naming[i].accepted) /
+                                          1000000 < NAME_TIMEOUT_MS) {
+                naming[kept++] = naming[i];
+            } else {
+                close(naming[i].connection);
+            }
+        }
+        num_naming = kept;
+
+        // Take a new connection to read the name of
+        if (events[0].revents & POLLIN) {
+            int connection = accept(listener, NULL, NULL);
+            if (connection >= 0) {
+                naming[num_naming++] = (Naming) { .connection = connection,
+                                                  .accepted = now(),
+                                                  .length = 0 };
+            }
+        }
+    }
+
+    report(stderr, &queued, &ran);
+    for (int i = 0; i < num_naming; i++) {
+        close(naming[i].connection);
+    }
+    for (int i = 0; i < num_paths; i++) {
+        kill(loaders[i], SIGTERM);
+        waitpid(loaders[i], NULL, 0);
+        close(jobs[i]);
+    }
+    close(listener);
+    unlink(socket_path);
+    free(jobs);
+    free(loaders);
+    free(queued.samples);
+    free(ran.samples);
+    return true;
+}
+
+bool submit_job(const char *socket_path, const char *program)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strcpy(address.sun_path, socket_path);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 ||
+        connect(server, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        fprintf(stderr, "Cannot connect to %s.\n", socket_path);
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    dprintf(server, "%s\n", program);
+
+    // Send stdin and copy the output back as it comes, until the server
+    // closes the connection. The first byte back is the status of the job;
+    // a refused job is followed by the reason, for stderr.
+    struct pollfd events[2] = { { .fd = server, .events = POLLIN },
+                                { .fd = STDIN_FILENO, .events = POLLIN } };
+    int num_events = 2;
+    char buffer[4096];
+    int status = -1;
+    while (true) {
+        if (poll(events, num_events, -1) < 0) {
+            continue;
+        }
+        if (num_events == 2 && (events[1].revents & (POLLIN | POLLHUP))) {
+            ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (length <= 0 || write(server, buffer, length) != length) {
+                shutdown(server, SHUT_WR);
+                num_events = 1;
+            }
+        }
+        if (events[0].revents & (POLLIN | POLLHUP)) {
+            ssize_t length = read(server, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            char *output = buffer;
+            if (status < 0) {
+                status = *output++;
+                length--;
+            }
+            int out = status == JOB_ACCEPTED ? STDOUT_FILENO : STDERR_FILENO;
+            if (write(out, output, length) != length) {
+                break;
+            }
+        }
+    }
+    close(server);
+    if (status < 0) {
+        fprintf(stderr, "The server at %s closed the job without running "
+                        "it.\n", socket_path);
+    }
+    return status == JOB_ACCEPTED;
+}
@@ -0,0 +1,61 @@
+/*
+*   um_serve.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_serve, a job server on a Unix
+*   domain socket and the client that submits jobs to it. The server loads
+*   each of its programs once, into a process of its own that keeps a pool
+*   of forked copies of the loaded machine waiting for jobs, so a job pays
+*   for neither process start-up nor loading. A job names a program and
+*   sends its input; the machine reads the input straight from the
+*   connection and streams its output back on it.
+*
+*   Protocol, on a stream connection: the client writes the program's name
+*   (the base name of its file) and a newline, then the input, then shuts
+*   down its side for writing. The server answers with a status byte:
+*   JOB_ACCEPTED followed by the output, or JOB_REFUSED followed by the
+*   reason, and closes. The name "stats" gets a report of the queueing and
+*   run latency percentiles of the jobs run so far instead of output.
+*/
+
+#ifndef UM_SERVE_INCLUDED
+#define UM_SERVE_INCLUDED
+
+#include <stdbool.h>
+#include "um_engine.h"
+
+/*
+* Machines each program keeps loaded and waiting
+*/
+#define SERVE_POOL 4
+
+/*
+* Status bytes the server answers a job with
+*/
+#define JOB_ACCEPTED '+'
+#define JOB_REFUSED '-'
+
+/*
+* serve
+* Serves jobs for the given programs on a socket until SIGINT or SIGTERM,
+* then prints the latency report to stderr
+* Arguments:
+*   - socket_path - where to create the socket; any file there is replaced
+*   - paths, num_paths - the um instruction files to serve
+*   - options - the engine options every job runs with
+* Return: whether the server could start
+*/
+bool serve(const char *socket_path, char **paths, int num_paths,
+           const Um_options *options);
+
+/*
+* submit_job
+* Runs a job on a server, with stdin as its input and stdout as its output
+* Arguments:
+*   - socket_path - the server's socket
+*   - program - the name of the program, or "stats"
+* Return: whether the server accepted the job and it ran to the end
+*/
+bool submit_job(const char *socket_path, const char *program);
+
+#endif
@@ -0,0 +1,334 @@
+/*
+*   um_spill.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_spill. Segments start out on
+*   the heap. Whenever mapping a segment would push heap-resident segment
+*   memory over the budget, a clock sweep over the segment table evicts
+*   segments whose referenced bit (set by SLOAD/SSTORE on a lookup cache miss)
+*   has stayed clear since the last sweep. An evicted segment is written to
+*   its own extent of a sparse backing file and its table entry is replaced by
+*   a shared file mapping of that extent, so the engine keeps dereferencing it
+*   without any check and the kernel pages it in and out on demand.
+*
+*   Only segments of at least one page are spilled; smaller ones would waste a
+*   page of file and a kernel mapping each.
+*
+*   The extent of a spilled segment that is unmapped is punched out of the
+*   file and kept on a free list, and the next extent is carved from the first
+*   free one large enough before the file grows, so a program that maps and
+*   unmaps large segments keeps its file as large as what it holds at once.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "um_spill.h"
+
+/*
+* Where each segment id's words currently live
+*/
+typedef enum Spill_state {
+    SPILL_NONE = 0, SPILL_HEAP, SPILL_FILE
+} Spill_state;
+
+typedef struct Spill_entry {
+    uint8_t state;
+    off_t offset;
+} Spill_entry;
+
+/*
+* A punched-out extent of the backing file, free for reuse
+*/
+typedef struct Spill_extent {
+    off_t offset;
+    size_t bytes;
+} Spill_extent;
+
+static UM *spill_um = NULL;
+static int fd = -1;
+static size_t page_size = 0;
+static size_t budget = 0;
+static size_t resident = 0;
+static off_t file_end = 0;
+static uint32_t clock_hand = 1;
+static bool mappings_exhausted = false;
+
+static Spill_entry *entries = NULL;
+static uint32_t entries_capacity = 0;
+
+static Spill_extent *free_extents = NULL;
+static uint32_t num_free_extents = 0;
+static uint32_t free_extents_capacity = 0;
+
+static inline size_t round_to_page(size_t bytes)
+{
+    return (bytes + page_size - 1) & ~(page_size - 1);
+}
+
+static inline size_t segment_bytes(uint32_t length)
+{
+    return (size_t) length * sizeof(uint32_t);
+}
+
+/*
+* entry
+* Returns the bookkeeping for id, growing the entry array to cover it
+*/
+static Spill_entry *entry(uint32_t id)
+{
+    if (id >= entries_capacity) {
+        uint32_t old_capacity = entries_capacity;
+        entries_capacity = entries_capacity == 0 ? 1024 : entries_capacity;
+        while (entries_capacity <= id) {
+            entries_capacity *= 2;
+        }
+        entries = realloc(entries, entries_capacity * sizeof(*entries));
+        assert(entries != NULL);
+        memset(entries + old_capacity, 0,
+               (entries_capacity - old_capacity) * sizeof(*entries));
+    }
+    return &entries[id];
+}
+
+/*
+* extent_bytes
+* Returns the bytes of the extent that holds length words
+*/
+static inline size_t extent_bytes(uint32_t length)
+{
+    size_t bytes = round_to_page(segment_bytes(length));
+    return bytes == 0 ? page_size : bytes;
+}
+
+/*
+* take_extent
+* Carves bytes out of the first free extent large enough, leaving the rest
+* of it free; returns whether one was found
+*/
+static bool take_extent(size_t bytes, off_t *offset)
+{
+    for (uint32_t i = 0; i < num_free_extents; i++) {
+        Spill_extent *extent = &free_extents[i];
+        if (extent->bytes < bytes) {
+            continue;
+        }
+        *offset = extent->offset;
+        extent->offset += bytes;
+        extent->bytes -= bytes;
+        if (extent->bytes == 0) {
+            *extent = free_extents[--num_free_extents];
+        }
+        return true;
+    }
+    return false;
+}
+
+/*
+* give_extent
+* Returns a punched-out extent to the free list, or to the end of the file
+* if it is the last one
+*/
+static void give_extent(off_t offset, size_t bytes)
+{
+    if (offset + (off_t) bytes == file_end) {
+        file_end = offset;
+        return;
+    }
+    if (num_free_extents == free_extents_capacity) {
+        free_extents_capacity = free_extents_capacity == 0 ?
+                                64 : 2 * free_extents_capacity;
+        free_extents = realloc(free_extents, free_extents_capacity *
+                                             sizeof(*free_extents));
+        assert(free_extents != NULL);
+    }
+    free_extents[num_free_extents++] = (Spill_extent) { offset, bytes };
+}
+
+/*
+* map_extent
+* Reserves a page-aligned extent of the backing file for length words, a
+* free one if there is one large enough, and maps it shared; returns NULL if
+* no mapping could be made. The extent reads as zeros, being either past the
+* old end of the file or punched out.
+*/
+static uint32_t *map_extent(uint32_t length, off_t *offset)
+{
+    size_t bytes = extent_bytes(length);
+    off_t start;
+    bool reused = take_extent(bytes, &start);
+    if (!reused) {
+        start = file_end;
+        if (ftruncate(fd, file_end + bytes) != 0) {
+            return NULL;
+        }
+    }
+    uint32_t *words = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           fd, start);
+    if (words == MAP_FAILED) {
+        if (reused) {
+            give_extent(start, bytes);
+        }
+        if (!mappings_exhausted) {
+            fprintf(stderr, "um: could not map spilled segment, keeping "
+                            "remaining segments on the heap\n");
+            mappings_exhausted = true;
+        }
+        return NULL;
+    }
+    *offset = start;
+    if (!reused) {
+        file_end += bytes;
+    }
+    return words;
+}
+
+/*
+* evict
+* Moves heap segment id into the backing file; returns whether it moved
+*/
+static bool evict(uint32_t id)
+{
+    uint32_t length = spill_um->lengths[id];
+    off_t offset;
+    uint32_t *mapped = map_extent(length, &offset);
+    if (mapped == NULL) {
+        return false;
+    }
+
+    // Copy through the shared mapping; the kernel writes it back lazily
+    memcpy(mapped, spill_um->words[id], segment_bytes(length));
+    free(spill_um->words[id]);
+    spill_um->words[id] = mapped;
+    if (spill_um->cached_id == id) {
+        spill_um->cached_words = mapped;
+    }
+
+    Spill_entry *e = entry(id);
+    e->state = SPILL_FILE;
+    e->offset = offset;
+    resident -= segment_bytes(length);
+    return true;
+}
+
+/*
+* sweep
+* Runs the clock until needed more bytes fit under the budget or two full
+* revolutions found nothing more to evict. Segment 0 is never spilled since
+* the engine holds on to its instruction pointer.
+*/
+static void sweep(size_t needed)
+{
+    uint32_t min_length = page_size / sizeof(uint32_t);
+    uint64_t steps = 2 * (uint64_t) spill_um->num_segments;
+
+    for (uint64_t i = 0; i < steps && resident + needed > budget &&
+                         !mappings_exhausted; i++) {
+        if (clock_hand >= spill_um->num_segments) {
+            clock_hand = 1;
+            continue;
+        }
+        uint32_t id = clock_hand++;
+        if (id >= entries_capacity || entries[id].state != SPILL_HEAP ||
+            spill_um->lengths[id] < min_length) {
+            continue;
+        }
+        if (spill_um->referenced[id] || spill_um->cached_id == id) {
+            spill_um->referenced[id] = 0;
+            continue;
+        }
+        evict(id);
+    }
+}
+
+void spill_init(UM *um, size_t spill_budget, const char *path)
+{
+    spill_um = um;
+    budget = spill_budget;
+    page_size = sysconf(_SC_PAGESIZE);
+
+    if (path != NULL) {
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    } else {
+        char template[] = "/tmp/um-spill-XXXXXX";
+        fd = mkstemp(template);
+        if (fd >= 0) {
+            unlink(template);
+        }
+    }
+    if (fd < 0) {
+        perror("um: could not open spill file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+uint32_t *spill_words_new(uint32_t id, uint32_t length)
+{
+    size_t bytes = segment_bytes(length);
+    Spill_entry *e = entry(id);
+
+    if (resident + bytes > budget) {
+        sweep(bytes);
+    }
+
+    uint32_t *words = calloc(length, sizeof(uint32_t));
+    if (words == NULL && length > 0) {
+        // Out of heap: spill everything we can and try once more
+        sweep(SIZE_MAX - resident);
+        words = calloc(length, sizeof(uint32_t));
+    }
+    if (words == NULL && length > 0) {
+        // Still nothing: the new segment lives in the file from the start
+        words = map_extent(length, &e->offset);
+        if (words == NULL) {
+            fprintf(stderr, "um: out of memory mapping %" PRIu32
+                            " words\n", length);
+            exit(EXIT_FAILURE);
+        }
+        e->state = SPILL_FILE;
+        return words;
+    }
+
+    e->state = SPILL_HEAP;
+    resident += bytes;
+    return words;
+}
+
+void spill_words_free(uint32_t id)
+{
+    Spill_entry *e = entry(id);
+    uint32_t length = spill_um->lengths[id];
+
+    if (e->state == SPILL_FILE) {
+        size_t bytes = extent_bytes(length);
+        munmap(spill_um->words[id], bytes);
+
+        // Give the extent's blocks back so the file stays sparse, and the
+        // extent itself for the next segment spilled once it reads as zeros
+        if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      e->offset, bytes) == 0) {
+            give_extent(e->offset, bytes);
+        }
+    } else {
+        free(spill_um->words[id]);
+        resident -= segment_bytes(length);
+    }
+    e->state = SPILL_NONE;
+}
+
+void spill_finish()
+{
+    close(fd);
+    free(entries);
+    free(free_extents);
+    entries = NULL;
+    entries_capacity = 0;
+    free_extents = NULL;
+    num_free_extents = free_extents_capacity = 0;
+}
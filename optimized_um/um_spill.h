@@ -0,0 +1,59 @@
+/*
+*   um_spill.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_spill, a segment memory backend
+*   that keeps resident segment memory under a budget by moving cold segments
+*   into a sparse backing file and mapping them back with file-backed mmap
+*/
+
+#ifndef UM_SPILL_INCLUDED
+#define UM_SPILL_INCLUDED
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "um_util.h"
+
+/*
+* spill_init
+* Opens the backing file and starts accounting resident segment memory
+* Arguments:
+*   - um - the machine whose segments are managed
+*   - budget - bytes of heap-resident segment memory allowed before spilling
+*   - path - the backing file to create, or NULL for an unlinked temp file
+* Return: void
+*/
+void spill_init(UM *um, size_t budget, const char *path);
+
+/*
+* spill_words_new
+* Allocates zeroed words for segment id, first spilling cold segments if the
+* allocation would exceed the budget. If the heap is exhausted the segment
+* is placed in the backing file directly rather than failing.
+* Arguments:
+*   - id - the id the words will be stored under
+*   - length - the number of words in the segment
+* Return: the first word of the segment
+*/
+uint32_t *spill_words_new(uint32_t id, uint32_t length);
+
+/*
+* spill_words_free
+* Releases the words of segment id, punching its extent out of the backing
+* file if it was spilled
+* Arguments:
+*   - id - the segment to release; um->words[id] and um->lengths[id] must
+*          still describe it
+* Return: void
+*/
+void spill_words_free(uint32_t id);
+
+/*
+* spill_finish
+* Closes the backing file and frees the bookkeeping of spilled segments
+* Arguments: None
+* Return: void
+*/
+void spill_finish();
+
+#endif
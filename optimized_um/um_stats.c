@@ -0,0 +1,183 @@
+/*
+*   um_stats.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_stats. The page is a mapping
+*   of the file shared with every reader, so publishing a statistic is an
+*   ordinary store. The file is unlinked and created afresh by each run,
+*   so a reader still mapping the last run's file is never cut short.
+*
+*   The SIGUSR1 handler formats the page with snprintf and writes it with
+*   write, as safe mode's fault report does, and is installed to restart
+*   the input it may interrupt.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "um_stats.h"
+
+static Um_stats *page = NULL;
+
+// The instructions and time of the last report, for the rate since
+static uint64_t last_instructions;
+static uint64_t last_ns;
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+* format_stats
+* Writes a line reporting a page into report, with the instructions per
+* second since the last report
+* Return: the length of the line
+*/
+static size_t format_stats(char *report, size_t size, const Um_stats *stats)
+{
+    uint64_t now = monotonic_ns();
+    uint64_t instructions = stats->instructions;
+    double rate = now > last_ns ?
+                  (instructions - last_instructions) * 1e3 / (now - last_ns) :
+                  0;
+    last_instructions = instructions;
+    last_ns = now;
+
+    int n = snprintf(report, size,
+                     "um %" PRIu32 ": %.1f s, %" PRIu64 " instructions "
+                     "(%.1f M/s), %" PRIu64 " segments (%.1f MiB), %" PRIu64
+                     " unmapped ids, %" PRIu64 " load programs, %" PRIu64
+                     " bytes in, %" PRIu64 " bytes out",
+                     stats->pid, (now - stats->start_ns) / 1e9, instructions,
+                     rate, stats->segments,
+                     stats->mapped_bytes / (1024.0 * 1024.0),
+                     stats->unmapped_ids, stats->load_programs,
+                     stats->input_bytes, stats->output_bytes);
+    if (n >= 0 && (size_t) n < size && stats->compactions != 0) {
+        n += snprintf(report + n, size - n,
+                      ", %" PRIu64 " compactions (fragmentation %.2f -> "
+                      "%.2f)", stats->compactions,
+                      stats->fragmentation_before,
+                      stats->fragmentation_after);
+    }
+    const uint64_t *looped = stats->loop_instructions;
+    if (n >= 0 && (size_t) n < size &&
+        (looped[0] != 0 || looped[1] != 0 || looped[2] != 0)) {
+        n += snprintf(report + n, size - n,
+                      ", loop idioms removed %" PRIu64 " copy, %" PRIu64
+                      " fill and %" PRIu64 " compare instructions",
+                      looped[0], looped[1], looped[2]);
+    }
+    if (n >= 0 && (size_t) n < size) {
+        n += snprintf(report + n, size - n, "%s\n",
+                      stats->halted ? ", halted" : "");
+    }
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t) n < size ? (size_t) n : size - 1;
+}
+
+/*
+* report_stats
+* Signal handler that prints the page to stderr
+*/
+static void report_stats(int signo)
+{
+    (void) signo;
+    int saved_errno = errno;
+    char report[512];
+    size_t n = format_stats(report, sizeof(report), page);
+    ssize_t written = write(STDERR_FILENO, report, n);
+    (void) written;
+    errno = saved_errno;
+}
+
+Um_stats *stats_start(const char *path)
+{
+    unlink(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(Um_stats)) != 0) {
+        fprintf(stderr, "um: could not create the statistics %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    page = mmap(NULL, sizeof(Um_stats), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        fprintf(stderr, "um: could not map the statistics %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    // The file is zeroed, and so is every count
+    page->magic = STATS_MAGIC;
+    page->version = STATS_VERSION;
+    page->pid = getpid();
+    page->start_ns = monotonic_ns();
+    last_ns = page->start_ns;
+
+    struct sigaction action;
+    action.sa_handler = report_stats;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+    return page;
+}
+
+void stats_finish()
+{
+    if (page == NULL) {
+        return;
+    }
+    signal(SIGUSR1, SIG_IGN);
+    munmap(page, sizeof(Um_stats));
+    page = NULL;
+}
+
+bool watch_stats(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 ||
+        (size_t) status.st_size < sizeof(Um_stats)) {
+        fprintf(stderr, "um: could not open the statistics %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    const Um_stats *stats = mmap(NULL, sizeof(Um_stats), PROT_READ,
+                                 MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED || stats->magic != STATS_MAGIC ||
+        stats->version != STATS_VERSION) {
+        fprintf(stderr, "um: %s holds no statistics\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    // The first rate is over the whole run so far
+    last_instructions = 0;
+    last_ns = stats->start_ns;
+    struct timespec second = { 1, 0 };
+    char report[512];
+    while (true) {
+        bool halted = stats->halted;
+        fwrite(report, 1, format_stats(report, sizeof(report), stats),
+               stdout);
+        fflush(stdout);
+        if (halted) {
+            return true;
+        }
+        if (kill(stats->pid, 0) != 0 && errno == ESRCH && !stats->halted) {
+            printf("um %" PRIu32 ": exited without halting\n", stats->pid);
+            return false;
+        }
+        nanosleep(&second, NULL);
+    }
+}
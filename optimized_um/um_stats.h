@@ -0,0 +1,90 @@
+/*
+*   um_stats.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_stats, which publishes live
+*   statistics of a running machine in a page of shared memory: a file,
+*   best kept in /dev/shm, that any process can map and read while the
+*   machine runs, as watch_stats does. The machine also prints them to
+*   stderr whenever it receives SIGUSR1.
+*
+*   The engine updates the page only where it is cheap: the instruction
+*   count at each block entry, which every load program is, as run_for
+*   counts its budget; the segment counts at each map and unmap; the I/O
+*   counts at each input and output. A reader may see one field updated
+*   and not yet the next, and the instruction count lags by the
+*   instructions run since the last block entry. With -c, the compactor
+*   publishes the fragmentation ratio, resident over live segment bytes,
+*   before and after each pass it finishes. With -O, the engine counts
+*   the dynamic instructions each kind of loop idiom ran in bulk.
+*/
+
+#ifndef UM_STATS_INCLUDED
+#define UM_STATS_INCLUDED
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define STATS_MAGIC 0x53544d55
+#define STATS_VERSION 2
+
+/*
+* Um_stats struct, the layout of the page
+*/
+typedef struct Um_stats {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t halted;            // set by the engine once it halts
+
+    // CLOCK_MONOTONIC, in nanoseconds, when the machine started
+    uint64_t start_ns;
+
+    uint64_t instructions;
+    uint64_t segments;          // mapped, besides m[0]
+    uint64_t mapped_bytes;      // in those segments
+    uint64_t unmapped_ids;      // ids waiting to be reused
+    uint64_t load_programs;     // copies of another segment into m[0]
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+
+    // Compaction passes finished, and the ratios around the last of them
+    uint64_t compactions;
+    double fragmentation_before;
+    double fragmentation_after;
+
+    // Instructions loop idioms ran in bulk, by Um_loop_kind (see um_loop.h):
+    // copy, fill and compare
+    uint64_t loop_instructions[3];
+} Um_stats;
+
+/*
+* stats_start
+* Creates the page of a machine and prints it on every SIGUSR1 from now on
+* Arguments:
+*   - path - the file to share it in; any file there is replaced
+* Return: the page, for the engine to update
+*/
+Um_stats *stats_start(const char *path);
+
+/*
+* stats_finish
+* Stops printing the page on SIGUSR1 and unmaps it, leaving the file with
+* the final statistics
+* Arguments: None
+* Return: void
+*/
+void stats_finish();
+
+/*
+* watch_stats
+* Prints the statistics of the machine publishing them in a file once a
+* second, with the instructions per second since the last, until it halts
+* or exits
+* Arguments:
+*   - path - the file
+* Return: whether the machine halted
+*/
+bool watch_stats(const char *path);
+
+#endif
@@ -0,0 +1,197 @@
+/*
+*   um_tier.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_tier. Requests wait in a
+*   bounded queue guarded by a mutex, and the compiler thread sleeps on a
+*   condition variable while it is empty. Every request carries a copy of
+*   the words it is built from, so the thread never reads m[0], and the
+*   generation of m[0] it was made for, so a block finished after m[0] was
+*   replaced is never published. The table of finished blocks is only
+*   replaced with the mutex held; the engine reads its slots without it,
+*   which the atomic publish and take make safe.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "um_tier.h"
+
+/*
+* Most requests waiting to be built at once
+*/
+#define QUEUE_CAPACITY 64
+
+/*
+* Tier_job struct that represents one request: the block entered at start,
+* built from a copy of the words from start on, once the thread is done
+*/
+typedef struct Tier_job {
+    uint32_t generation;
+    uint32_t start;
+    uint32_t count;
+    Um_block *block;
+    uint32_t words[MAX_BLOCK_LENGTH];
+} Tier_job;
+
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static bool stopping = false;
+
+static Tier_job *queue[QUEUE_CAPACITY];
+static uint32_t queue_head = 0;
+static uint32_t queue_length = 0;
+
+// Which m[0] the table is for, and its finished jobs by entry pc
+static uint32_t generation = 0;
+static Tier_job **ready = NULL;
+static uint32_t ready_length = 0;
+
+/*
+* free_job
+* Frees a job and the block it built, if any
+*/
+static void free_job(Tier_job *job)
+{
+    if (job != NULL) {
+        free_block(job->block);
+    }
+    free(job);
+}
+
+/*
+* compile_jobs
+* The compiler thread: builds queued blocks until tier_finish
+*/
+static void *compile_jobs(void *unused)
+{
+    (void) unused;
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (queue_length == 0 && !stopping) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if (stopping) {
+            break;
+        }
+        Tier_job *job = queue[queue_head];
+        queue_head = (queue_head + 1) % QUEUE_CAPACITY;
+        queue_length--;
+
+        // Build without the lock so the engine can keep queueing
+        pthread_mutex_unlock(&lock);
+        job->block = optimize_block(job->words, job->count, job->start);
+        pthread_mutex_lock(&lock);
+
+        if (job->generation != generation) {
+            free_job(job);
+            continue;
+        }
+        free_job(__atomic_exchange_n(&ready[job->start], job,
+                                     __ATOMIC_RELEASE));
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+void tier_start()
+{
+    int error = pthread_create(&thread, NULL, compile_jobs, NULL);
+    if (error != 0) {
+        fprintf(stderr, "um: could not start the compiler thread: %s\n",
+                strerror(error));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+* drop_jobs
+* Frees every queued and published job; the lock must be held
+*/
+static void drop_jobs()
+{
+    for (; queue_length > 0; queue_length--) {
+        free_job(queue[queue_head]);
+        queue_head = (queue_head + 1) % QUEUE_CAPACITY;
+    }
+    for (uint32_t pc = 0; pc < ready_length; pc++) {
+        free_job(ready[pc]);
+    }
+    free(ready);
+    ready = NULL;
+    ready_length = 0;
+}
+
+void tier_reset(uint32_t length)
+{
+    pthread_mutex_lock(&lock);
+    drop_jobs();
+    generation++;
+    ready = calloc(length, sizeof(*ready));
+    assert(ready != NULL || length == 0);
+    ready_length = length;
+    pthread_mutex_unlock(&lock);
+}
+
+bool tier_request(const uint32_t *words, uint32_t count, uint32_t start)
+{
+    assert(count > 0);
+    if (count > MAX_BLOCK_LENGTH) {
+        count = MAX_BLOCK_LENGTH;
+    }
+    Tier_job *job = malloc(sizeof(*job));
+    assert(job != NULL);
+    job->start = start;
+    job->count = count;
+    job->block = NULL;
+    memcpy(job->words, words, count * sizeof(uint32_t));
+
+    pthread_mutex_lock(&lock);
+    bool queued = queue_length < QUEUE_CAPACITY;
+    if (queued) {
+        job->generation = generation;
+        queue[(queue_head + queue_length) % QUEUE_CAPACITY] = job;
+        queue_length++;
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (!queued) {
+        free(job);
+    }
+    return queued;
+}
+
+bool tier_take(uint32_t start, const uint32_t *words, Um_block **block)
+{
+    if (__atomic_load_n(&ready[start], __ATOMIC_RELAXED) == NULL) {
+        return false;
+    }
+    Tier_job *job = __atomic_exchange_n(&ready[start], NULL,
+                                        __ATOMIC_ACQUIRE);
+
+    // Stores into m[0] since the request may have changed the block's words
+    *block = job->block;
+    job->block = NULL;
+    if (memcmp(job->words, words,
+               (*block)->length * sizeof(uint32_t)) != 0) {
+        free_block(*block);
+        *block = NULL;
+    }
+    free(job);
+    return true;
+}
+
+void tier_finish()
+{
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+
+    drop_jobs();
+}
@@ -0,0 +1,71 @@
+/*
+*   um_tier.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_tier, which optimizes hot blocks
+*   of m[0] on a background compiler thread. The engine queues a copy of the
+*   words a block starts at, the thread builds the block from the copy, and
+*   publishes it into a table by entry pc with an atomic store. The engine
+*   takes it from the table at its next entry to that pc, checking that the
+*   words it was built from are still the ones in m[0].
+*/
+
+#ifndef UM_TIER_INCLUDED
+#define UM_TIER_INCLUDED
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "um_optimize.h"
+
+/*
+* tier_start
+* Starts the background compiler thread
+* Arguments: None
+* Return: void
+*/
+void tier_start();
+
+/*
+* tier_reset
+* Drops every queued and published block, since m[0] was replaced, and
+* makes an empty table for the new m[0]. Blocks still being built for the
+* old m[0] are thrown away when they finish.
+* Arguments:
+*   - length - the number of words in the new m[0]
+* Return: void
+*/
+void tier_reset(uint32_t length);
+
+/*
+* tier_request
+* Queues the block entered at start to be built in the background
+* Arguments:
+*   - words - the words of m[0] from start on, copied before returning
+*   - count - the number of words from start to the end of m[0], at least 1
+*   - start - the pc the block is entered at
+* Return: false if the queue was full and nothing was queued
+*/
+bool tier_request(const uint32_t *words, uint32_t count, uint32_t start);
+
+/*
+* tier_take
+* Takes the block built for start out of the table, if it is done
+* Arguments:
+*   - start - the pc the block is entered at
+*   - words - the words of m[0] from start on, to check the block against
+*   - block - set to the block, or to NULL if m[0] changed under it since it
+*             was requested, in which case it was freed
+* Return: false if the block is still queued or being built
+*/
+bool tier_take(uint32_t start, const uint32_t *words, Um_block **block);
+
+/*
+* tier_finish
+* Stops the compiler thread and frees every block it built that was not
+* taken
+* Arguments: None
+* Return: void
+*/
+void tier_finish();
+
+#endif
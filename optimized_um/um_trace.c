@@ -0,0 +1,178 @@
+/*
+*   um_trace.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_trace. The machine fills a
+*   ring of buffers in order and the compressing thread takes them in the
+*   same order, so two counters under one lock say which buffers are full:
+*   the machine waits only when every buffer is still being compressed.
+*   The file is a gzip stream at the fastest level, which is enough once
+*   loaded values are written as small changes, and lets the thread keep
+*   up with the machine.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "um_trace.h"
+
+/*
+* Tuning constants
+*/
+#define TRACE_BUFFERS 4
+#define TRACE_BUFFER_BYTES (1 << 20)
+
+// Room left at the end of a buffer for the longest value: a varint
+#define TRACE_SLACK 8
+
+uint8_t *trace_next = NULL;
+uint8_t *trace_end = NULL;
+uint32_t *trace_last = NULL;
+
+static uint8_t *buffers[TRACE_BUFFERS];
+static size_t lengths[TRACE_BUFFERS];
+
+// Buffers handed to the thread and buffers it has written, counted from
+// the start; buffer n of either lives at buffers[n % TRACE_BUFFERS]
+static uint64_t handed = 0;
+static uint64_t written = 0;
+static bool finishing = false;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t full = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t empty = PTHREAD_COND_INITIALIZER;
+
+static gzFile file = NULL;
+static pthread_t compressor;
+
+/*
+* put_word
+* Appends a word to the trace, little-endian
+*/
+static void put_word(uint32_t word)
+{
+    for (int i = 0; i < 4; i++) {
+        *trace_next++ = word >> (8 * i);
+    }
+    if (trace_next >= trace_end) {
+        trace_buffer_full();
+    }
+}
+
+/*
+* compress_buffers
+* Body of the compressing thread: writes out full buffers until the trace
+* is finished
+*/
+static void *compress_buffers(void *unused)
+{
+    (void) unused;
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (written == handed && !finishing) {
+            pthread_cond_wait(&full, &lock);
+        }
+        if (written == handed) {
+            break;
+        }
+        uint32_t index = written % TRACE_BUFFERS;
+        pthread_mutex_unlock(&lock);
+
+        gzwrite(file, buffers[index], lengths[index]);
+
+        pthread_mutex_lock(&lock);
+        written++;
+        pthread_cond_signal(&empty);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+void trace_start(const char *path, const uint32_t *words, uint32_t length)
+{
+    file = gzopen(path, "wb1");
+    if (file == NULL) {
+        fprintf(stderr, "um: could not create the trace %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    gzbuffer(file, 1 << 20);
+    for (int i = 0; i < TRACE_BUFFERS; i++) {
+        buffers[i] = malloc(TRACE_BUFFER_BYTES);
+        assert(buffers[i] != NULL);
+    }
+    trace_next = buffers[0];
+    trace_end = buffers[0] + TRACE_BUFFER_BYTES - TRACE_SLACK;
+    int status = pthread_create(&compressor, NULL, compress_buffers, NULL);
+    assert(status == 0);
+    (void) status;
+
+    put_word(TRACE_MAGIC);
+    put_word(TRACE_VERSION);
+    trace_program(words, length);
+}
+
+/*
+* hand_over
+* Hands the buffer being filled, however full, to the thread
+*/
+static void hand_over()
+{
+    uint32_t index = handed % TRACE_BUFFERS;
+    lengths[index] = trace_next - buffers[index];
+    pthread_mutex_lock(&lock);
+    handed++;
+    pthread_cond_signal(&full);
+    pthread_mutex_unlock(&lock);
+}
+
+void trace_buffer_full()
+{
+    hand_over();
+
+    // The next buffer in the ring must have been written out
+    pthread_mutex_lock(&lock);
+    while (handed - written == TRACE_BUFFERS) {
+        pthread_cond_wait(&empty, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    trace_next = buffers[handed % TRACE_BUFFERS];
+    trace_end = trace_next + TRACE_BUFFER_BYTES - TRACE_SLACK;
+}
+
+void trace_program(const uint32_t *words, uint32_t length)
+{
+    trace_value(length);
+    for (uint32_t i = 0; i < length; i++) {
+        put_word(words[i]);
+    }
+
+    // Loads of the new program are predicted afresh
+    free(trace_last);
+    trace_last = calloc(length + 1, sizeof(uint32_t));
+    assert(trace_last != NULL);
+}
+
+void trace_finish()
+{
+    if (file == NULL) {
+        return;
+    }
+    hand_over();
+    pthread_mutex_lock(&lock);
+    finishing = true;
+    pthread_cond_signal(&full);
+    pthread_mutex_unlock(&lock);
+    pthread_join(compressor, NULL);
+
+    gzclose(file);
+    file = NULL;
+    for (int i = 0; i < TRACE_BUFFERS; i++) {
+        free(buffers[i]);
+    }
+    free(trace_last);
+    trace_next = trace_end = NULL;
+    trace_last = NULL;
+}
@@ -0,0 +1,111 @@
+/*
+*   um_trace.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_trace, which writes a complete
+*   execution trace of a run in a compressed binary file, for umtrace to
+*   expand offline into every pc executed, its opcode, the register it
+*   writes and the segments it touches.
+*
+*   The trace holds only what the program and the register file cannot
+*   reproduce: the program itself, and then each value loaded by a
+*   segmented load, each id handed out by a map, each result of an input
+*   and the words of each program loaded from another segment, in the
+*   order the machine met them. Everything else, pcs and registers
+*   included, follows from running the same instructions on the same
+*   values, which is what umtrace does.
+*
+*   Format, after deflate: the words TRACE_MAGIC and TRACE_VERSION, then
+*   the program, then the values. Numbers are little-endian base-128
+*   varints. A program is its length followed by its words, four bytes
+*   each, little-endian. A loaded value is written as its difference from
+*   the value last loaded at the same pc of the current program (0 at
+*   first), zigzag encoded, since a load tends to see the same or nearby
+*   values each time it runs; a segment id as itself; an input as the
+*   byte read plus one, so that EOF is 0.
+*/
+
+#ifndef UM_TRACE_INCLUDED
+#define UM_TRACE_INCLUDED
+
+#include <inttypes.h>
+
+#define TRACE_MAGIC 0x52544d55
+#define TRACE_VERSION 2
+
+// The free part of the buffer being filled, short of room for the longest
+// value, and the value last loaded at each pc
+extern uint8_t *trace_next;
+extern uint8_t *trace_end;
+extern uint32_t *trace_last;
+
+/*
+* trace_start
+* Creates a trace of a program and starts the thread that compresses it
+* Arguments:
+*   - path - the file to write; any file there is replaced
+*   - words, length - the program as loaded into m[0]
+* Return: void
+*/
+void trace_start(const char *path, const uint32_t *words, uint32_t length);
+
+/*
+* trace_buffer_full
+* Hands the full buffer to the compressing thread and takes an empty one
+* Arguments: None
+* Return: void
+*/
+void trace_buffer_full();
+
+/*
+* trace_value
+* Appends a segment id, or an input plus one, to the trace
+* Arguments:
+*   - value - the number
+* Return: void
+*/
+static inline void trace_value(uint32_t value)
+{
+    while (value >= 0x80) {
+        *trace_next++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *trace_next++ = value;
+    if (trace_next >= trace_end) {
+        trace_buffer_full();
+    }
+}
+
+/*
+* trace_load
+* Appends the value of a segmented load to the trace
+* Arguments:
+*   - pc - the pc of the load
+*   - value - the value loaded
+* Return: void
+*/
+static inline void trace_load(uint32_t pc, uint32_t value)
+{
+    int32_t change = (int32_t) (value - trace_last[pc]);
+    trace_last[pc] = value;
+    trace_value(((uint32_t) change << 1) ^ (uint32_t) (change >> 31));
+}
+
+/*
+* trace_program
+* Appends a program loaded into m[0] to the trace
+* Arguments:
+*   - words, length - the program
+* Return: void
+*/
+void trace_program(const uint32_t *words, uint32_t length);
+
+/*
+* trace_finish
+* Writes out the rest of the trace and waits for the file to be complete
+* Arguments: None
+* Return: void
+*/
+void trace_finish();
+
+#endif
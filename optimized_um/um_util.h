@@ -32,20 +32,53 @@ typedef enum Um_register {
 
 /*
 * UM struct that represents the registers and segments of the simulated UM
+*
+* The segment table is kept as a structure of arrays: SLOAD/SSTORE only ever
+* touch the packed words array, while the lengths array is only consulted by
+* LOADP, teardown and the checked (UM_CHECKED) build. The referenced bits are
+* kept only when spilling, set on map and on lookup cache misses and read by
+* the spilling backend (um_spill.h).
 */
 typedef struct UM {
     uint32_t registers [NUM_REGISTERS];
     uint32_t counter;
-    Seq_T mapped;
-    Seq_T unmapped;
+
+    // Segment table, indexed by segment id
+    uint32_t **words;
+    uint32_t *lengths;
+    uint8_t *referenced;
+    uint32_t num_segments;
+    uint32_t segment_capacity;
+
+    // Stack of unmapped ids available for reuse
+    uint32_t *unmapped;
+    uint32_t num_unmapped;
+    uint32_t unmapped_capacity;
+
+    // One-entry cache of the last (id -> words) pair used by SLOAD/SSTORE
+    uint32_t cached_id;
+    uint32_t *cached_words;
+
+    // Decoded form of m[0], one entry per word (see um_decode.h)
+    struct Um_decoded *code;
+
+    // Optimized blocks by entry pc, and how many blocks cover each word
+    // (see um_optimize.h); NULL unless the optimizing tier is on
+    struct Um_block **blocks;
+    uint16_t *block_cover;
+
+    // Memory the blocks of a profile-guided layout were placed in, or NULL
+    // (see um_layout.h)
+    void *block_arena;
+
+    // Entries to each pc with no block yet, counted up to the threshold for
+    // building it in the background (see um_tier.h); NULL unless tiered
+    uint32_t *block_entries;
 } UM;
 
 /*
-* Segment struct that represents a mapped segment
+* Id that never names a mapped segment, used to invalidate the lookup cache
 */
-typedef struct Segment {
-    uint32_t length;
-    uint32_t *words;
-} *Segment;
+#define NO_SEGMENT UINT32_MAX
 
 #endif
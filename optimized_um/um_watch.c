@@ -0,0 +1,206 @@
+/*
+*   um_watch.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class implements the functions of um_watch. Each page of m[0] has a
+*   flag saying whether it is write-protected. The fault handler only claims
+*   write faults inside a protected page of m[0]; any other fault is handed
+*   back to the handler that was installed before, by reinstalling it and
+*   returning so that the faulting instruction runs again under it.
+*
+*   A program that keeps storing into pages it also runs from would fault on
+*   nearly every such store, so once any page has been opened WATCH_LIMIT
+*   times the watch stops for good: every page is opened, and the engine is
+*   told to go back to checking each store.
+*
+*   The fault handler does only what is async-signal-safe: it has the
+*   engine forget the decodings of the page, which takes plain stores, and
+*   marks the page stale in a bitmap. Everything else cached from the page,
+*   which may take freeing memory, is dropped by watch_flush, outside the
+*   handler; the engine calls it on reaching a forgotten decoding, so before
+*   it runs any word of the page, and before it enters cached code.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "um_watch.h"
+
+/*
+* The number of times a page may be opened before the watch stops
+*/
+#define WATCH_LIMIT 64
+
+static void (*forget)(uint32_t first, uint32_t count) = NULL;
+static void (*invalidate)(uint32_t first, uint32_t count) = NULL;
+static void (*stopped)() = NULL;
+static struct sigaction previous;
+static bool active = true;
+
+static size_t page_size = 0;
+static uint32_t words_per_page = 0;
+
+// The current m[0], whether each of its pages is write-protected, how many
+// times each was opened, and whether each was stored into since the last
+// flush, as any was if stale_pages is set
+static char *base = NULL;
+static uint32_t num_words = 0;
+static size_t num_pages = 0;
+static bool *protected = NULL;
+static uint32_t *opened = NULL;
+static volatile uint8_t *stale = NULL;
+static volatile sig_atomic_t stale_pages = 0;
+
+static inline size_t pages_for(uint32_t length)
+{
+    size_t bytes = (size_t) length * sizeof(uint32_t);
+    return length == 0 ? 1 : (bytes + page_size - 1) / page_size;
+}
+
+/*
+* catch_store
+* SIGSEGV handler: opens a protected page of m[0] to the faulting store
+* after forgetting the decodings of its words and marking it stale
+*/
+static void catch_store(int signo, siginfo_t *info, void *context)
+{
+    (void) context;
+    char *address = info->si_addr;
+    if (base != NULL && address >= base &&
+        address < base + num_pages * page_size) {
+        size_t page = (address - base) / page_size;
+        if (protected[page]) {
+            uint32_t first = page * words_per_page;
+            uint32_t count = num_words - first < words_per_page ?
+                             num_words - first : words_per_page;
+            forget(first, count);
+            stale[page] = 1;
+            stale_pages = 1;
+            if (++opened[page] == WATCH_LIMIT) {
+                watch_stop();
+                return;
+            }
+            int status = mprotect(base + page * page_size, page_size,
+                                  PROT_READ | PROT_WRITE);
+            assert(status == 0);
+            (void) status;
+            protected[page] = false;
+            return;
+        }
+    }
+
+    // Not ours: fault again under the previous handler
+    sigaction(signo, &previous, NULL);
+}
+
+void watch_init(void (*on_store)(uint32_t first, uint32_t count),
+                void (*on_stale)(uint32_t first, uint32_t count),
+                void (*on_stop)())
+{
+    page_size = sysconf(_SC_PAGESIZE);
+    words_per_page = page_size / sizeof(uint32_t);
+    forget = on_store;
+    invalidate = on_stale;
+    stopped = on_stop;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = catch_store;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous);
+}
+
+uint32_t *watch_words_new(uint32_t length)
+{
+    assert(base == NULL);
+    num_words = length;
+    num_pages = pages_for(length);
+    base = mmap(NULL, num_pages * page_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(base != MAP_FAILED);
+    protected = calloc(num_pages, sizeof(*protected));
+    opened = calloc(num_pages, sizeof(*opened));
+    stale = calloc(num_pages, sizeof(*stale));
+    assert(protected != NULL && opened != NULL && stale != NULL);
+    return (uint32_t *) base;
+}
+
+void watch_words_free(uint32_t *words, uint32_t length)
+{
+    assert((char *) words == base && length == num_words);
+    munmap(base, num_pages * page_size);
+    free(protected);
+    free(opened);
+    free((uint8_t *) stale);
+    base = NULL;
+    protected = NULL;
+    opened = NULL;
+    stale = NULL;
+    stale_pages = 0;
+    num_words = 0;
+    num_pages = 0;
+}
+
+void watch_range(uint32_t first, uint32_t count)
+{
+    if (!active || first >= num_words || count == 0) {
+        return;
+    }
+    uint32_t last = num_words - first < count ? num_words - 1 :
+                                                first + count - 1;
+    for (size_t page = first / words_per_page;
+         page <= last / words_per_page; page++) {
+        if (!protected[page]) {
+            int status = mprotect(base + page * page_size, page_size,
+                                  PROT_READ);
+            assert(status == 0);
+            (void) status;
+            protected[page] = true;
+        }
+    }
+}
+
+void watch_flush()
+{
+    if (!stale_pages) {
+        return;
+    }
+    stale_pages = 0;
+    for (size_t page = 0; page < num_pages; page++) {
+        if (stale[page]) {
+            stale[page] = 0;
+            uint32_t first = page * words_per_page;
+            uint32_t count = num_words - first < words_per_page ?
+                             num_words - first : words_per_page;
+            invalidate(first, count);
+        }
+    }
+}
+
+bool watch_active()
+{
+    return active;
+}
+
+void watch_stop()
+{
+    active = false;
+    if (base != NULL) {
+        int status = mprotect(base, num_pages * page_size,
+                              PROT_READ | PROT_WRITE);
+        assert(status == 0);
+        (void) status;
+        memset(protected, 0, num_pages * sizeof(*protected));
+    }
+    stopped();
+}
+
+void watch_finish()
+{
+    sigaction(SIGSEGV, &previous, NULL);
+}
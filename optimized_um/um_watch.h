@@ -0,0 +1,103 @@
+/*
+*   um_watch.h
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This class declares the functions of um_watch, which catches stores into
+*   m[0] with page protection instead of a check on every segmented store.
+*   m[0] lives in its own page-aligned mapping. A page is made read-only once
+*   the engine caches code decoded or built from its words, so the first
+*   store into it faults; the fault handler has the engine forget the
+*   page's decodings, marks it for the engine to drop the rest of what it
+*   cached from it at the next watch_flush, and makes the page writable
+*   again. It stays writable, and stores into it cost nothing, until code
+*   is next cached from it. A program that keeps storing into pages it
+*   runs from stops the watch, and the engine checks each store from then
+*   on.
+*/
+
+#ifndef UM_WATCH_INCLUDED
+#define UM_WATCH_INCLUDED
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+* watch_init
+* Installs the SIGSEGV handler that catches stores into watched pages
+* Arguments:
+*   - on_store - called from the handler, before the store is carried out,
+*                with the words of the page being stored into: first and
+*                count, clipped to the end of m[0]. It may only do what is
+*                safe in a signal handler.
+*   - on_stale - called from watch_flush with the words of each page stored
+*                into since the last flush
+*   - on_stop - called when the watch stops, after which no store is
+*               caught; it may be called from the handler too
+* Return: void
+*/
+void watch_init(void (*on_store)(uint32_t first, uint32_t count),
+                void (*on_stale)(uint32_t first, uint32_t count),
+                void (*on_stop)());
+
+/*
+* watch_words_new
+* Maps a zeroed, writable m[0] of length words. Only one can exist at a time.
+* Arguments:
+*   - length - the number of words
+* Return: the words
+*/
+uint32_t *watch_words_new(uint32_t length);
+
+/*
+* watch_words_free
+* Unmaps an m[0] made by watch_words_new
+* Arguments:
+*   - words, length - the words and their number
+* Return: void
+*/
+void watch_words_free(uint32_t *words, uint32_t length);
+
+/*
+* watch_range
+* Write-protects the pages holding some words of m[0], since code is about
+* to be cached from them
+* Arguments:
+*   - first, count - the words; any past the end of m[0] are ignored
+* Return: void
+*/
+void watch_range(uint32_t first, uint32_t count);
+
+/*
+* watch_flush
+* Hands each page of m[0] stored into since the last flush to on_stale
+* Arguments: None
+* Return: void
+*/
+void watch_flush();
+
+/*
+* watch_active
+* Returns whether stores into m[0] are still being caught
+* Arguments: None
+* Return: false once the watch has stopped
+*/
+bool watch_active();
+
+/*
+* watch_stop
+* Stops catching stores into m[0] for the rest of the run and opens every
+* page of it
+* Arguments: None
+* Return: void
+*/
+void watch_stop();
+
+/*
+* watch_finish
+* Restores the previous SIGSEGV handler
+* Arguments: None
+* Return: void
+*/
+void watch_finish();
+
+#endif
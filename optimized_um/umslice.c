@@ -0,0 +1,91 @@
+/*
+*   umslice.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This file holds umslice, which runs a um program through run_for a
+*   slice of so many instructions at a time, resuming it after each until
+*   it halts, and prints the number of slices it took to stderr. A machine
+*   preempted and resumed must print exactly what it does run straight
+*   through, which is what run_tests.sh checks with it. With -n, the
+*   program runs that many times on one machine, with segments from the
+*   pool, and reset_um between runs alternately keeps and releases the
+*   pool's memory; each run must print what the first did.
+*
+*       ./umslice 1 tests/copy_loop.um
+*       ./umslice -O -n 3 100 tests/copy_loop.um
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "um_engine.h"
+
+static void usage()
+{
+    fprintf(stderr, "Usage: ./umslice [-O] [-n runs] instructions "
+                    "[um instruction file]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    Um_options options = { .safe = false, .memory_budget = 0,
+                           .spill_path = NULL, .compact = false,
+                           .optimize = false, .tier_threshold = 0,
+                           .cache_dir = NULL, .profile = false,
+                           .dump_prefix = NULL, .asm_core = false,
+                           .input_ring = NULL, .output_ring = NULL,
+                           .time_limit_ms = 0, .pool = false,
+                           .record_path = NULL, .replay_path = NULL,
+                           .trace_path = NULL, .events_path = NULL,
+                           .event_sample = 1, .stats_path = NULL,
+                           .aot_images = NULL, .num_aot_images = 0 };
+    unsigned long runs = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "On:")) != -1) {
+        switch (opt) {
+          case 'O':
+              options.optimize = true;
+              break;
+          case 'n':
+              runs = strtoul(optarg, NULL, 10);
+              if (runs == 0) {
+                  usage();
+              }
+              options.pool = true;
+              break;
+          default:
+              usage();
+        }
+    }
+    if (argc - optind != 2) {
+        usage();
+    }
+    Um_budget budget = { strtoull(argv[optind], NULL, 10), 0 };
+    if (budget.instructions == 0) {
+        usage();
+    }
+    FILE *fp = fopen(argv[optind + 1], "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Specified um instruction file does not exist.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    load_um(fp, &options);
+    fclose(fp);
+    uint64_t slices = 0;
+    for (unsigned long run = 0; run < runs; run++) {
+        if (run > 0) {
+            reset_um(run % 2 == 0);
+        }
+        slices++;
+        while (run_for(budget) == UM_PREEMPTED) {
+            slices++;
+        }
+    }
+    free_um();
+    fflush(stdout);
+    fprintf(stderr, "%" PRIu64 " slices\n", slices);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,413 @@
+/*
+*   umtrace.c
+*   Authors: Louis Xue (zxue03) and Kevin Gao (kgao03)
+*
+*   This file holds umtrace, the reader of traces written by um -x (see
+*   um_trace.h). It runs the traced program again on the register file
+*   alone, taking every value that came from outside the registers from the
+*   trace, and prints one line per instruction executed: the pc, the
+*   opcode, and what the instruction did to the registers, segments and
+*   I/O. With -s it prints a summary instead: instructions by opcode and
+*   the pcs executed most often.
+*
+*       ./um -x sandmark.trace ums/sandmark.umz > /dev/null
+*       ./umtrace -s sandmark.trace
+*
+*   Only m[0] is kept, updated by stores into it and by load programs, since
+*   the opcode of each instruction comes from there; other segments are
+*   never needed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <zlib.h>
+#include "um_util.h"
+#include "um_trace.h"
+
+#define READ_BYTES (1 << 16)
+#define TOP_PCS 20
+
+static const char *const names[16] = {
+    "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+    "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV", "?14", "?15"
+};
+
+/*
+* Trace struct, a trace being read, with the value last loaded at each pc
+* of the current program
+*/
+typedef struct Trace {
+    gzFile file;
+    uint8_t bytes[READ_BYTES];
+    int count;
+    int next;
+    uint32_t *last;
+} Trace;
+
+/*
+* next_byte
+* Reads the next byte of the trace
+* Return: false at the end of the trace
+*/
+static bool next_byte(Trace *trace, uint8_t *byte)
+{
+    if (trace->next == trace->count) {
+        trace->count = gzread(trace->file, trace->bytes, READ_BYTES);
+        trace->next = 0;
+        if (trace->count <= 0) {
+            trace->count = 0;
+            return false;
+        }
+    }
+    *byte = trace->bytes[trace->next++];
+    return true;
+}
+
+/*
+* next_value
+* Reads a varint of the trace
+* Return: false at the end of the trace
+*/
+static bool next_value(Trace *trace, uint32_t *value)
+{
+    uint8_t byte;
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (!next_byte(trace, &byte)) {
+            return false;
+        }
+        *value |= (uint32_t) (byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+* next_word
+* Reads a little-endian word of the trace
+* Return: false at the end of the trace
+*/
+static bool next_word(Trace *trace, uint32_t *word)
+{
+    uint8_t byte;
+    *word = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!next_byte(trace, &byte)) {
+            return false;
+        }
+        *word |= (uint32_t) byte << (8 * i);
+    }
+    return true;
+}
+
+/*
+* next_program
+* Reads a program of the trace: its length and words
+* Return: the malloc'd words, or NULL at the end of the trace
+*/
+static uint32_t *next_program(Trace *trace, uint32_t *length)
+{
+    if (!next_value(trace, length)) {
+        return NULL;
+    }
+    uint32_t *words = malloc((*length + 1) * sizeof(uint32_t));
+    free(trace->last);
+    trace->last = calloc(*length + 1, sizeof(uint32_t));
+    if (words == NULL || trace->last == NULL) {
+        fprintf(stderr, "umtrace: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < *length; i++) {
+        if (!next_word(trace, &words[i])) {
+            free(words);
+            return NULL;
+        }
+    }
+    return words;
+}
+
+/*
+* next_load
+* Reads the value of the load at pc
+* Return: false at the end of the trace
+*/
+static bool next_load(Trace *trace, uint32_t pc, uint32_t *value)
+{
+    uint32_t zigzag;
+    if (!next_value(trace, &zigzag)) {
+        return false;
+    }
+    *value = trace->last[pc] + ((zigzag >> 1) ^ -(zigzag & 1));
+    trace->last[pc] = *value;
+    return true;
+}
+
+/*
+* Summary struct, what -s counts
+*/
+typedef struct Summary {
+    uint64_t by_opcode[16];
+    uint64_t *by_pc;
+    uint32_t pcs;
+    uint32_t programs;
+} Summary;
+
+static void count(Summary *summary, uint32_t pc, uint32_t opcode)
+{
+    summary->by_opcode[opcode]++;
+    if (pc >= summary->pcs) {
+        uint32_t pcs = summary->pcs == 0 ? 1024 : summary->pcs;
+        while (pcs <= pc) {
+            pcs *= 2;
+        }
+        summary->by_pc = realloc(summary->by_pc, pcs * sizeof(uint64_t));
+        if (summary->by_pc == NULL) {
+            fprintf(stderr, "umtrace: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(summary->by_pc + summary->pcs, 0,
+               (pcs - summary->pcs) * sizeof(uint64_t));
+        summary->pcs = pcs;
+    }
+    summary->by_pc[pc]++;
+}
+
+static void report(const Summary *summary)
+{
+    uint64_t total = 0;
+    for (int op = 0; op < 16; op++) {
+        total += summary->by_opcode[op];
+    }
+    printf("%" PRIu64 " instructions, %" PRIu32 " programs loaded from "
+           "other segments\n\n", total, summary->programs);
+    for (int op = 0; op < 16; op++) {
+        if (summary->by_opcode[op] != 0) {
+            printf("%-7s %14" PRIu64 " %6.2f%%\n", names[op],
+                   summary->by_opcode[op],
+                   100.0 * summary->by_opcode[op] / total);
+        }
+    }
+
+    // Selection of the hottest pcs, over all the programs run
+    printf("\nhottest pcs\n");
+    bool *taken = calloc(summary->pcs + 1, sizeof(bool));
+    for (int rank = 0; rank < TOP_PCS && taken != NULL; rank++) {
+        uint32_t best = UINT32_MAX;
+        for (uint32_t pc = 0; pc < summary->pcs; pc++) {
+            if (!taken[pc] && summary->by_pc[pc] != 0 &&
+                (best == UINT32_MAX ||
+                 summary->by_pc[pc] > summary->by_pc[best])) {
+                best = pc;
+            }
+        }
+        if (best == UINT32_MAX) {
+            break;
+        }
+        taken[best] = true;
+        printf("%10" PRIu32 " %14" PRIu64 "\n", best, summary->by_pc[best]);
+    }
+    free(taken);
+}
+
+/*
+* replay
+* Runs the traced program from the trace, printing each instruction or
+* counting it into summary if not NULL
+* Return: whether the trace ran to a halt
+*/
+static bool replay(Trace *trace, Summary *summary)
+{
+    uint32_t length;
+    uint32_t *m0 = next_program(trace, &length);
+    if (m0 == NULL) {
+        fprintf(stderr, "umtrace: the trace holds no program\n");
+        return false;
+    }
+    uint32_t r[NUM_REGISTERS] = { 0 };
+    uint32_t pc = 0;
+    uint32_t value;
+
+    while (true) {
+        if (pc >= length) {
+            fprintf(stderr, "umtrace: pc %" PRIu32 " is past the end of "
+                            "m[0]\n", pc);
+            return false;
+        }
+        uint32_t word = m0[pc];
+        uint32_t opcode = word >> 28;
+        uint32_t a = (word >> 6) & 7, b = (word >> 3) & 7, c = word & 7;
+        if (summary != NULL) {
+            count(summary, pc, opcode);
+        } else {
+            printf("%10" PRIu32 "  %-7s", pc, names[opcode]);
+        }
+        pc++;
+
+        // Everything the instruction took from outside the registers
+        if ((opcode == SLOAD && !next_load(trace, pc - 1, &value)) ||
+            ((opcode == ACTIVATE || opcode == IN) &&
+             !next_value(trace, &value))) {
+            break;
+        }
+
+        switch ((Um_opcode) opcode) {
+          case CMOV:
+              if (r[c] != 0) {
+                  r[a] = r[b];
+              }
+              if (summary == NULL) {
+                  if (r[c] != 0) {
+                      printf("r%" PRIu32 " = 0x%08" PRIx32 "\n", a, r[a]);
+                  } else {
+                      printf("not moved\n");
+                  }
+              }
+              continue;
+          case SLOAD:
+              if (summary == NULL) {
+                  printf("r%" PRIu32 " = 0x%08" PRIx32 "  m[%" PRIu32 "][%"
+                         PRIu32 "]\n", a, value, r[b], r[c]);
+              }
+              r[a] = value;
+              continue;
+          case SSTORE:
+              if (summary == NULL) {
+                  printf("m[%" PRIu32 "][%" PRIu32 "] = 0x%08" PRIx32 "\n",
+                         r[a], r[b], r[c]);
+              }
+              if (r[a] == 0 && r[b] < length) {
+                  m0[r[b]] = r[c];
+              }
+              continue;
+          case ADD:
+              r[a] = r[b] + r[c];
+              break;
+          case MUL:
+              r[a] = r[b] * r[c];
+              break;
+          case DIV:
+              if (r[c] == 0) {
+                  fprintf(stderr, "umtrace: division by zero at pc %"
+                                  PRIu32 "\n", pc - 1);
+                  return false;
+              }
+              r[a] = r[b] / r[c];
+              break;
+          case NAND:
+              r[a] = ~(r[b] & r[c]);
+              break;
+          case HALT:
+              if (summary == NULL) {
+                  printf("\n");
+              }
+              free(m0);
+              return true;
+          case ACTIVATE:
+              // The length may be in the register the id goes to
+              if (summary == NULL) {
+                  printf("r%" PRIu32 " = %" PRIu32 "  (%" PRIu32
+                         " words)\n", b, value, r[c]);
+              }
+              r[b] = value;
+              continue;
+          case INACTIVATE:
+              if (summary == NULL) {
+                  printf("m[%" PRIu32 "]\n", r[c]);
+              }
+              continue;
+          case OUT:
+              if (summary == NULL) {
+                  printf("0x%02" PRIx32 "\n", r[c] & 0xff);
+              }
+              continue;
+          case IN:
+              value--;
+              r[c] = value;
+              if (summary == NULL) {
+                  if (value == UINT32_MAX) {
+                      printf("r%" PRIu32 " = EOF\n", c);
+                  } else {
+                      printf("r%" PRIu32 " = 0x%02" PRIx32 "\n", c, value);
+                  }
+              }
+              continue;
+          case LOADP:
+              if (r[b] != 0) {
+                  free(m0);
+                  m0 = next_program(trace, &length);
+                  if (m0 == NULL) {
+                      return false;
+                  }
+                  if (summary != NULL) {
+                      summary->programs++;
+                  }
+              }
+              if (summary == NULL) {
+                  if (r[b] != 0) {
+                      printf("m[%" PRIu32 "] (%" PRIu32 " words), ", r[b],
+                             length);
+                  }
+                  printf("pc %" PRIu32 "\n", r[c]);
+              }
+              pc = r[c];
+              continue;
+          case LV:
+              a = (word >> 25) & 7;
+              r[a] = word & 0x1ffffff;
+              break;
+          default:
+              fprintf(stderr, "umtrace: invalid instruction at pc %"
+                              PRIu32 "\n", pc - 1);
+              return false;
+        }
+
+        // Arithmetic and load value write register a
+        if (summary == NULL) {
+            printf("r%" PRIu32 " = 0x%08" PRIx32 "\n", a, r[a]);
+        }
+    }
+    if (summary == NULL) {
+        printf("\n");
+    }
+    fprintf(stderr, "umtrace: the trace ends before the program halts\n");
+    free(m0);
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    bool summarize = argc == 3 && strcmp(argv[1], "-s") == 0;
+    if (argc != 2 && !summarize) {
+        fprintf(stderr, "Usage: ./umtrace [-s] trace\n");
+        exit(EXIT_FAILURE);
+    }
+
+    static Trace trace;
+    trace.file = gzopen(argv[argc - 1], "rb");
+    if (trace.file == NULL) {
+        fprintf(stderr, "umtrace: could not open %s\n", argv[argc - 1]);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t magic, version;
+    trace.last = NULL;
+    if (!next_word(&trace, &magic) || !next_word(&trace, &version) ||
+        magic != TRACE_MAGIC || version != TRACE_VERSION) {
+        fprintf(stderr, "umtrace: %s is not a trace\n", argv[argc - 1]);
+        exit(EXIT_FAILURE);
+    }
+
+    Summary summary = { { 0 }, NULL, 0, 0 };
+    bool halted = replay(&trace, summarize ? &summary : NULL);
+    if (summarize) {
+        report(&summary);
+        free(summary.by_pc);
+    }
+    gzclose(trace.file);
+    free(trace.last);
+    return halted ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -365,4 +365,423 @@ void edit_instruction_segment(Seq_T stream)
     append(stream, output(r2));
     append(stream, segmented_store(r6, r4, r1));
     append(stream, output(r3));
-}
\ No newline at end of file
+}
+
+/*
+ * Fault tests for the optimized UM's safe mode (-s). Each stops at a fault
+ * without printing anything; optimized_um/run_tests.sh checks what safe
+ * mode reports for it.
+ */
+
+// Fault Test: divide by zero
+void fault_division(Seq_T stream)
+{
+    append(stream, loadval(r1, 3));
+    append(stream, division(r2, r1, r0));
+    append(stream, halt());
+}
+
+// Fault Test: load from a segment that was never mapped
+void fault_unmapped_load(Seq_T stream)
+{
+    append(stream, loadval(r1, 3));
+    append(stream, segmented_load(r2, r1, r0));
+    append(stream, halt());
+}
+
+// Fault Test: load from just past the end of a mapped segment
+void fault_out_of_bounds_load(Seq_T stream)
+{
+    append(stream, loadval(r1, 1));
+    append(stream, map_segment(r2, r1));
+    append(stream, segmented_load(r3, r2, r1));
+    append(stream, halt());
+}
+
+// Fault Test: store far past the end of a mapped segment, beyond any page
+// that follows it
+void fault_far_store(Seq_T stream)
+{
+    append(stream, loadval(r1, 1));
+    append(stream, map_segment(r2, r1));
+    append(stream, loadval(r3, 100000));
+    append(stream, segmented_store(r2, r3, r1));
+    append(stream, halt());
+}
+
+/*
+ * Fault tests whose faulting instruction would be fused with the ones
+ * before it into a superinstruction, were safe mode to fuse them
+ */
+
+// Fault Test: store to an unmapped segment right after a load value
+void fault_fused_store(Seq_T stream)
+{
+    append(stream, loadval(r1, 5));
+    append(stream, segmented_store(r1, r0, r0));
+    append(stream, halt());
+}
+
+// Fault Test: load past the end of a segment right after a load value
+void fault_fused_load(Seq_T stream)
+{
+    append(stream, loadval(r1, 1));
+    append(stream, map_segment(r2, r1));
+    append(stream, loadval(r3, 1));
+    append(stream, segmented_load(r4, r2, r3));
+    append(stream, halt());
+}
+
+// Fault Test: store past the end of a segment as the last of a segmented
+// load, an addition and a segmented store
+void fault_fused_load_add_store(Seq_T stream)
+{
+    append(stream, loadval(r1, 1));
+    append(stream, map_segment(r2, r1));
+    append(stream, loadval(r3, 1));
+    append(stream, addition(r5, r0, r0));
+    append(stream, segmented_load(r4, r2, r0));
+    append(stream, addition(r4, r4, r4));
+    append(stream, segmented_store(r2, r3, r4));
+    append(stream, halt());
+}
+
+// Fault Test: load an unmapped segment as the program right after a load
+// value
+void fault_fused_load_program(Seq_T stream)
+{
+    append(stream, loadval(r1, 9));
+    append(stream, addition(r3, r1, r0));
+    append(stream, loadval(r2, 0));
+    append(stream, load_program(r1, r2));
+}
+
+/*
+ * Tests of the optimized UM's -O option, which optimizes each block entered
+ * by a load program before running it. Each is an ordinary UM program.
+ */
+
+// Optimizer Test: constants computed, overwritten and moved in a block,
+// and values it leaves for the next block
+void constant_folding(Seq_T stream)
+{
+    append(stream, loadval(r7, 2));
+    append(stream, load_program(r0, r7));
+
+    append(stream, loadval(r1, 6));
+    append(stream, loadval(r2, 7));
+    append(stream, multiplication(r3, r1, r2));
+    append(stream, loadval(r4, 100));
+    append(stream, loadval(r4, 2));
+    append(stream, division(r5, r3, r4));
+    append(stream, addition(r5, r5, r3));
+    append(stream, output(r5));
+    append(stream, bitwise_NAND(r6, r1, r1));
+    append(stream, bitwise_NAND(r6, r6, r6));
+    append(stream, loadval(r1, 48));
+    append(stream, addition(r6, r6, r1));
+    append(stream, conditional_move(r6, r3, r0));
+    append(stream, output(r6));
+    append(stream, conditional_move(r1, r3, r4));
+    append(stream, output(r1));
+    append(stream, loadval(r7, Seq_length(stream) + 2));
+    append(stream, load_program(r0, r7));
+
+    append(stream, output(r3));
+    append(stream, halt());
+}
+
+/*
+ * Appends the end of a loop that starts at index start: a load program
+ * back to start while counter is nonzero, and on past the loop once it is
+ * zero. target and temp are overwritten.
+ */
+static void loop_back(Seq_T stream, uint32_t start, Um_register counter,
+                      Um_register target, Um_register temp)
+{
+    append(stream, loadval(target, Seq_length(stream) + 4));
+    append(stream, loadval(temp, start));
+    append(stream, conditional_move(target, temp, counter));
+    append(stream, load_program(r0, target));
+}
+
+/*
+ * Appends a loop that stores value into count words of segment from index
+ * first on, counting r4 up and r5 down. r6, r7 and r3 are overwritten.
+ */
+static void fill_words(Seq_T stream, Um_register segment, unsigned first,
+                       unsigned count, unsigned value)
+{
+    append(stream, loadval(r4, first));
+    append(stream, loadval(r5, count));
+    append(stream, loadval(r6, value));
+    uint32_t start = Seq_length(stream);
+    append(stream, segmented_store(segment, r4, r6));
+    append(stream, loadval(r7, 1));
+    append(stream, addition(r4, r4, r7));
+    append(stream, bitwise_NAND(r7, r0, r0));
+    append(stream, addition(r5, r5, r7));
+    loop_back(stream, start, r5, r7, r3);
+}
+
+/*
+ * Appends the instructions that output word index of segment, plus
+ * offset. r4, r6 and r7 are overwritten.
+ */
+static void output_word(Seq_T stream, Um_register segment, unsigned index,
+                        unsigned offset)
+{
+    append(stream, loadval(r4, index));
+    append(stream, segmented_load(r6, segment, r4));
+    append(stream, loadval(r7, offset));
+    append(stream, addition(r6, r6, r7));
+    append(stream, output(r6));
+}
+
+/*
+ * Appends the instructions that output register value less subtrahend.
+ * r3, r6 and r7 are overwritten.
+ */
+static void output_difference(Seq_T stream, Um_register value,
+                              unsigned subtrahend)
+{
+    append(stream, loadval(r7, subtrahend));
+    append(stream, bitwise_NAND(r7, r7, r7));
+    append(stream, loadval(r3, 1));
+    append(stream, addition(r7, r7, r3));
+    append(stream, addition(r6, value, r7));
+    append(stream, output(r6));
+}
+
+// Optimizer Test: a loop that fills all but the last word of a segment
+void fill_loop(Seq_T stream)
+{
+    append(stream, loadval(r1, 1000));
+    append(stream, map_segment(r2, r1));
+    fill_words(stream, r2, 0, 999, 'A');
+    output_word(stream, r2, 0, 0);
+    output_word(stream, r2, 998, 0);
+    output_word(stream, r2, 999, '0');
+    append(stream, halt());
+}
+
+// Optimizer Test: loops that copy a segment forwards, copy words onto the
+// next word of the same segment, and copy part of a segment backwards
+void copy_loop(Seq_T stream)
+{
+    append(stream, loadval(r1, 1000));
+    append(stream, map_segment(r2, r1));
+    append(stream, map_segment(r1, r1));
+    fill_words(stream, r2, 0, 1000, 'A');
+    fill_words(stream, r2, 500, 1, 'B');
+
+    // Copy all of r2 into r1
+    append(stream, loadval(r4, 0));
+    append(stream, loadval(r5, 1000));
+    uint32_t start = Seq_length(stream);
+    append(stream, segmented_load(r6, r2, r4));
+    append(stream, segmented_store(r1, r4, r6));
+    append(stream, loadval(r7, 1));
+    append(stream, addition(r4, r4, r7));
+    append(stream, bitwise_NAND(r7, r0, r0));
+    append(stream, addition(r5, r5, r7));
+    loop_back(stream, start, r5, r7, r3);
+    output_word(stream, r1, 499, 0);
+    output_word(stream, r1, 500, 0);
+    output_word(stream, r1, 999, 0);
+
+    // Copy r2[i] into r2[i + 1] ten times, spreading r2[0] over r2[1..10]
+    fill_words(stream, r2, 0, 1, 'C');
+    append(stream, loadval(r4, 0));
+    append(stream, loadval(r5, 10));
+    start = Seq_length(stream);
+    append(stream, segmented_load(r6, r2, r4));
+    append(stream, loadval(r7, 1));
+    append(stream, addition(r4, r4, r7));
+    append(stream, segmented_store(r2, r4, r6));
+    append(stream, bitwise_NAND(r7, r0, r0));
+    append(stream, addition(r5, r5, r7));
+    loop_back(stream, start, r5, r7, r3);
+    output_word(stream, r2, 5, 0);
+    output_word(stream, r2, 10, 0);
+    output_word(stream, r2, 11, 0);
+
+    // Copy r2[999] down to r2[900] into r1, and no further
+    fill_words(stream, r2, 950, 1, 'D');
+    fill_words(stream, r2, 899, 1, 'E');
+    append(stream, loadval(r4, 999));
+    append(stream, loadval(r5, 100));
+    start = Seq_length(stream);
+    append(stream, segmented_load(r6, r2, r4));
+    append(stream, segmented_store(r1, r4, r6));
+    append(stream, bitwise_NAND(r7, r0, r0));
+    append(stream, addition(r4, r4, r7));
+    append(stream, addition(r5, r5, r7));
+    loop_back(stream, start, r5, r7, r3);
+    output_word(stream, r1, 950, 0);
+    output_word(stream, r1, 899, 0);
+    append(stream, halt());
+}
+
+// Optimizer Test: loops that compare two segments until they differ, and
+// scan a segment for a zero word
+void compare_loop(Seq_T stream)
+{
+    append(stream, loadval(r1, 1000));
+    append(stream, map_segment(r2, r1));
+    append(stream, map_segment(r1, r1));
+    fill_words(stream, r2, 0, 1000, 'A');
+    fill_words(stream, r1, 0, 1000, 'A');
+    fill_words(stream, r1, 700, 1, 'Z');
+
+    // Count r4 up while r2[r4] - r1[r4] is zero, for at most 1000 words
+    append(stream, loadval(r4, 0));
+    append(stream, loadval(r5, 1000));
+    uint32_t start = Seq_length(stream);
+    append(stream, segmented_load(r6, r2, r4));
+    append(stream, segmented_load(r7, r1, r4));
+    append(stream, bitwise_NAND(r7, r7, r7));
+    append(stream, loadval(r3, 1));
+    append(stream, addition(r7, r7, r3));
+    append(stream, addition(r6, r6, r7));
+    append(stream, addition(r4, r4, r3));
+    append(stream, bitwise_NAND(r7, r0, r0));
+    append(stream, addition(r5, r5, r7));
+    uint32_t end = Seq_length(stream) + 6;
+    append(stream, loadval(r7, end));
+    append(stream, loadval(r3, start));
+    append(stream, conditional_move(r7, r3, r5));
+    append(stream, loadval(r3, end));
+    append(stream, conditional_move(r7, r3, r6));
+    append(stream, load_program(r0, r7));
+    output_difference(stream, r4, 700 - '0');
+    output_difference(stream, r5, 250);
+
+    // Count r4 up from 600 past the first zero word of r2, at 800
+    append(stream, loadval(r4, 800));
+    append(stream, segmented_store(r2, r4, r0));
+    append(stream, loadval(r4, 600));
+    start = Seq_length(stream);
+    append(stream, segmented_load(r6, r2, r4));
+    append(stream, loadval(r7, 1));
+    append(stream, addition(r4, r4, r7));
+    loop_back(stream, start, r6, r7, r3);
+    output_difference(stream, r4, 801 - '0');
+    append(stream, halt());
+}
+
+// Optimizer Test: a loop that rewrites the instruction after its store
+// into m[0] every time round, between two words that output different
+// letters, so each letter output is the one just stored
+void self_modifying_loop(Seq_T stream)
+{
+    append(stream, loadval(r7, 10));
+
+    // r6: the word of loadval(r1, 'b'), and r3: -1
+    append(stream, loadval(r6, 0xd2));
+    append(stream, loadval(r3, 1 << 24));
+    append(stream, multiplication(r6, r6, r3));
+    append(stream, loadval(r3, 'b'));
+    append(stream, addition(r6, r6, r3));
+    append(stream, bitwise_NAND(r3, r0, r0));
+
+    // Enter the loop by a load program, as the optimizer needs
+    append(stream, loadval(r2, Seq_length(stream) + 2));
+    append(stream, load_program(r0, r2));
+
+    // Swap r6 with the word at the loadval below, then run that word
+    uint32_t start = Seq_length(stream);
+    append(stream, loadval(r4, start + 4));
+    append(stream, segmented_load(r5, r0, r4));
+    append(stream, segmented_store(r0, r4, r6));
+    append(stream, addition(r6, r5, r0));
+    append(stream, loadval(r1, 'a'));
+    append(stream, output(r1));
+    append(stream, addition(r7, r7, r3));
+    loop_back(stream, start, r7, r2, r5);
+    append(stream, halt());
+}
+
+// Stress Test: maps 16 segments of 256 KiB, more than the optimized UM's
+// -m 1 budget holds, storing a letter into the last word of each, then
+// outputs the letters back in the order the segments were mapped
+void large_segments(Seq_T stream)
+{
+    append(stream, loadval(r1, 65536));
+    append(stream, loadval(r2, 'a'));
+    append(stream, loadval(r5, 16));
+    uint32_t start = Seq_length(stream);
+    append(stream, map_segment(r3, r1));
+    append(stream, loadval(r4, 65535));
+    append(stream, segmented_store(r3, r4, r2));
+    append(stream, loadval(r7, 1));
+    append(stream, addition(r2, r2, r7));
+    append(stream, bitwise_NAND(r7, r0, r0));
+    append(stream, addition(r5, r5, r7));
+    loop_back(stream, start, r5, r7, r6);
+
+    append(stream, loadval(r3, 1));
+    append(stream, loadval(r5, 16));
+    start = Seq_length(stream);
+    append(stream, loadval(r4, 65535));
+    append(stream, segmented_load(r6, r3, r4));
+    append(stream, output(r6));
+    append(stream, loadval(r7, 1));
+    append(stream, addition(r3, r3, r7));
+    append(stream, bitwise_NAND(r7, r0, r0));
+    append(stream, addition(r5, r5, r7));
+    loop_back(stream, start, r5, r7, r6);
+    append(stream, halt());
+}
+
+// Input Test: reads a byte into a mapped segment and outputs it from
+// there, so the segment is live while the machine waits for input
+void input_to_segment(Seq_T stream)
+{
+    append(stream, loadval(r1, 1000));
+    append(stream, map_segment(r2, r1));
+    append(stream, loadval(r4, 999));
+    append(stream, input(r3));
+    append(stream, segmented_store(r2, r4, r3));
+    append(stream, segmented_load(r5, r2, r4));
+    append(stream, output(r5));
+    append(stream, halt());
+}
+
+// Budget Test: outputs a letter, then loads the program at the load
+// program itself forever
+void endless_loop(Seq_T stream)
+{
+    append(stream, loadval(r1, 'a'));
+    append(stream, output(r1));
+    append(stream, loadval(r2, 3));
+    append(stream, load_program(r0, r2));
+}
+
+// Self-Modifying Test: outputs a letter, rewrites the load value that
+// loaded it to load the next letter, and runs it again, so that a machine
+// run again from the start must find the first letter back in place
+void self_modifying_restart(Seq_T stream)
+{
+    append(stream, loadval(r1, 'a'));
+    append(stream, output(r1));
+
+    // Halt once the rewritten word has run
+    uint32_t halt_at = Seq_length(stream) + 12;
+    append(stream, loadval(r2, Seq_length(stream) + 4));
+    append(stream, loadval(r3, halt_at));
+    append(stream, conditional_move(r2, r3, r7));
+    append(stream, load_program(r0, r2));
+
+    // r6: the word of loadval(r1, 'b'), stored over the first word
+    append(stream, loadval(r6, 0xd2));
+    append(stream, loadval(r3, 1 << 24));
+    append(stream, multiplication(r6, r6, r3));
+    append(stream, loadval(r3, 'b'));
+    append(stream, addition(r6, r6, r3));
+    append(stream, segmented_store(r0, r0, r6));
+    append(stream, loadval(r7, 1));
+    append(stream, load_program(r0, r0));
+    assert((uint32_t) Seq_length(stream) == halt_at);
+    append(stream, halt());
+}
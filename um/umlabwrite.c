@@ -30,6 +30,23 @@ extern void check_initial_register_values(Seq_T stream);
 extern void segment_words_initial_values(Seq_T stream);
 extern void segment_ids_reused(Seq_T stream);
 extern void edit_instruction_segment(Seq_T stream);
+extern void large_segments(Seq_T stream);
+extern void input_to_segment(Seq_T stream);
+extern void constant_folding(Seq_T stream);
+extern void fill_loop(Seq_T stream);
+extern void copy_loop(Seq_T stream);
+extern void compare_loop(Seq_T stream);
+extern void self_modifying_loop(Seq_T stream);
+extern void self_modifying_restart(Seq_T stream);
+extern void endless_loop(Seq_T stream);
+extern void fault_division(Seq_T stream);
+extern void fault_unmapped_load(Seq_T stream);
+extern void fault_out_of_bounds_load(Seq_T stream);
+extern void fault_far_store(Seq_T stream);
+extern void fault_fused_store(Seq_T stream);
+extern void fault_fused_load(Seq_T stream);
+extern void fault_fused_load_add_store(Seq_T stream);
+extern void fault_fused_load_program(Seq_T stream);
 
 /* The array `tests` contains all unit tests for the lab. */
 
@@ -62,7 +79,31 @@ static struct test_info {
         { "map_and_umap_0_segments", NULL, "F", map_and_umap_0_segments },
         { "halt_instruction_from_load_program", NULL, "F", halt_from_load_program},
         { "initial_register_value_check", NULL, "00000000", check_initial_register_values},
-        { "edit_instruction_segment", NULL, "1", edit_instruction_segment }
+        { "edit_instruction_segment", NULL, "1", edit_instruction_segment },
+        { "large_segments", NULL, "abcdefghijklmnop", large_segments },
+        { "input_to_segment", "C", "C", input_to_segment },
+
+        // Optimizer tests, for the optimized UM's -O
+        { "constant_folding", NULL, "?6**", constant_folding },
+        { "fill_loop", NULL, "AA0", fill_loop },
+        { "copy_loop", NULL, "ABACCADA", copy_loop },
+        { "compare_loop", NULL, "110", compare_loop },
+        { "self_modifying_loop", NULL, "bababababa", self_modifying_loop },
+        { "self_modifying_restart", NULL, "ab", self_modifying_restart },
+
+        // Budget tests, for the optimized UM's -T
+        { "endless_loop", NULL, "a", endless_loop },
+
+        // Fault tests, for the optimized UM's safe mode
+        { "fault_division", NULL, "", fault_division },
+        { "fault_unmapped_load", NULL, "", fault_unmapped_load },
+        { "fault_out_of_bounds_load", NULL, "", fault_out_of_bounds_load },
+        { "fault_far_store", NULL, "", fault_far_store },
+        { "fault_fused_store", NULL, "", fault_fused_store },
+        { "fault_fused_load", NULL, "", fault_fused_load },
+        { "fault_fused_load_add_store", NULL, "",
+          fault_fused_load_add_store },
+        { "fault_fused_load_program", NULL, "", fault_fused_load_program }
         // { "segment_ids_reused", NULL, "0", segment_ids_reused}
         // { "segment_words_initial_values", NULL, "0000", segment_words_initial_values}
 };